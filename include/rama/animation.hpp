@@ -0,0 +1,115 @@
+#pragma once
+#include <rama/engine.hpp>
+
+//
+// Local joint transforms as ten float streams (translation xyz, rotation
+// xyzw, scale xyz) of `stride` floats each. stride is the joint count
+// rounded up to four so the streams can be processed four joints at a time.
+//
+struct Pose {
+  enum Stream { tx, ty, tz, rx, ry, rz, rw, sx, sy, sz, stream_count };
+
+  ArrayList<f32> data;
+  u32 stride = 0;
+
+  void resize(u32 joints);
+
+  f32 *stream(u32 s) { return data.data() + s * stride; }
+  const f32 *stream(u32 s) const { return data.data() + s * stride; }
+};
+
+//
+// Joints are the nodes of the model file in depth-first order, so every
+// parent precedes its children and Mesh::load can refer to them by index.
+//
+class Skeleton {
+public:
+  ArrayList<string> names;
+  ArrayList<i32> parent;
+  Pose bind_pose;
+  // mesh space -> bone space, identity for joints without a bone
+  ArrayList<Mat4> offset;
+  Mat4 global_inverse = Mat4(1);
+
+  static Skeleton load(string path);
+
+  u32 joint_count() const { return names.size(); }
+};
+
+//
+// An animation resampled at a fixed rate when loaded, so sampling at any
+// time is a blend of two neighbouring frames for every joint at once rather
+// than a per-channel key search.
+//
+class AnimationClip {
+private:
+  // frame-major, each frame laid out like a Pose
+  ArrayList<f32> frames;
+  u32 frame_count = 0;
+  u32 stride = 0;
+
+  friend class AnimationSystem;
+
+public:
+  string name;
+  f32 duration = 0;
+  f32 sample_rate = 30.0f;
+
+  static AnimationClip load(string path, const Skeleton &skeleton,
+                            u32 index = 0);
+
+  void sample(f32 time, bool loop, Pose &out) const;
+};
+
+//
+// Evaluates every animated instance on the job system and writes the
+// skinning matrices into one palette SSBO (binding 5). Playing a new clip
+// cross-fades from the current one.
+//
+class AnimationSystem {
+private:
+  struct Instance {
+    const Skeleton *skeleton;
+    const AnimationClip *clip = nullptr;
+    const AnimationClip *previous = nullptr;
+    f32 time = 0, previous_time = 0;
+    f32 fade = 0, fade_duration = 0;
+    f32 speed = 1.0f;
+    bool loop = true, previous_loop = true;
+    u32 palette_offset;
+  };
+
+  struct Scratch {
+    Pose current, previous;
+    ArrayList<Mat4> model;
+  };
+
+  ArrayList<Instance> instances;
+  ArrayList<Scratch> scratch;
+  ArrayList<Mat4> palette;
+
+  u32 ssbo;
+  usize capacity = 0;
+
+  void evaluate(Instance &instance, Scratch &scratch);
+
+public:
+  static AnimationSystem make();
+  void destroy();
+
+  // the skeleton and clips must outlive the system
+  u32 add(const Skeleton &skeleton);
+  void play(u32 instance, const AnimationClip &clip, f32 fade, bool loop);
+  void set_speed(u32 instance, f32 speed);
+
+  u32 count() { return instances.size(); }
+
+  // advances, samples and blends every instance, then uploads the palette
+  void update(f32 dt);
+
+  void bind();
+  // sets `bone_offset` to the instance's first palette entry
+  void apply(Shader &shader, u32 instance);
+
+  static string glsl();
+};
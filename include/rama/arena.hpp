@@ -0,0 +1,141 @@
+#pragma once
+#include <rama/engine.hpp>
+
+//
+// Two-level segregated fit allocator over an abstract range of units. It
+// only does the bookkeeping, the memory itself lives elsewhere (here, in GL
+// buffers). Allocation and free are O(1): a free block is found through two
+// bitmaps, and freed blocks merge with their free physical neighbours.
+//
+class TlsfAllocator {
+public:
+  static constexpr u32 none = UINT32_MAX;
+
+private:
+  static constexpr u32 sl_bits = 4;
+  static constexpr u32 sl_count = 1 << sl_bits;
+  static constexpr u32 fl_count = 32;
+
+  struct Block {
+    u32 offset, size;
+    u32 prev_phys, next_phys;
+    u32 prev_free, next_free;
+    bool free;
+  };
+
+  ArrayList<Block> blocks;
+  ArrayList<u32> unused;
+
+  u32 fl_bitmap = 0;
+  Array<u32, fl_count> sl_bitmap{};
+  Array<Array<u32, sl_count>, fl_count> heads;
+
+  u32 capacity = 0, used = 0;
+
+  u32 new_block(u32 offset, u32 size);
+  void insert(u32 block);
+  void remove(u32 block);
+  u32 split(u32 block, u32 size);
+  void merge(u32 left, u32 right);
+
+public:
+  static TlsfAllocator make(u32 capacity);
+  // blocks 0..n-1 allocated back to back with `sizes`, the rest free
+  static TlsfAllocator make_packed(u32 capacity, const ArrayList<u32> &sizes);
+
+  // returns a block id, or none when no free block is large enough
+  u32 allocate(u32 size);
+  void free(u32 block);
+
+  u32 offset(u32 block) const { return blocks[block].offset; }
+  u32 size(u32 block) const { return blocks[block].size; }
+
+  u32 total() const { return capacity; }
+  u32 used_units() const { return used; }
+  u32 free_blocks() const;
+  u32 largest_free() const;
+};
+
+// 48 bytes, std430 layout mirrored by GeometryArena::glsl()
+struct ArenaVertex {
+  Vec4f position_u;
+  Vec4f normal_v;
+  Vec4f tangent;
+};
+
+// matches the GL DrawElementsIndirectCommand layout
+struct ArenaDrawCommand {
+  u32 count;
+  u32 instance_count;
+  u32 first_index;
+  i32 base_vertex;
+  u32 base_instance;
+};
+
+struct ArenaStats {
+  u32 meshes = 0;
+  u32 vertex_capacity = 0, vertex_used = 0, vertex_free_blocks = 0;
+  u32 index_capacity = 0, index_used = 0, index_free_blocks = 0;
+  // 0 when all free space is one block, towards 1 as it splinters
+  f32 vertex_fragmentation = 0, index_fragmentation = 0;
+  u32 defragmentations = 0;
+};
+
+//
+// All arena meshes share one vertex SSBO (binding 6), one index buffer and
+// one VAO with no attributes. Shaders pull their vertex by gl_VertexID,
+// which includes the draw's base vertex, so indices stay mesh-relative and
+// switching meshes is just a different offset in the draw call.
+//
+// When an allocation doesn't fit, the arena compacts itself if that frees
+// enough room and otherwise doubles the buffer.
+//
+class GeometryArena {
+private:
+  struct Entry {
+    u32 vertex_block = TlsfAllocator::none;
+    u32 index_block = TlsfAllocator::none;
+    u32 index_count = 0;
+  };
+
+  TlsfAllocator vertex_alloc, index_alloc;
+  u32 vertex_buffer, index_buffer, indirect_buffer, vao;
+  usize indirect_capacity = 0;
+
+  ArrayList<Entry> entries;
+  ArrayList<u32> free_entries;
+  u32 live = 0;
+  u32 defragmentations = 0;
+
+  u32 reserve(TlsfAllocator &alloc, u32 &buffer, usize unit, u32 size);
+  void relocate(TlsfAllocator &alloc, u32 &buffer, usize unit,
+                u32 Entry::*block, u32 new_capacity);
+
+public:
+  static GeometryArena make(u32 vertex_capacity = 1 << 20,
+                            u32 index_capacity = 1 << 22);
+  void destroy();
+
+  // returns a mesh id that stays valid across defragmentation
+  u32 add(const ArrayList<ArenaVertex> &vertices,
+          const ArrayList<u32> &indices);
+  u32 add(const Mesh &mesh);
+  void remove(u32 mesh);
+
+  // packs every allocation to the front of its buffer
+  void defragment();
+
+  // binds the shared VAO and vertex SSBO, needed before any draw
+  void bind();
+  void draw(u32 mesh, u32 instances = 1, u32 base_instance = 0);
+
+  ArenaDrawCommand command(u32 mesh, u32 instances = 1,
+                           u32 base_instance = 0);
+  // one glMultiDrawElementsIndirect for the whole list
+  void multi_draw(const ArrayList<ArenaDrawCommand> &commands);
+
+  ArenaStats stats();
+  void draw_panel();
+
+  static string glsl();
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <rama/engine.hpp>
+#include <rama/scripting.hpp>
+
+#include <functional>
+
+//
+// Asynchronous framebuffer readback. Each captured frame is copied into one
+// of a ring of pixel-pack buffers guarded by a fence, and is only mapped once
+// the fence has signalled a few frames later, so capturing never stalls the
+// GL pipeline. Encoding and the user callback run on encoder threads.
+//
+namespace capture {
+
+// RGBA8, top row first
+struct CapturedFrame {
+  u64 index = 0;
+  u32 width = 0, height = 0;
+  ArrayList<u8> pixels;
+};
+
+// called from an encoder thread
+using Callback = std::function<void(const CapturedFrame &frame)>;
+
+void init(u32 ring_size = 4, u32 encoder_threads = 0);
+void shutdown();
+
+// called once per frame by the engine after the game has rendered
+void frame(Framebuffer &framebuffer);
+
+void screenshot(string path);
+
+void start_recording(string directory);
+void stop_recording();
+bool is_recording();
+
+void set_callback(Callback callback);
+
+u64 dropped_frames();
+
+void RegisterLuaModule(sol::state &state);
+
+} // namespace capture
@@ -0,0 +1,64 @@
+#pragma once
+#include <rama/engine.hpp>
+
+struct Frustum {
+  Array<Vec4f, 6> planes;
+
+  static Frustum make(Mat4 viewproj);
+
+  bool intersects_sphere(Vec3f center, f32 radius) const;
+};
+
+struct DrawItem {
+  Mesh *mesh;
+  Shader *shader;
+  Mat4 model;
+  u32 material;
+};
+
+struct DrawPacket {
+  u64 key;
+  Mesh *mesh;
+  Shader *shader;
+  Mat4 model;
+  u32 material;
+};
+
+// Per-worker output of DrawList::build, only ever touched by one thread.
+class CommandList {
+public:
+  ArrayList<DrawPacket> packets;
+
+  void clear() { packets.clear(); }
+  void push(DrawPacket packet) { packets.push_back(packet); }
+};
+
+//
+// Culls and sorts draw items on the job system, then replays the result on
+// the GL thread. Items are split into partitions of `partition_size` and each
+// worker writes to its own CommandList, so building never takes a lock.
+//
+// The material index (see MaterialTable) is passed as the base instance, so
+// it costs no state change and isn't part of the sort key.
+//
+class DrawList {
+private:
+  ArrayList<DrawItem> items;
+  ArrayList<CommandList> lists;
+  ArrayList<DrawPacket> merged;
+
+public:
+  u32 partition_size = 256;
+
+  u32 visible = 0, culled = 0;
+
+  static DrawList make();
+  void destroy();
+
+  void add(Mesh &mesh, Shader &shader, Mat4 model);
+  void add(Mesh &mesh, Shader &shader, Mat4 model, u32 material);
+  void clear();
+
+  void build(Mat4 perspective, Mat4 view);
+  void submit(Mat4 perspective, Mat4 view);
+};
@@ -25,6 +25,8 @@
 
 #include <nlohmann/json.hpp>
 
+class PostProcess;
+
 class Texture {
 private:
   string path;
@@ -44,6 +46,10 @@ private:
   string path;
   u32 program;
 
+  friend class DrawList;
+  friend class AnimationSystem;
+  friend class ShaderVariants;
+
 public:
   static Shader load(string path);
   static Shader make(string vertex_src, string fragment_src);
@@ -56,7 +62,10 @@ public:
   void uniform(string name, Vec3f val);
   void uniform(string name, Vec2f val);
   void uniform(string name, f32 val);
-  void uniform(string name, Texture val);
+  void uniform(string name, const Texture &val);
+
+  // points a sampler uniform at a texture unit
+  void sampler(string name, i32 unit);
 };
 
 class Mesh {
@@ -68,16 +77,47 @@ private:
   ArrayList<Vec3f> bitangents;
   ArrayList<u32> indices;
 
+  // up to four influences per vertex, indices are Skeleton joint indices.
+  // empty for static meshes.
+  ArrayList<Vec4u> bone_ids;
+  ArrayList<Vec4f> bone_weights;
+
+  // the lightmap channel, attribute 7, in its own buffer. empty if unused
+  ArrayList<Vec2f> uv2s;
+
   u32 vao, vbo, ibo;
+  u32 uv2_vbo = 0;
+
+  // bounding sphere in model space
+  Vec3f center = Vec3f(0);
+  f32 radius = 0;
+
+  friend class DrawList;
+  friend class GeometryArena;
+  friend class Impostor;
+  friend class LightmapBaker;
+
+  // records the mesh's buffers with gpu_memory
+  void track_memory();
 
 public:
   static Mesh load(string path);
   static Mesh make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
                    ArrayList<Vec3f> normals, ArrayList<Vec3f> tangents,
                    ArrayList<Vec3f> bitangents, ArrayList<u32> indices);
+  static Mesh make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
+                   ArrayList<Vec3f> normals, ArrayList<Vec3f> tangents,
+                   ArrayList<Vec3f> bitangents, ArrayList<u32> indices,
+                   ArrayList<Vec4u> bone_ids, ArrayList<Vec4f> bone_weights);
   void destroy();
 
+  bool skinned() { return !bone_ids.empty(); }
+
+  void set_uv2(ArrayList<Vec2f> uv2);
+  bool has_uv2() { return !uv2s.empty(); }
+
   void draw();
+  void draw_instanced(u32 instances, u32 base_instance);
 };
 
 struct SpriteSheetMetadata {
@@ -152,9 +192,13 @@ class Framebuffer {
 private:
 public:
   u32 fbo, rbo, albedo;
+  u32 width = 0, height = 0;
   bool depth_test;
 
-  static Framebuffer make(bool depth_test);
+  // RGB16F colour instead of RGB8, for lighting past 1.0 and tonemapping
+  bool hdr = false;
+
+  static Framebuffer make(bool depth_test, bool hdr = false);
   void destroy();
 
   void bind();
@@ -189,6 +233,28 @@ constexpr auto WorldUp = Vec3f(0, 1, 0);
 constexpr auto WorldRight = Vec3f(1, 0, 0);
 
 f32 DeltaTime();
+f32 RawDeltaTime();
+
+enum class VSync { off, on, adaptive };
+
+// frame times are in milliseconds, over the last few hundred frames
+struct FrameStats {
+  f32 average = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+  u32 samples = 0;
+};
+
+void set_vsync(VSync mode);
+VSync get_vsync();
+
+// 0 disables the limiter
+void set_target_fps(f32 fps);
+f32 get_target_fps();
+
+// dt is clamped to `max_dt` and then exponentially smoothed, 0 = no smoothing
+void set_max_delta_time(f32 max_dt);
+void set_delta_time_smoothing(f32 smoothing);
+
+FrameStats get_frame_stats();
 
 Vec3f safe_normalize(Vec3f val);
 
@@ -221,9 +287,31 @@ string get_GLSLVersion();
 
 Vec2f get_game_size();
 
+// the part of the game framebuffer the scene is drawn into, smaller than the
+// game size while dynamic resolution is scaling down
+Vec2f get_render_size();
+
 void set_framebuffer(Framebuffer &frame);
+
+// run after draw() on the game framebuffer, nullptr turns it off
+void set_post_process(PostProcess *post);
+PostProcess *get_post_process();
 void set_clear_color(f32 x, f32 y, f32 z);
 
+// set by --headless or RAMA_HEADLESS=1, see main()
+bool is_headless();
+
+// set by --shipping, RAMA_SHIPPING=1 or building with RAMA_SHIPPING: no
+// editor shell, the game draws straight into the window
+bool is_shipping();
+
+// ImGui is always up in the editor, shipping runs create it on first use
+void enable_imgui();
+bool imgui_enabled();
+// for code about to submit widgets: creates ImGui if a game frame is running
+// without it, and returns whether an ImGui frame is open to draw into
+bool imgui_available();
+
 template <typename... Args>
 void info(spdlog::format_string_t<Args...> fmt, Args &&...args) {
   spdlog::info(fmt, std::forward<Args>(args)...);
@@ -0,0 +1,62 @@
+#pragma once
+#include <rama/engine.hpp>
+
+class MaterialTable;
+
+//
+// A glTF/GLB model drawn straight from its own buffer views. Every
+// bufferView is uploaded as one GL buffer directly from the file's binary
+// blob and the vertex attributes point into it with the accessor's offset,
+// stride and component type, so nothing is unpacked or repacked on the CPU.
+//
+// Attributes use the same locations as Mesh: POSITION 0, TEXCOORD_0 1,
+// NORMAL 2, TANGENT 3 (vec4, w is the bitangent sign), JOINTS_0 5 and
+// WEIGHTS_0 6. Joint indices are relative to the glTF skin.
+//
+class GltfModel {
+private:
+  struct Primitive {
+    u32 vao;
+    u32 mode;
+    u32 count;
+    // 0 for non-indexed primitives
+    u32 index_type;
+    usize index_offset;
+    u32 material;
+
+    // bounding sphere in mesh space, negative radius when POSITION has no
+    // bounds and the primitive is never culled
+    Vec3f center = Vec3f(0);
+    f32 radius = -1.0f;
+  };
+
+  struct Instance {
+    u32 primitive;
+    Mat4 transform;
+  };
+
+  ArrayList<u32> buffers;
+  ArrayList<Primitive> primitives;
+  ArrayList<Instance> instances;
+
+  void draw_instance(Shader &shader, const Instance &instance, Mat4 model);
+
+public:
+  f64 load_ms = 0;
+
+  // materials are added to `materials` when given, otherwise every
+  // primitive uses material 0
+  static GltfModel load(string path, MaterialTable *materials = nullptr);
+  void destroy();
+
+  // sets `model` per node and passes the material as the base instance,
+  // like DrawList
+  void draw(Shader &shader, Mat4 model);
+  // the same, skipping primitives whose bounds are outside the view
+  void draw(Shader &shader, Mat4 model, Mat4 perspective, Mat4 view);
+
+  u32 primitive_count() { return primitives.size(); }
+
+  // loads `path` with both this loader and Mesh::load and logs the times
+  static void benchmark(string path);
+};
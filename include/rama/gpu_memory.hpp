@@ -0,0 +1,47 @@
+#pragma once
+#include <rama/scripting.hpp>
+#include <rama/types.hpp>
+
+//
+// A registry of the GPU memory the engine allocates. Texture::make,
+// Mesh::make and Framebuffer::make/UpdateSize record every allocation here
+// with its size, format and owning asset, keyed by category and GL name, and
+// destroy() takes it out again. Sizes are what the allocation asks for; the
+// driver's padding and alignment are not visible from GL.
+//
+namespace gpu_memory {
+
+enum class Category : u32 { texture = 0, mesh, framebuffer, count };
+
+struct Resource {
+  Category category = Category::texture;
+  u32 name = 0;
+  usize bytes = 0;
+  string format;
+  string path;
+  u32 width = 0, height = 0;
+};
+
+// records a new allocation, or the new size of one already tracked
+void track(Category category, u32 name, usize bytes, string format,
+           string path, u32 width = 0, u32 height = 0);
+void set_path(Category category, u32 name, string path);
+void release(Category category, u32 name);
+
+usize total(Category category);
+usize total();
+// the largest the total has been since startup
+usize high_water(Category category);
+usize high_water();
+
+u32 count(Category category);
+const char *category_name(Category category);
+
+// every tracked resource, largest first
+ArrayList<Resource> largest(u32 limit = 0);
+
+void draw_panel();
+
+void RegisterLuaModule(sol::state &state);
+
+} // namespace gpu_memory
@@ -0,0 +1,68 @@
+#pragma once
+#include <rama/engine.hpp>
+
+//
+// A mesh pre-rendered from frames x frames directions spread over the
+// sphere with an octahedral mapping. Each view is an orthographic capture
+// of the mesh's bounding sphere, stored side by side in an albedo atlas and
+// an object space normal atlas.
+//
+class Impostor {
+private:
+  u32 albedo = 0, normal = 0;
+  u32 frames = 0;
+  Vec3f center = Vec3f(0);
+  f32 radius = 1.0f;
+
+  friend class ImpostorSet;
+
+  static Impostor bake(Mesh &mesh, Texture *texture, Vec4f colour,
+                       u32 frames, u32 frame_size);
+
+public:
+  static Impostor bake(Mesh &mesh, Vec4f colour, u32 frames = 8,
+                       u32 frame_size = 128);
+  static Impostor bake(Mesh &mesh, Texture &texture, u32 frames = 8,
+                       u32 frame_size = 128);
+  void destroy();
+};
+
+//
+// Instances of one mesh. Those closer than `distance` draw the real mesh
+// with the caller's shader, the rest become camera-facing quads that blend
+// the four nearest baked views, all in one instanced draw.
+//
+class ImpostorSet {
+private:
+  struct Instance {
+    Vec3f pos;
+    f32 scale;
+    Quat rotation;
+  };
+
+  Mesh *mesh = nullptr;
+  Impostor *impostor = nullptr;
+
+  ArrayList<Instance> instances;
+  ArrayList<Instance> far;
+
+  u32 vao, vbo;
+  usize vbo_capacity = 0;
+  Shader shader;
+
+public:
+  f32 distance = 100.0f;
+  Vec3f sun_direction = Vec3f(0.3f, -1.0f, 0.2f);
+
+  u32 near_count = 0, far_count = 0;
+
+  // the mesh and impostor must outlive the set
+  static ImpostorSet make(Mesh &mesh, Impostor &impostor);
+  void destroy();
+
+  void add(Vec3f pos, Quat rotation, f32 scale);
+  void clear();
+
+  // `mesh_shader` gets `perspective`, `view` and `model`, like DrawList
+  void draw(Shader &mesh_shader, Mat4 perspective, Mat4 view);
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <rama/types.hpp>
+
+#include <functional>
+
+namespace jobs {
+
+//
+// A small fork/join worker pool for the renderer and other per-frame work.
+// The calling thread always takes part, so `thread_count()` is the number of
+// workers plus one and worker indices are in [0, thread_count()).
+//
+
+using Range = std::function<void(u32 begin, u32 end, u32 worker)>;
+
+void init(u32 workers = 0);
+void shutdown();
+
+u32 thread_count();
+
+// Splits [0, count) into batches of `batch_size` and runs them on every
+// thread. Blocks until all batches are done. Nested calls run inline.
+void parallel_for(u32 count, u32 batch_size, const Range &fn);
+
+} // namespace jobs
@@ -0,0 +1,61 @@
+#pragma once
+#include <rama/engine.hpp>
+
+enum class LightType : u32 { point = 0, spot = 1 };
+
+struct Light {
+  LightType type = LightType::point;
+  Vec3f pos = Vec3f(0);
+  Vec3f colour = Vec3f(1);
+  f32 intensity = 1.0f;
+  f32 radius = 10.0f;
+
+  // spot lights only
+  Vec3f direction = engine::WorldForward;
+  f32 inner_angle = 20.0f, outer_angle = 30.0f;
+};
+
+//
+// Clustered forward lighting. The view frustum of an FPSCamera is split into
+// a grid of froxels (exponential depth slices), every light is binned into
+// the froxels its bounding sphere touches on the job system, and the compact
+// per-cluster index lists are uploaded as SSBOs. Shaders prepend
+// ClusteredLighting::glsl() and call `clustered_lighting(...)`.
+//
+// SSBO bindings: 1 = lights, 2 = cluster grid, 3 = light indices.
+//
+class ClusteredLighting {
+private:
+  u32 light_ssbo, grid_ssbo, index_ssbo;
+
+  Vec3u dims;
+  f32 near = 0, far = 0, fov = 0, aspect = 0;
+
+  // view space cluster bounds, SoA
+  ArrayList<f32> min_x, min_y, min_z, max_x, max_y, max_z;
+
+  ArrayList<u32> grid;
+  ArrayList<u32> indices;
+
+  void build_clusters(FPSCamera &camera);
+
+public:
+  ArrayList<Light> lights;
+
+  static ClusteredLighting make(u32 x = 16, u32 y = 9, u32 z = 24);
+  void destroy();
+
+  void add_point(Vec3f pos, Vec3f colour, f32 intensity, f32 radius);
+  void add_spot(Vec3f pos, Vec3f direction, Vec3f colour, f32 intensity,
+                f32 radius, f32 inner_angle, f32 outer_angle);
+  void clear();
+
+  void update(FPSCamera &camera);
+
+  void bind();
+  void apply(Shader &shader);
+
+  u32 light_index_count() { return indices.size(); }
+
+  static string glsl();
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <rama/engine.hpp>
+#include <rama/lighting.hpp>
+
+//
+// A baked lightmap: RGBM encoded RGBA8 (colour * alpha * range), so HDR
+// light fits in a plain 8 bit texture and decoding is one multiply. Every
+// receiving mesh has its own rectangle of the atlas, mapped from its UV2
+// channel (attribute 7) with `scale_offset(receiver)`.
+//
+// Shaders prepend Lightmap::glsl(), read UV2 from attribute 7 and call
+// `sample_lightmap(uv2)`, which returns the light arriving at the surface;
+// multiply it by albedo. apply() binds the atlas and the receiver's rectangle.
+//
+class Lightmap {
+private:
+  u32 texture = 0;
+  ArrayList<Vec4f> scale_offsets;
+
+  friend class LightmapBaker;
+
+public:
+  static constexpr f32 rgbm_range = 8.0f;
+
+  u32 width = 0, height = 0;
+
+  // a PNG written by LightmapBaker::save and its .json sidecar
+  static Lightmap load(string path);
+  static Lightmap make(const ArrayList<u8> &rgbm, u32 width, u32 height,
+                       ArrayList<Vec4f> scale_offsets);
+  void destroy();
+
+  Vec4f scale_offset(u32 receiver);
+  u32 receiver_count() { return scale_offsets.size(); }
+
+  void apply(Shader &shader, u32 receiver, i32 unit);
+
+  static string glsl();
+};
+
+//
+// An offline lightmap baker that runs on the CPU, for build machines
+// without a GPU. Scene triangles go into a 4 wide BVH traversed with SSE,
+// every lightmap texel is rasterized from the receivers' UV2 channels, and
+// refine() adds path traced samples to every texel on all cores, so the
+// result can be looked at after any number of passes.
+//
+// Light comes from a constant sky, a sun and the point and spot lights of
+// lighting.hpp, with `bounces` diffuse bounces off the scene's albedo.
+//
+// Only result() and the Mesh overloads need a GL context. A build machine
+// without a GPU runs a script with `--bake script.lua`, which never opens a
+// window; it loads the scene with Geometry::load, which only reads the file,
+// and calls bake(). The game then loads the PNG with Lightmap::load.
+//
+class LightmapBaker {
+public:
+  // the CPU side of a mesh: everything the bake reads, nothing it draws
+  struct Geometry {
+    ArrayList<Vec3f> positions, normals;
+    // empty when the mesh has no lightmap channel
+    ArrayList<Vec2f> uv2;
+    ArrayList<u32> indices;
+
+    // the same vertices Mesh::load would produce, without a GL context
+    static Geometry load(string path);
+  };
+
+  // the BVH's storage, public only so the builder can fill it
+  struct Triangle {
+    Vec3f v0, e1, e2;
+    Vec3f n0, n1, n2;
+    u32 instance;
+  };
+
+  struct Node {
+    f32 min_x[4], min_y[4], min_z[4];
+    f32 max_x[4], max_y[4], max_z[4];
+    // >= 0 a node, < 0 the leaf ~child with `count` triangles
+    i32 child[4];
+    u32 count[4];
+  };
+
+private:
+  struct Instance {
+    Geometry geometry;
+    Mat4 model;
+    Vec3f albedo;
+    bool receiver;
+    Vec4f scale_offset = Vec4f(0);
+  };
+
+  struct Texel {
+    Vec3f pos, normal;
+    u32 pixel;
+  };
+
+  ArrayList<Instance> instances;
+
+  ArrayList<Triangle> triangles;
+  ArrayList<Node> nodes;
+
+  ArrayList<Texel> texels;
+  // direct light is noise free, so it is traced once; only the indirect
+  // samples accumulate
+  ArrayList<Vec3f> direct, accumulated;
+  f32 epsilon = 1e-3f;
+
+  bool pack();
+  void rasterize(u32 instance);
+  void build_bvh();
+
+  bool trace(Vec3f origin, Vec3f dir, f32 max_t, bool any, f32 &t,
+             u32 &triangle, Vec2f &barycentric);
+  Vec3f direct_light(Vec3f pos, Vec3f normal);
+
+public:
+  u32 resolution = 1024;
+  f32 texels_per_unit = 16.0f;
+  u32 padding = 2;
+
+  u32 bounces = 2;
+  u32 samples_per_pass = 4;
+
+  Vec3f sky = Vec3f(0.5f, 0.6f, 0.8f);
+  Vec3f sun_direction = Vec3f(0.3f, -1.0f, 0.2f);
+  Vec3f sun_colour = Vec3f(2.0f);
+  ArrayList<Light> lights;
+
+  u32 passes = 0;
+
+  // the geometry is copied. it needs a UV2 channel to receive light, see
+  // unwrap()
+  u32 add(Geometry geometry, Mat4 model, Vec3f albedo, bool receiver = true);
+  u32 add(Mesh &mesh, Mat4 model, Vec3f albedo, bool receiver = true);
+  void clear();
+
+  // packs the receivers, rasterizes the texels and builds the BVH
+  bool build();
+  // one progressive pass of `samples_per_pass` samples per texel
+  void refine();
+
+  u32 texel_count() { return texels.size(); }
+  u32 node_count() { return nodes.size(); }
+  Vec4f scale_offset(u32 receiver) { return instances[receiver].scale_offset; }
+
+  // dilated into the padding and RGBM encoded, bottom row first
+  ArrayList<u8> encode();
+  // the only step that needs GL
+  Lightmap result();
+  bool save(string path);
+
+  // the whole headless bake: build(), `count` refine() passes and save()
+  bool bake(string path, u32 count);
+
+  // a copy of `mesh` with one lightmap chart per triangle. Authored UV2
+  // channels pack far better; this is a fallback for meshes without one.
+  static Mesh unwrap(Mesh &mesh, u32 resolution = 512);
+  static Geometry unwrap(const Geometry &geometry, u32 resolution = 512);
+
+  // the arrays of a loaded mesh, for add()
+  static Geometry geometry(Mesh &mesh);
+};
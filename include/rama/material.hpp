@@ -0,0 +1,71 @@
+#pragma once
+#include <rama/engine.hpp>
+
+// A GL_TEXTURE_2D_ARRAY where every layer has the same size and format.
+class TextureArray {
+private:
+  u32 GLid;
+  u32 width, height, capacity;
+  u32 layers = 0;
+  bool mipmaps_dirty = false;
+
+public:
+  static TextureArray make(u32 width, u32 height, u32 capacity);
+  void destroy();
+
+  // returns the layer index, or -1 if the image is missing or the wrong size
+  i32 add(string path);
+  i32 add(const u8 *rgba, u32 width, u32 height);
+
+  void bind(i32 unit);
+
+  u32 count() { return layers; }
+};
+
+// std430 layout, mirrored by MaterialTable::glsl()
+struct MaterialParams {
+  Vec4f albedo = Vec4f(1);
+  Vec4f emissive = Vec4f(0);
+  f32 roughness = 0.5f;
+  f32 metallic = 0.0f;
+  i32 albedo_layer = -1;
+  i32 normal_layer = -1;
+};
+
+//
+// Every material's parameters live in one SSBO (binding 4) and its textures
+// in one TextureArray. A draw only needs the material's index, which the
+// DrawList passes as the base instance, so draws that share a shader need no
+// uniform or texture changes between them.
+//
+class MaterialTable {
+private:
+  u32 ssbo;
+  usize capacity = 0;
+  bool dirty = false;
+
+  ArrayList<MaterialParams> materials;
+  Map<string, i32> texture_layers;
+
+  TextureArray textures;
+
+public:
+  static MaterialTable make(u32 texture_size = 1024, u32 max_textures = 64);
+  void destroy();
+
+  u32 add(MaterialParams params);
+  void set(u32 material, MaterialParams params);
+  MaterialParams get(u32 material);
+
+  // loads a texture into the table's array once, returns its layer
+  i32 texture(string path);
+  // same for already decoded RGBA8 pixels, deduplicated by `key`
+  i32 texture(string key, const u8 *rgba, u32 width, u32 height);
+
+  u32 count() { return materials.size(); }
+
+  void upload();
+  void bind(Shader &shader, i32 unit);
+
+  static string glsl();
+};
@@ -15,6 +15,7 @@
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
 #include <Jolt/Physics/Body/BodyActivationListener.h>
 #include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
+#include <Jolt/Physics/Collision/Shape/HeightFieldShape.h>
 #include "Jolt/Physics/Character/CharacterVirtual.h"
 #include "Jolt/Physics/Character/CharacterVirtual.h"
 #include "Jolt/Physics/Collision/Shape/Shape.h"
@@ -45,6 +46,11 @@ namespace physics3d {
         Vec3f scale;
     public:
         static Shape Cube(Vec3f scale);
+        // `samples` is size x size, row major along z. a sample at (x, z)
+        // lands at offset + scale * (x, samples[z * size + x], z). Jolt
+        // compresses the samples into its own block representation, so the
+        // array can be freed afterwards.
+        static Shape HeightField(const ArrayList<f32>& samples, u32 size, Vec3f offset, Vec3f scale);
 
         friend class Rigidbody;
     };
@@ -0,0 +1,88 @@
+#pragma once
+#include <rama/engine.hpp>
+
+struct RenderTarget {
+  u32 fbo = 0, texture = 0;
+  u32 width = 0, height = 0;
+  u32 format = 0;
+};
+
+//
+// Colour-only render targets shared between passes. A released target goes
+// back to the pool and is handed out again to the next acquire() of the same
+// size and format; targets nobody asked for in `max_age` frames are freed.
+//
+class RenderTargetPool {
+private:
+  struct Entry {
+    RenderTarget target;
+    bool in_use = false;
+    u64 last_used = 0;
+  };
+
+  ArrayList<Entry> entries;
+  u64 frame = 0;
+
+public:
+  RenderTarget acquire(u32 width, u32 height, u32 format);
+  void release(const RenderTarget &target);
+
+  void end_frame(u32 max_age = 120);
+  void destroy();
+
+  u32 count() { return entries.size(); }
+  usize bytes();
+};
+
+//
+// Post-processing for the game framebuffer: bloom, exposure and tonemapping,
+// colour grading and FXAA. Bloom runs as a chain of downsample and
+// upsample passes starting at half (or quarter) resolution. Everything else
+// per-pixel is merged into one uber pass, compiled once for each
+// combination of enabled effects, and FXAA reads the luma it stored in
+// alpha. At most two full resolution passes touch every pixel.
+//
+// Tonemapping needs a floating point scene, which the engine's game
+// framebuffer is. Hand the chain to engine::set_post_process() to run it
+// after draw().
+//
+class PostProcess {
+private:
+  RenderTargetPool pool;
+
+  Shader downsample, upsample, fxaa_pass;
+  UnorderedMap<u32, Shader> uber_variants;
+  u32 vao = 0;
+
+  Shader &uber(u32 mask);
+  RenderTarget bloom(Framebuffer &source, Vec2f size);
+
+public:
+  bool bloom_enabled = true;
+  f32 bloom_threshold = 1.0f;
+  f32 bloom_intensity = 0.1f;
+  u32 bloom_levels = 5;
+  bool bloom_quarter_res = false;
+
+  bool tonemap = true;
+  f32 exposure = 1.0f;
+
+  bool grading = false;
+  f32 contrast = 1.0f;
+  f32 saturation = 1.0f;
+  Vec3f tint = Vec3f(1);
+
+  bool fxaa = true;
+
+  static PostProcess make();
+  void destroy();
+
+  // reads the drawn region of `source` and writes the same region of
+  // `destination`, which may be `source` itself
+  void apply(Framebuffer &source, Framebuffer &destination);
+
+  u32 variant_count() { return uber_variants.size(); }
+  RenderTargetPool &targets() { return pool; }
+
+  void draw_panel();
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <rama/scripting.hpp>
+#include <rama/types.hpp>
+
+//
+// GPU pass timings from GL_TIMESTAMP queries. Queries are kept in a ring of
+// frames and read back once they are a few frames old, so profiling never
+// waits on the GPU. Scopes nest and the results form a timing tree.
+//
+namespace profiler {
+
+struct PassTiming {
+  string name;
+  f64 ms = 0;
+  u32 depth = 0;
+};
+
+void init();
+void shutdown();
+
+void begin_frame();
+void end_frame();
+
+void begin(string name);
+void end();
+
+// results of the latest completed frame, in tree pre-order
+const ArrayList<PassTiming> &results();
+f64 frame_ms();
+
+void draw_panel();
+
+void RegisterLuaModule(sol::state &state);
+
+struct Scope {
+  Scope(string name) { begin(name); }
+  ~Scope() { end(); }
+};
+
+} // namespace profiler
+
+#define RAMA_GPU_CONCAT_(a, b) a##b
+#define RAMA_GPU_CONCAT(a, b) RAMA_GPU_CONCAT_(a, b)
+#define GPU_SCOPE(name)                                                        \
+  profiler::Scope RAMA_GPU_CONCAT(gpu_scope_, __LINE__)(name)
@@ -0,0 +1,65 @@
+#pragma once
+#include <rama/scripting.hpp>
+#include <rama/types.hpp>
+
+//
+// Per-frame render counters, bumped by the engine's GL wrappers (and the
+// modules that issue their own draws and uploads) through RENDER_STAT. The
+// main loop closes each frame, keeping the totals and a short history for
+// the overlay's graphs.
+//
+// Builds with NDEBUG compile the counting out: RENDER_STAT expands to
+// nothing and every counter reads zero. Define RAMA_RENDER_STATS to keep
+// them in an optimized build.
+//
+#if !defined(NDEBUG) || defined(RAMA_RENDER_STATS)
+#define RAMA_RENDER_STATS_ENABLED 1
+#endif
+
+namespace render_stats {
+
+struct Counters {
+  u64 draw_calls = 0;
+  u64 triangles = 0;
+  // program and framebuffer binds
+  u64 state_changes = 0;
+  u64 uniform_uploads = 0;
+  u64 buffer_uploads = 0;
+  u64 buffer_bytes = 0;
+  u64 texture_binds = 0;
+};
+
+#if defined(RAMA_RENDER_STATS_ENABLED)
+// the frame being counted, only touched from the render thread
+extern Counters current;
+#endif
+
+constexpr bool enabled() {
+#if defined(RAMA_RENDER_STATS_ENABLED)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void end_frame();
+
+// totals of the last finished frame
+const Counters &last_frame();
+
+void draw_panel();
+
+void RegisterLuaModule(sol::state &state);
+
+} // namespace render_stats
+
+#if defined(RAMA_RENDER_STATS_ENABLED)
+#define RENDER_STAT(counter, amount)                                           \
+  (render_stats::current.counter += (u64)(amount))
+#define RENDER_STAT_UPLOAD(bytes)                                              \
+  (render_stats::current.buffer_uploads++,                                     \
+   render_stats::current.buffer_bytes += (u64)(bytes))
+#else
+#define RENDER_STAT(counter, amount) ((void)0)
+#define RENDER_STAT_UPLOAD(bytes) ((void)0)
+#endif
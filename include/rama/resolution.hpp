@@ -0,0 +1,45 @@
+#pragma once
+#include <rama/engine.hpp>
+#include <rama/scripting.hpp>
+
+//
+// Dynamic resolution. The game framebuffer keeps the size of the output,
+// but the scene is drawn into its bottom left `scale` fraction and then
+// upscaled to the output with a contrast adaptive sharpening filter. Every
+// frame the scale is nudged towards the frame time budget using the GPU
+// frame time from the profiler, or the CPU frame time when there are no GPU
+// timings, dropping quickly when over budget and recovering slowly.
+//
+namespace resolution {
+
+void init();
+void shutdown();
+
+void set_enabled(bool enabled);
+bool is_enabled();
+
+// frame time budget in milliseconds
+void set_target_ms(f32 ms);
+f32 get_target_ms();
+
+void set_scale_range(f32 min, f32 max);
+
+// 0 is a plain bilinear upscale, 1 is the strongest sharpening
+void set_sharpness(f32 sharpness);
+
+f32 get_scale();
+
+// true when the scene is not drawn at the output size and needs upscale()
+bool is_active();
+
+// called once per frame by the engine before the game draws
+void update(f32 frame_ms);
+
+// draws the scaled region of `source` over the whole of `output`
+void upscale(Framebuffer &source, Framebuffer &output);
+
+void draw_panel();
+
+void RegisterLuaModule(sol::state &state);
+
+} // namespace resolution
@@ -0,0 +1,55 @@
+#pragma once
+#include <rama/engine.hpp>
+
+//
+// A shader file after preprocessing. On top of the `@vertex`/`@fragment`
+// markers Shader::load has always used, it understands
+//
+//   #include "common.glsl"   relative to the including file, in any stage
+//   @feature NAME            a boolean feature for ShaderVariants
+//
+// `#line` markers are kept so compile errors point at the right file:
+// source string N is `files[N]`.
+//
+struct ShaderSource {
+  string vertex, fragment;
+  ArrayList<string> files;
+  ArrayList<string> features;
+  u64 hash = 0;
+
+  // `path` is relative to the executable, like every other loader
+  static ShaderSource load(string path);
+};
+
+//
+// Every combination of a shader's features is a separate program, compiled
+// with `#define NAME 1` for the enabled ones the first time it is asked for.
+// Compiled variants are kept in memory and, when the driver supports
+// program binaries, on disk under `cache_dir`, keyed by the preprocessed
+// source, the feature mask and the GL driver.
+//
+class ShaderVariants {
+private:
+  ShaderSource source;
+  UnorderedMap<u64, Shader> variants;
+
+  Shader compile(u64 mask);
+
+public:
+  static inline string cache_dir = "shader_cache";
+  static inline bool disk_cache = true;
+
+  u32 compiled = 0, disk_hits = 0;
+
+  static ShaderVariants load(string path);
+  void destroy();
+
+  // unknown feature names are reported and ignored
+  u64 mask(const ArrayList<string> &features);
+
+  Shader &get(u64 mask);
+  Shader &get(const ArrayList<string> &features) { return get(mask(features)); }
+
+  u32 variant_count() { return variants.size(); }
+  const ArrayList<string> &features() { return source.features; }
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <rama/engine.hpp>
+
+#include <functional>
+
+//
+// Directional light shadows using cascaded shadow maps in a depth texture
+// array. Cascades are fitted to bounding spheres of the FPSCamera frustum
+// slices and snapped to whole texels, so they don't shimmer.
+//
+// Static casters are drawn into a separate cached array and only re-rendered
+// when the camera leaves a cascade's margin (or `invalidate` is called). Each
+// frame the cached layer is copied into the live array and dynamic casters are
+// drawn on top with the same light matrix.
+//
+class CascadedShadowMap {
+public:
+  using DrawCallback = std::function<void(Mat4 light_matrix)>;
+
+private:
+  u32 fbo;
+  u32 static_depth, depth;
+  u32 resolution, cascades;
+
+  Vec3f light_dir = Vec3f(0);
+
+  ArrayList<Mat4> matrices;
+  ArrayList<Vec3f> centers;
+  ArrayList<f32> radii;
+  ArrayList<f32> splits;
+  ArrayList<bool> dirty;
+
+  void fit(u32 cascade, Vec3f center, f32 radius);
+
+public:
+  // blend between logarithmic (1) and uniform (0) split distances
+  f32 lambda = 0.75f;
+  // extra coverage around each cascade, as a fraction of its radius. the
+  // static cache survives camera movement up to this distance.
+  f32 margin = 0.25f;
+  f32 max_distance = 200.0f;
+  // how far behind a cascade casters are still captured
+  f32 depth_range = 100.0f;
+
+  static CascadedShadowMap make(u32 resolution = 2048, u32 cascades = 4);
+  void destroy();
+
+  void update(FPSCamera &camera, Vec3f light_dir);
+  void render(DrawCallback draw_static, DrawCallback draw_dynamic);
+  void invalidate();
+
+  void bind(i32 unit);
+  void apply(Shader &shader, i32 unit);
+
+  u32 cascade_count() { return cascades; }
+  Mat4 light_matrix(u32 cascade) { return matrices[cascade]; }
+
+  static string glsl();
+};
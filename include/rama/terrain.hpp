@@ -0,0 +1,60 @@
+#pragma once
+#include <rama/engine.hpp>
+#include <rama/physics3d.hpp>
+
+//
+// Heightfield terrain drawn with nested geometry clipmaps. Every level is
+// the same (grid + 1)^2 vertex grid at twice the spacing of the one inside
+// it, centred on the camera and snapped to the next level's cells, so the
+// vertex cost per frame is constant however large the map is. Heights are
+// fetched from an R16 texture in the vertex shader; odd vertices on a
+// level's outer edge take the coarser level's height so there are no cracks.
+//
+// The same 16 bit samples back the physics3d HeightField shape. The terrain
+// covers [0, size * spacing] on x and z and [0, height_scale] on y.
+//
+class Terrain {
+private:
+  struct Range {
+    u32 offset, count;
+  };
+
+  ArrayList<u16> heights;
+  u32 size = 0;
+
+  u32 texture, vao, vbo, ibo;
+  Shader shader;
+
+  u32 grid = 128;
+  Range full;
+  // the hole for the finer level sits at one of four offsets
+  Array<Range, 4> rings;
+
+  ArrayList<Vec2i> origins;
+  ArrayList<u8> holes;
+
+public:
+  f32 spacing = 1.0f;
+  f32 height_scale = 100.0f;
+  Vec3f sun_direction = Vec3f(0.3f, -1.0f, 0.2f);
+
+  // levels whose origin moved in the last update()
+  u32 levels_moved = 0;
+
+  // `path` is a square, single channel 16 bit image
+  static Terrain load(string path, f32 spacing, f32 height_scale,
+                      u32 levels = 8, u32 grid = 128);
+  static Terrain make(ArrayList<u16> heights, u32 size, f32 spacing,
+                      f32 height_scale, u32 levels = 8, u32 grid = 128);
+  void destroy();
+
+  void update(FPSCamera &camera);
+  void draw(Mat4 perspective, Mat4 view);
+
+  // bilinear, world space
+  f32 height_at(f32 x, f32 z);
+
+  physics3d::Shape shape();
+
+  u32 vertex_count() { return origins.size() * (grid + 1) * (grid + 1); }
+};
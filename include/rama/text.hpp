@@ -0,0 +1,114 @@
+#pragma once
+#include <rama/engine.hpp>
+
+typedef struct FT_FaceRec_ *FT_Face;
+
+//
+// A FreeType font with its own glyph atlas. Glyphs are rasterized the
+// first time they are drawn, as signed distance fields by default so one
+// atlas serves every text size, into fixed cells of a single channel
+// texture. When the atlas is full the least recently drawn glyph gives up
+// its cell.
+//
+// draw() only queues glyph quads; flush() uploads them and draws the whole
+// font in one instanced call. Positions are in pixels with y up, the same
+// space as Camera2D, and `pos` is the baseline of the first line. A `wrap`
+// width above 0 breaks lines at spaces.
+//
+// Layouts (kerning, line breaks, glyph lookups) are cached by string, size
+// and wrap width, so text that does not change between frames is only laid
+// out once. Layouts nobody drew for `layout_max_age` frames are dropped.
+//
+class Font {
+private:
+  struct Glyph {
+    // in font pixels, at `pixel_size`
+    Vec2f offset, size;
+    f32 advance = 0;
+    u32 codepoint = 0, index = 0;
+    i32 cell = -1;
+    bool outline = false;
+  };
+
+  struct PlacedGlyph {
+    u32 glyph;
+    Vec2f pos;
+  };
+
+  struct Layout {
+    string text;
+    f32 size = 0, wrap = 0;
+    ArrayList<PlacedGlyph> glyphs;
+    Vec2f extent = Vec2f(0);
+    u64 last_used = 0;
+  };
+
+  struct Cell {
+    u32 codepoint = 0;
+    u64 last_used = 0;
+    bool used = false;
+  };
+
+  struct Instance {
+    Vec4f rect;
+    Vec4f uv;
+    u32 colour;
+  };
+
+  FT_Face face = nullptr;
+
+  // codepoint to index into `glyphs`, which only ever grows
+  UnorderedMap<u32, u32> glyph_index;
+  ArrayList<Glyph> glyphs;
+  UnorderedMap<u64, Layout> layouts;
+  ArrayList<Cell> cells;
+  u32 atlas = 0, atlas_size = 0, cell_size = 0, cells_per_row = 0;
+
+  ArrayList<Instance> instances;
+  u32 vao = 0, vbo = 0;
+  usize vbo_capacity = 0;
+  Shader shader;
+
+  u64 frame = 1;
+  u32 frame_hits = 0, frame_misses = 0;
+
+  // index into `glyphs`, or -1 when the font cannot load it
+  i64 lookup(u32 codepoint);
+  bool make_resident(Glyph &glyph);
+  bool touch(Glyph &glyph);
+
+  const Layout &layout(const string &text, f32 size, f32 wrap);
+
+public:
+  u32 pixel_size = 32;
+  bool sdf = true;
+  f32 line_height = 0;
+
+  // overflows are glyphs dropped because every cell was drawn this frame
+  u32 rasterized = 0, evictions = 0, overflows = 0;
+
+  u32 layout_max_age = 120;
+  // per frame, as of the last flush()
+  u32 layout_hits = 0, layout_misses = 0;
+  u64 total_layout_hits = 0, total_layout_misses = 0;
+
+  // `path` is relative to the executable, like every other loader
+  static Font load(string path, u32 pixel_size = 32, bool sdf = true,
+                   u32 atlas_size = 1024);
+  void destroy();
+
+  void draw(const string &text, Vec2f pos, f32 size, Vec4f colour,
+            f32 wrap = 0);
+  Vec2f measure(const string &text, f32 size, f32 wrap = 0);
+
+  void flush(Mat4 perspective, Mat4 view);
+  // screen space, the game view in pixels
+  void flush();
+
+  u32 resident();
+  u32 capacity() { return cells.size(); }
+  u32 queued() { return instances.size(); }
+  u32 cached_layouts() { return layouts.size(); }
+
+  void draw_panel();
+};
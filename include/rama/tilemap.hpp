@@ -0,0 +1,52 @@
+#pragma once
+#include <rama/engine.hpp>
+
+//
+// A static tile layer for Camera2D, split into chunks of chunk_size^2
+// tiles. Each chunk keeps its non-empty tiles in its own static instance
+// buffer (4 bytes a tile) and is drawn as one instanced quad strip, so a
+// frame only walks the chunks overlapping the view. Editing a tile marks its
+// chunk dirty and the chunk is re-meshed the next time it is drawn.
+//
+// Tile 0 is empty, tile n is cell n - 1 of the atlas, counted row by row
+// from the top left. Tile (0, 0) is at the world origin and y points up.
+//
+class Tilemap {
+public:
+  static constexpr u32 chunk_size = 64;
+
+private:
+  struct Chunk {
+    u32 vao = 0, vbo = 0;
+    u32 count = 0;
+    bool dirty = true;
+  };
+
+  ArrayList<u16> tiles;
+  ArrayList<Chunk> chunks;
+  u32 width = 0, height = 0;
+  u32 chunks_x = 0, chunks_y = 0;
+
+  Texture atlas;
+  u32 atlas_columns = 1, atlas_rows = 1;
+
+  Shader shader;
+
+  void mark(u32 x, u32 y);
+  void build(u32 chunk);
+
+public:
+  f32 tile_size = 16.0f;
+
+  u32 drawn_chunks = 0, rebuilt_chunks = 0;
+
+  static Tilemap make(u32 width, u32 height, f32 tile_size, Texture atlas,
+                      u32 atlas_columns, u32 atlas_rows);
+  void destroy();
+
+  void set(u32 x, u32 y, u16 tile);
+  u16 get(u32 x, u32 y);
+  void fill(u32 x, u32 y, u32 w, u32 h, u16 tile);
+
+  void draw(Camera2D &camera);
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <rama/types.hpp>
+
+// stable reference to a transform, survives re-sorting of the hierarchy
+struct TransformHandle {
+  u32 id = UINT32_MAX;
+
+  bool valid() const { return id != UINT32_MAX; }
+};
+
+//
+// Transform hierarchy stored as parent-sorted SoA arrays. Nodes are kept in
+// depth-first order, so every parent precedes its children and every subtree
+// is one contiguous range; structural edits only mark the order dirty and it
+// is rebuilt on the next update.
+//
+// Setting a local transform marks the node dirty and flags its ancestors, so
+// update() can skip clean subtrees wholesale. Local matrices are rebuilt in
+// parallel over all nodes, then world matrices are propagated in parallel
+// over independent roots.
+//
+class TransformSystem {
+private:
+  ArrayList<u32> parent;
+  ArrayList<u32> subtree_size;
+
+  ArrayList<Vec3f> position;
+  ArrayList<Quat> rotation;
+  ArrayList<Vec3f> scale;
+
+  ArrayList<Mat4> local;
+  ArrayList<Mat4> world;
+
+  ArrayList<u8> dirty;
+  ArrayList<u8> subtree_dirty;
+  ArrayList<u32> changed_frame;
+
+  ArrayList<u32> handle_of;
+  ArrayList<u32> dense_of;
+  ArrayList<u32> free_ids;
+
+  ArrayList<u32> roots;
+
+  bool order_dirty = false;
+  u32 frame = 0;
+
+  u32 index(TransformHandle handle);
+  void mark_dirty(u32 i);
+  void rebuild_order();
+  void propagate(u32 root);
+
+public:
+  static TransformSystem make();
+  void destroy();
+
+  TransformHandle create();
+  TransformHandle create(TransformHandle parent);
+  // removes the node and all of its children
+  void remove(TransformHandle handle);
+
+  void set_parent(TransformHandle child, TransformHandle parent);
+  TransformHandle get_parent(TransformHandle handle);
+
+  void set_position(TransformHandle handle, Vec3f value);
+  void set_rotation(TransformHandle handle, Quat value);
+  void set_scale(TransformHandle handle, Vec3f value);
+
+  Vec3f get_position(TransformHandle handle);
+  Quat get_rotation(TransformHandle handle);
+  Vec3f get_scale(TransformHandle handle);
+
+  // valid after update()
+  Mat4 get_world(TransformHandle handle);
+
+  u32 count() { return parent.size(); }
+
+  void update();
+};
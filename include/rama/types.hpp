@@ -11,6 +11,8 @@
 #include <glm/vec3.hpp>   // glm::vec3
 #include <glm/vec4.hpp>   // glm::vec4
 
+#include <glm/gtc/quaternion.hpp> // glm::quat
+
 template <typename T> using ArrayList = std::vector<T>;
 
 template <typename T, std::size_t size> using Array = std::array<T, size>;
@@ -58,6 +60,8 @@ using Vec4u = glm::uvec4;
 using Mat3 = glm::mat3;
 using Mat4 = glm::mat4;
 
+using Quat = glm::quat;
+
 #define TODO(...)                                                              \
   do {                                                                         \
     engine::warning("__FILE__ :: TODO at line __LINE__: {}", __VA_ARGS__);     \
@@ -0,0 +1,520 @@
+#include <rama/animation.hpp>
+
+#include <rama/jobs.hpp>
+#include <rama/render_stats.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+Mat4 to_mat4(const aiMatrix4x4 &m) {
+  // assimp is row major
+  return glm::transpose(glm::make_mat4(&m.a1));
+}
+
+Vec3f to_vec3(const aiVector3D &v) { return Vec3f(v.x, v.y, v.z); }
+
+Quat to_quat(const aiQuaternion &q) { return Quat(q.w, q.x, q.y, q.z); }
+
+template <typename Key> u32 find_key(const Key *keys, u32 count, f64 time) {
+  // last key at or before `time`
+  const Key *it =
+      std::upper_bound(keys, keys + count, time,
+                       [](f64 t, const Key &key) { return t < key.mTime; });
+  return it == keys ? 0 : (u32)(it - keys) - 1;
+}
+
+template <typename Key> f32 key_factor(const Key *keys, u32 i, f64 time) {
+  f64 span = keys[i + 1].mTime - keys[i].mTime;
+  return span > 0 ? glm::clamp((f32)((time - keys[i].mTime) / span), 0.f, 1.f)
+                  : 0.0f;
+}
+
+Vec3f interpolate(const aiVectorKey *keys, u32 count, f64 time) {
+  u32 i = find_key(keys, count, time);
+  if (i + 1 >= count) {
+    return to_vec3(keys[i].mValue);
+  }
+
+  return glm::mix(to_vec3(keys[i].mValue), to_vec3(keys[i + 1].mValue),
+                  key_factor(keys, i, time));
+}
+
+Quat interpolate(const aiQuatKey *keys, u32 count, f64 time) {
+  u32 i = find_key(keys, count, time);
+  if (i + 1 >= count) {
+    return to_quat(keys[i].mValue);
+  }
+
+  return glm::slerp(to_quat(keys[i].mValue), to_quat(keys[i + 1].mValue),
+                    key_factor(keys, i, time));
+}
+
+void write_joint(f32 *pose, u32 stride, u32 joint, Vec3f t, Quat r, Vec3f s) {
+  f32 values[Pose::stream_count] = {t.x, t.y, t.z, r.x, r.y,
+                                    r.z, r.w, s.x, s.y, s.z};
+  for (u32 k = 0; k < Pose::stream_count; k++) {
+    pose[k * stride + joint] = values[k];
+  }
+}
+
+//
+// out = mix(a, b, t) for a whole pose: translation and scale are lerped,
+// rotations are nlerped along the shortest arc. out may alias a or b.
+//
+void mix_pose(const f32 *a, const f32 *b, f32 t, f32 *out, u32 stride) {
+  u32 linear[2] = {Pose::tx, Pose::sx};
+
+#if defined(__SSE2__)
+  __m128 vt = _mm_set1_ps(t);
+
+  for (u32 first : linear) {
+    for (u32 i = first * stride; i < (first + 3) * stride; i += 4) {
+      __m128 va = _mm_loadu_ps(a + i);
+      __m128 vb = _mm_loadu_ps(b + i);
+      _mm_storeu_ps(out + i,
+                    _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vt)));
+    }
+  }
+
+  const f32 *ar = a + Pose::rx * stride;
+  const f32 *br = b + Pose::rx * stride;
+  f32 *outr = out + Pose::rx * stride;
+  __m128 sign_bit = _mm_set1_ps(-0.0f);
+
+  for (u32 j = 0; j < stride; j += 4) {
+    __m128 qa[4], qb[4];
+    for (u32 k = 0; k < 4; k++) {
+      qa[k] = _mm_loadu_ps(ar + k * stride + j);
+      qb[k] = _mm_loadu_ps(br + k * stride + j);
+    }
+
+    __m128 dot = _mm_mul_ps(qa[0], qb[0]);
+    for (u32 k = 1; k < 4; k++) {
+      dot = _mm_add_ps(dot, _mm_mul_ps(qa[k], qb[k]));
+    }
+
+    // flip b where the quaternions are in opposite hemispheres
+    __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), sign_bit);
+
+    __m128 q[4];
+    __m128 length = _mm_setzero_ps();
+    for (u32 k = 0; k < 4; k++) {
+      __m128 vb = _mm_xor_ps(qb[k], flip);
+      q[k] = _mm_add_ps(qa[k], _mm_mul_ps(_mm_sub_ps(vb, qa[k]), vt));
+      length = _mm_add_ps(length, _mm_mul_ps(q[k], q[k]));
+    }
+
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length));
+    for (u32 k = 0; k < 4; k++) {
+      _mm_storeu_ps(outr + k * stride + j, _mm_mul_ps(q[k], inverse));
+    }
+  }
+#else
+  for (u32 first : linear) {
+    for (u32 i = first * stride; i < (first + 3) * stride; i++) {
+      out[i] = a[i] + (b[i] - a[i]) * t;
+    }
+  }
+
+  for (u32 j = 0; j < stride; j++) {
+    f32 qa[4], qb[4];
+    f32 dot = 0;
+    for (u32 k = 0; k < 4; k++) {
+      qa[k] = a[(Pose::rx + k) * stride + j];
+      qb[k] = b[(Pose::rx + k) * stride + j];
+      dot += qa[k] * qb[k];
+    }
+
+    f32 sign = dot < 0.0f ? -1.0f : 1.0f;
+    f32 q[4], length = 0;
+    for (u32 k = 0; k < 4; k++) {
+      q[k] = qa[k] + (qb[k] * sign - qa[k]) * t;
+      length += q[k] * q[k];
+    }
+
+    f32 inverse = 1.0f / std::sqrt(length);
+    for (u32 k = 0; k < 4; k++) {
+      out[(Pose::rx + k) * stride + j] = q[k] * inverse;
+    }
+  }
+#endif
+}
+
+Mat4 compose(const Pose &pose, u32 j) {
+  Quat rotation(pose.stream(Pose::rw)[j], pose.stream(Pose::rx)[j],
+                pose.stream(Pose::ry)[j], pose.stream(Pose::rz)[j]);
+
+  Mat4 result = glm::mat4_cast(rotation);
+  result[0] *= pose.stream(Pose::sx)[j];
+  result[1] *= pose.stream(Pose::sy)[j];
+  result[2] *= pose.stream(Pose::sz)[j];
+  result[3] = Vec4f(pose.stream(Pose::tx)[j], pose.stream(Pose::ty)[j],
+                    pose.stream(Pose::tz)[j], 1.0f);
+  return result;
+}
+
+} // namespace
+
+void Pose::resize(u32 joints) {
+  stride = (joints + 3) & ~3u;
+  data.resize(stride * stream_count);
+}
+
+Skeleton Skeleton::load(string path) {
+  path = engine::get_path(path);
+  Assimp::Importer importer;
+  const aiScene *scene =
+      importer.ReadFile(path, aiProcess_Triangulate | aiProcess_SortByPType);
+
+  Skeleton result;
+
+  if (!scene) {
+    engine::error("Assimp error: {}", importer.GetErrorString());
+    return result;
+  }
+
+  ArrayList<aiNode *> nodes;
+  std::function<void(aiNode * node, i32 parent)> visit;
+  visit = [&](aiNode *node, i32 parent) -> void {
+    i32 index = nodes.size();
+    nodes.push_back(node);
+    result.names.push_back(node->mName.C_Str());
+    result.parent.push_back(parent);
+
+    for (u32 i = 0; i < node->mNumChildren; i++) {
+      visit(node->mChildren[i], index);
+    }
+  };
+  visit(scene->mRootNode, -1);
+
+  // padding joints stay at identity so the SIMD lanes never see a zero
+  // quaternion
+  result.bind_pose.resize(nodes.size());
+  for (u32 j = 0; j < result.bind_pose.stride; j++) {
+    write_joint(result.bind_pose.data.data(), result.bind_pose.stride, j,
+                Vec3f(0), Quat(1, 0, 0, 0), Vec3f(1));
+  }
+
+  for (u32 j = 0; j < nodes.size(); j++) {
+    aiVector3D scaling, position;
+    aiQuaternion rotation;
+    nodes[j]->mTransformation.Decompose(scaling, rotation, position);
+
+    write_joint(result.bind_pose.data.data(), result.bind_pose.stride, j,
+                to_vec3(position), to_quat(rotation), to_vec3(scaling));
+  }
+
+  result.offset.assign(nodes.size(), Mat4(1));
+
+  UnorderedMap<string, u32> joints;
+  for (u32 j = 0; j < nodes.size(); j++) {
+    joints.emplace(result.names[j], j);
+  }
+
+  for (u32 m = 0; m < scene->mNumMeshes; m++) {
+    aiMesh *mesh = scene->mMeshes[m];
+    for (u32 i = 0; i < mesh->mNumBones; i++) {
+      aiBone *bone = mesh->mBones[i];
+      if (auto it = joints.find(bone->mName.C_Str()); it != joints.end()) {
+        result.offset[it->second] = to_mat4(bone->mOffsetMatrix);
+      }
+    }
+  }
+
+  result.global_inverse =
+      glm::inverse(to_mat4(scene->mRootNode->mTransformation));
+
+  return result;
+}
+
+AnimationClip AnimationClip::load(string path, const Skeleton &skeleton,
+                                  u32 index) {
+  path = engine::get_path(path);
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFile(path, 0);
+
+  AnimationClip result;
+
+  if (!scene) {
+    engine::error("Assimp error: {}", importer.GetErrorString());
+    return result;
+  }
+
+  if (index >= scene->mNumAnimations) {
+    engine::error("AnimationClip: \"{}\" has {} animations, asked for {}",
+                  path, scene->mNumAnimations, index);
+    return result;
+  }
+
+  aiAnimation *animation = scene->mAnimations[index];
+  f64 ticks_per_second =
+      animation->mTicksPerSecond > 0 ? animation->mTicksPerSecond : 25.0;
+
+  result.name = animation->mName.C_Str();
+  result.duration = animation->mDuration / ticks_per_second;
+  result.frame_count =
+      std::max(2u, (u32)std::ceil(result.duration * result.sample_rate) + 1);
+  result.stride = skeleton.bind_pose.stride;
+
+  // joints without a channel hold their bind pose
+  usize frame_size = result.stride * Pose::stream_count;
+  result.frames.resize(frame_size * result.frame_count);
+  for (u32 f = 0; f < result.frame_count; f++) {
+    std::copy(skeleton.bind_pose.data.begin(), skeleton.bind_pose.data.end(),
+              result.frames.begin() + f * frame_size);
+  }
+
+  UnorderedMap<string, u32> joints;
+  for (u32 j = 0; j < skeleton.joint_count(); j++) {
+    joints.emplace(skeleton.names[j], j);
+  }
+
+  for (u32 c = 0; c < animation->mNumChannels; c++) {
+    aiNodeAnim *channel = animation->mChannels[c];
+
+    auto it = joints.find(channel->mNodeName.C_Str());
+    if (it == joints.end()) {
+      continue;
+    }
+    u32 joint = it->second;
+
+    Quat last(1, 0, 0, 0);
+    for (u32 f = 0; f < result.frame_count; f++) {
+      f32 *frame = result.frames.data() + f * frame_size;
+
+      f64 seconds = std::min((f64)f / result.sample_rate, (f64)result.duration);
+      f64 time = seconds * ticks_per_second;
+
+      Vec3f position = Vec3f(frame[Pose::tx * result.stride + joint],
+                             frame[Pose::ty * result.stride + joint],
+                             frame[Pose::tz * result.stride + joint]);
+      Vec3f scale = Vec3f(frame[Pose::sx * result.stride + joint],
+                          frame[Pose::sy * result.stride + joint],
+                          frame[Pose::sz * result.stride + joint]);
+      Quat rotation(frame[Pose::rw * result.stride + joint],
+                    frame[Pose::rx * result.stride + joint],
+                    frame[Pose::ry * result.stride + joint],
+                    frame[Pose::rz * result.stride + joint]);
+
+      if (channel->mNumPositionKeys > 0) {
+        position = interpolate(channel->mPositionKeys,
+                               channel->mNumPositionKeys, time);
+      }
+      if (channel->mNumRotationKeys > 0) {
+        rotation = interpolate(channel->mRotationKeys,
+                               channel->mNumRotationKeys, time);
+      }
+      if (channel->mNumScalingKeys > 0) {
+        scale =
+            interpolate(channel->mScalingKeys, channel->mNumScalingKeys, time);
+      }
+
+      // keep neighbouring frames in the same hemisphere so sampling can
+      // lerp them directly
+      if (f > 0 && glm::dot(rotation, last) < 0.0f) {
+        rotation = -rotation;
+      }
+      last = rotation;
+
+      write_joint(frame, result.stride, joint, position, rotation, scale);
+    }
+  }
+
+  return result;
+}
+
+void AnimationClip::sample(f32 time, bool loop, Pose &out) const {
+  if (frame_count == 0) {
+    return;
+  }
+
+  if (loop && duration > 0) {
+    time = std::fmod(time, duration);
+    if (time < 0) {
+      time += duration;
+    }
+  } else {
+    time = glm::clamp(time, 0.0f, duration);
+  }
+
+  f32 position = time * sample_rate;
+  u32 f0 = std::min((u32)position, frame_count - 1);
+  u32 f1 = std::min(f0 + 1, frame_count - 1);
+
+  usize frame_size = stride * Pose::stream_count;
+  out.stride = stride;
+  out.data.resize(frame_size);
+
+  mix_pose(frames.data() + f0 * frame_size, frames.data() + f1 * frame_size,
+           position - f0, out.data.data(), stride);
+}
+
+AnimationSystem AnimationSystem::make() {
+  AnimationSystem result;
+  glGenBuffers(1, &result.ssbo);
+  return result;
+}
+
+void AnimationSystem::destroy() { glDeleteBuffers(1, &ssbo); }
+
+u32 AnimationSystem::add(const Skeleton &skeleton) {
+  Instance instance;
+  instance.skeleton = &skeleton;
+  instance.palette_offset = palette.size();
+
+  palette.resize(palette.size() + skeleton.joint_count(), Mat4(1));
+  instances.push_back(instance);
+
+  return instances.size() - 1;
+}
+
+void AnimationSystem::play(u32 instance, const AnimationClip &clip, f32 fade,
+                           bool loop) {
+  if (instance >= instances.size()) {
+    engine::error("AnimationSystem::play: no instance {}", instance);
+    return;
+  }
+
+  Instance &it = instances[instance];
+  if (clip.stride != it.skeleton->bind_pose.stride) {
+    engine::error("AnimationSystem::play: \"{}\" was loaded for a different "
+                  "skeleton",
+                  clip.name);
+    return;
+  }
+
+  if (it.clip && fade > 0) {
+    it.previous = it.clip;
+    it.previous_time = it.time;
+    it.previous_loop = it.loop;
+    it.fade = 0;
+    it.fade_duration = fade;
+  } else {
+    it.previous = nullptr;
+  }
+
+  it.clip = &clip;
+  it.time = 0;
+  it.loop = loop;
+}
+
+void AnimationSystem::set_speed(u32 instance, f32 speed) {
+  if (instance < instances.size()) {
+    instances[instance].speed = speed;
+  }
+}
+
+void AnimationSystem::evaluate(Instance &instance, Scratch &scratch) {
+  const Skeleton &skeleton = *instance.skeleton;
+  u32 n = skeleton.joint_count();
+
+  if (instance.clip) {
+    instance.clip->sample(instance.time, instance.loop, scratch.current);
+  } else {
+    scratch.current = skeleton.bind_pose;
+  }
+
+  if (instance.previous) {
+    instance.previous->sample(instance.previous_time, instance.previous_loop,
+                              scratch.previous);
+    mix_pose(scratch.previous.data.data(), scratch.current.data.data(),
+             instance.fade / instance.fade_duration,
+             scratch.current.data.data(), scratch.current.stride);
+  }
+
+  // parents precede children, so one forward pass resolves the hierarchy
+  scratch.model.resize(n);
+  Mat4 *out = palette.data() + instance.palette_offset;
+
+  for (u32 j = 0; j < n; j++) {
+    Mat4 local = compose(scratch.current, j);
+    i32 p = skeleton.parent[j];
+    scratch.model[j] = p < 0 ? local : scratch.model[p] * local;
+    out[j] = skeleton.global_inverse * scratch.model[j] * skeleton.offset[j];
+  }
+}
+
+void AnimationSystem::update(f32 dt) {
+  if (instances.empty()) {
+    return;
+  }
+
+  for (auto &instance : instances) {
+    instance.time += dt * instance.speed;
+
+    if (instance.previous) {
+      instance.previous_time += dt * instance.speed;
+      instance.fade += dt;
+      if (instance.fade >= instance.fade_duration) {
+        instance.previous = nullptr;
+      }
+    }
+  }
+
+  scratch.resize(jobs::thread_count());
+
+  jobs::parallel_for(instances.size(), 8, [&](u32 begin, u32 end, u32 worker) {
+    for (u32 i = begin; i < end; i++) {
+      evaluate(instances[i], scratch[worker]);
+    }
+  });
+
+  usize size = sizeof(Mat4) * palette.size();
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+  if (size > capacity) {
+    capacity = std::max(size, capacity * 2);
+  }
+  // orphan so the previous frame's palette can still be read by the GPU
+  glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, palette.data());
+  RENDER_STAT_UPLOAD(size);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void AnimationSystem::bind() {
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, ssbo);
+}
+
+void AnimationSystem::apply(Shader &shader, u32 instance) {
+  if (instance >= instances.size()) {
+    engine::error("AnimationSystem::apply: no instance {}", instance);
+    return;
+  }
+
+  i32 loc = glGetUniformLocation(shader.program, "bone_offset");
+  glUniform1ui(loc, instances[instance].palette_offset);
+}
+
+string AnimationSystem::glsl() {
+  return R"(
+        layout(location = 5) in uvec4 bone_ids;
+        layout(location = 6) in vec4 bone_weights;
+
+        layout(std430, binding = 5) readonly buffer BonePalette {
+            mat4 bones[];
+        };
+
+        uniform uint bone_offset;
+
+        // model space skinning matrix, apply before the model matrix:
+        // `gl_Position = perspective * view * model * skin_matrix() * pos;`
+        mat4 skin_matrix() {
+            uvec4 ids = bone_ids + bone_offset;
+            return bones[ids.x] * bone_weights.x
+                 + bones[ids.y] * bone_weights.y
+                 + bones[ids.z] * bone_weights.z
+                 + bones[ids.w] * bone_weights.w;
+        }
+    )";
+}
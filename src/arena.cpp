@@ -0,0 +1,587 @@
+#include <rama/arena.hpp>
+
+#include <rama/render_stats.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr u32 none = TlsfAllocator::none;
+
+// size classes: sizes below sl_count map to fl 0 exactly, larger sizes are
+// split into sl_count linear steps per power of two
+void mapping(u32 size, u32 sl_bits, u32 &fl, u32 &sl) {
+  u32 sl_count = 1u << sl_bits;
+  if (size < sl_count) {
+    fl = 0;
+    sl = size;
+    return;
+  }
+
+  u32 msb = 31 - std::countl_zero(size);
+  fl = msb - sl_bits + 1;
+  sl = (size >> (msb - sl_bits)) ^ sl_count;
+}
+
+} // namespace
+
+//
+// TlsfAllocator
+//
+
+TlsfAllocator TlsfAllocator::make(u32 capacity) {
+  TlsfAllocator result;
+  for (auto &row : result.heads) {
+    row.fill(none);
+  }
+
+  result.capacity = capacity;
+  if (capacity > 0) {
+    u32 block = result.new_block(0, capacity);
+    result.insert(block);
+  }
+
+  return result;
+}
+
+TlsfAllocator TlsfAllocator::make_packed(u32 capacity,
+                                         const ArrayList<u32> &sizes) {
+  TlsfAllocator result = TlsfAllocator::make(0);
+  result.capacity = capacity;
+
+  u32 offset = 0, prev = none;
+  auto append = [&](u32 size) {
+    u32 id = result.new_block(offset, size);
+    result.blocks[id].prev_phys = prev;
+    if (prev != none) {
+      result.blocks[prev].next_phys = id;
+    }
+
+    offset += size;
+    prev = id;
+    return id;
+  };
+
+  for (u32 size : sizes) {
+    result.blocks[append(size)].free = false;
+    result.used += size;
+  }
+
+  if (offset < capacity) {
+    result.insert(append(capacity - offset));
+  }
+
+  return result;
+}
+
+u32 TlsfAllocator::new_block(u32 offset, u32 size) {
+  Block block{offset, size, none, none, none, none, true};
+
+  if (!unused.empty()) {
+    u32 id = unused.back();
+    unused.pop_back();
+    blocks[id] = block;
+    return id;
+  }
+
+  blocks.push_back(block);
+  return blocks.size() - 1;
+}
+
+void TlsfAllocator::insert(u32 id) {
+  Block &block = blocks[id];
+  u32 fl, sl;
+  mapping(block.size, sl_bits, fl, sl);
+
+  block.free = true;
+  block.prev_free = none;
+  block.next_free = heads[fl][sl];
+  if (block.next_free != none) {
+    blocks[block.next_free].prev_free = id;
+  }
+  heads[fl][sl] = id;
+
+  fl_bitmap |= 1u << fl;
+  sl_bitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::remove(u32 id) {
+  Block &block = blocks[id];
+  u32 fl, sl;
+  mapping(block.size, sl_bits, fl, sl);
+
+  if (block.prev_free != none) {
+    blocks[block.prev_free].next_free = block.next_free;
+  } else {
+    heads[fl][sl] = block.next_free;
+  }
+  if (block.next_free != none) {
+    blocks[block.next_free].prev_free = block.prev_free;
+  }
+
+  if (heads[fl][sl] == none) {
+    sl_bitmap[fl] &= ~(1u << sl);
+    if (sl_bitmap[fl] == 0) {
+      fl_bitmap &= ~(1u << fl);
+    }
+  }
+
+  block.free = false;
+}
+
+// trims `id` to `size` and returns the remainder as a new, unlisted block
+u32 TlsfAllocator::split(u32 id, u32 size) {
+  u32 rest = new_block(blocks[id].offset + size, blocks[id].size - size);
+  Block &block = blocks[id];
+
+  blocks[rest].prev_phys = id;
+  blocks[rest].next_phys = block.next_phys;
+  if (block.next_phys != none) {
+    blocks[block.next_phys].prev_phys = rest;
+  }
+
+  block.next_phys = rest;
+  block.size = size;
+  return rest;
+}
+
+// absorbs `right` into its physical predecessor `left`
+void TlsfAllocator::merge(u32 left, u32 right) {
+  blocks[left].size += blocks[right].size;
+  blocks[left].next_phys = blocks[right].next_phys;
+  if (blocks[right].next_phys != none) {
+    blocks[blocks[right].next_phys].prev_phys = left;
+  }
+
+  unused.push_back(right);
+}
+
+u32 TlsfAllocator::allocate(u32 size) {
+  if (size == 0) {
+    return none;
+  }
+
+  // round up to the next class so any block in it is large enough
+  u32 search = size;
+  if (search >= sl_count) {
+    u32 msb = 31 - std::countl_zero(search);
+    search += (1u << (msb - sl_bits)) - 1;
+  }
+
+  u32 fl, sl;
+  mapping(search, sl_bits, fl, sl);
+  if (fl >= fl_count) {
+    return none;
+  }
+
+  u32 sl_map = sl_bitmap[fl] & (~0u << sl);
+  if (sl_map == 0) {
+    u32 fl_map = fl + 1 < fl_count ? fl_bitmap & (~0u << (fl + 1)) : 0;
+    if (fl_map == 0) {
+      return none;
+    }
+
+    fl = std::countr_zero(fl_map);
+    sl_map = sl_bitmap[fl];
+  }
+  sl = std::countr_zero(sl_map);
+
+  u32 id = heads[fl][sl];
+  remove(id);
+
+  if (blocks[id].size > size) {
+    insert(split(id, size));
+  }
+
+  used += blocks[id].size;
+  return id;
+}
+
+void TlsfAllocator::free(u32 id) {
+  if (id == none || blocks[id].free) {
+    return;
+  }
+
+  used -= blocks[id].size;
+
+  u32 next = blocks[id].next_phys;
+  if (next != none && blocks[next].free) {
+    remove(next);
+    merge(id, next);
+  }
+
+  u32 prev = blocks[id].prev_phys;
+  if (prev != none && blocks[prev].free) {
+    remove(prev);
+    merge(prev, id);
+    id = prev;
+  }
+
+  insert(id);
+}
+
+u32 TlsfAllocator::free_blocks() const {
+  u32 count = 0;
+  for (const auto &row : heads) {
+    for (u32 head : row) {
+      for (u32 id = head; id != none; id = blocks[id].next_free) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+u32 TlsfAllocator::largest_free() const {
+  if (fl_bitmap == 0) {
+    return 0;
+  }
+
+  // the largest block is somewhere in the highest non-empty class
+  u32 fl = 31 - std::countl_zero(fl_bitmap);
+  u32 sl = 31 - std::countl_zero(sl_bitmap[fl]);
+
+  u32 largest = 0;
+  for (u32 id = heads[fl][sl]; id != none; id = blocks[id].next_free) {
+    largest = std::max(largest, blocks[id].size);
+  }
+  return largest;
+}
+
+//
+// GeometryArena
+//
+
+GeometryArena GeometryArena::make(u32 vertex_capacity, u32 index_capacity) {
+  GeometryArena result;
+  result.vertex_alloc = TlsfAllocator::make(vertex_capacity);
+  result.index_alloc = TlsfAllocator::make(index_capacity);
+
+  glGenBuffers(1, &result.vertex_buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, result.vertex_buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ArenaVertex) * vertex_capacity,
+               nullptr, GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  glGenBuffers(1, &result.index_buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, result.index_buffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, sizeof(u32) * index_capacity, nullptr,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  glGenBuffers(1, &result.indirect_buffer);
+
+  // no attributes, vertices are pulled from the SSBO
+  glGenVertexArrays(1, &result.vao);
+
+  return result;
+}
+
+void GeometryArena::destroy() {
+  glDeleteBuffers(1, &vertex_buffer);
+  glDeleteBuffers(1, &index_buffer);
+  glDeleteBuffers(1, &indirect_buffer);
+  glDeleteVertexArrays(1, &vao);
+}
+
+// moves every live allocation of one buffer, packed in offset order, into
+// a new buffer of `new_capacity` units
+void GeometryArena::relocate(TlsfAllocator &alloc, u32 &buffer, usize unit,
+                             u32 Entry::*block, u32 new_capacity) {
+  ArrayList<Entry *> moving;
+  for (auto &entry : entries) {
+    if (entry.*block != none) {
+      moving.push_back(&entry);
+    }
+  }
+
+  std::sort(moving.begin(), moving.end(), [&](Entry *a, Entry *b) {
+    return alloc.offset(a->*block) < alloc.offset(b->*block);
+  });
+
+  ArrayList<u32> sizes;
+  for (Entry *entry : moving) {
+    sizes.push_back(alloc.size(entry->*block));
+  }
+
+  // block i of the packed allocator is the i-th moved range
+  TlsfAllocator packed = TlsfAllocator::make_packed(new_capacity, sizes);
+
+  u32 target;
+  glGenBuffers(1, &target);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+  glBufferData(GL_COPY_WRITE_BUFFER, unit * new_capacity, nullptr,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+  for (u32 i = 0; i < moving.size(); i++) {
+    u32 old_block = moving[i]->*block;
+
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        unit * alloc.offset(old_block),
+                        unit * packed.offset(i), unit * sizes[i]);
+
+    moving[i]->*block = i;
+  }
+
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  glDeleteBuffers(1, &buffer);
+  buffer = target;
+  alloc = std::move(packed);
+}
+
+u32 GeometryArena::reserve(TlsfAllocator &alloc, u32 &buffer, usize unit,
+                           u32 size) {
+  if (size == 0) {
+    return none;
+  }
+
+  u32 Entry::*member = &alloc == &vertex_alloc ? &Entry::vertex_block
+                                               : &Entry::index_block;
+
+  u32 block = alloc.allocate(size);
+  if (block != none) {
+    return block;
+  }
+
+  // compacting leaves all free space in one block at the end
+  if (alloc.total() - alloc.used_units() >= size &&
+      alloc.largest_free() < size) {
+    relocate(alloc, buffer, unit, member, alloc.total());
+    defragmentations++;
+
+    block = alloc.allocate(size);
+    if (block != none) {
+      return block;
+    }
+  }
+
+  u32 capacity = std::max(alloc.total() * 2, alloc.used_units() + size * 2);
+  engine::info("GeometryArena: growing to {} units of {} bytes", capacity,
+               unit);
+  relocate(alloc, buffer, unit, member, capacity);
+
+  return alloc.allocate(size);
+}
+
+u32 GeometryArena::add(const ArrayList<ArenaVertex> &vertices,
+                       const ArrayList<u32> &indices) {
+  Entry entry;
+  entry.vertex_block =
+      reserve(vertex_alloc, vertex_buffer, sizeof(ArenaVertex), vertices.size());
+  entry.index_block =
+      reserve(index_alloc, index_buffer, sizeof(u32), indices.size());
+  entry.index_count = indices.size();
+
+  if (entry.vertex_block != none) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER,
+                    sizeof(ArenaVertex) * vertex_alloc.offset(entry.vertex_block),
+                    sizeof(ArenaVertex) * vertices.size(), vertices.data());
+    RENDER_STAT_UPLOAD(sizeof(ArenaVertex) * vertices.size());
+  }
+
+  if (entry.index_block != none) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER,
+                    sizeof(u32) * index_alloc.offset(entry.index_block),
+                    sizeof(u32) * indices.size(), indices.data());
+    RENDER_STAT_UPLOAD(sizeof(u32) * indices.size());
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  live++;
+
+  if (!free_entries.empty()) {
+    u32 id = free_entries.back();
+    free_entries.pop_back();
+    entries[id] = entry;
+    return id;
+  }
+
+  entries.push_back(entry);
+  return entries.size() - 1;
+}
+
+u32 GeometryArena::add(const Mesh &mesh) {
+  ArrayList<ArenaVertex> vertices(mesh.vertices.size());
+
+  for (u32 i = 0; i < vertices.size(); i++) {
+    Vec2f uv = i < mesh.uvs.size() ? mesh.uvs[i] : Vec2f(0);
+    Vec3f normal = i < mesh.normals.size() ? mesh.normals[i] : Vec3f(0, 1, 0);
+    Vec3f tangent = i < mesh.tangents.size() ? mesh.tangents[i] : Vec3f(0);
+
+    vertices[i] = ArenaVertex{Vec4f(mesh.vertices[i], uv.x),
+                              Vec4f(normal, uv.y), Vec4f(tangent, 0)};
+  }
+
+  return add(vertices, mesh.indices);
+}
+
+void GeometryArena::remove(u32 mesh) {
+  if (mesh >= entries.size() || (entries[mesh].vertex_block == none &&
+                                 entries[mesh].index_block == none)) {
+    return;
+  }
+
+  vertex_alloc.free(entries[mesh].vertex_block);
+  index_alloc.free(entries[mesh].index_block);
+
+  entries[mesh] = Entry{};
+  free_entries.push_back(mesh);
+  live--;
+}
+
+void GeometryArena::defragment() {
+  relocate(vertex_alloc, vertex_buffer, sizeof(ArenaVertex),
+           &Entry::vertex_block, vertex_alloc.total());
+  relocate(index_alloc, index_buffer, sizeof(u32), &Entry::index_block,
+           index_alloc.total());
+  defragmentations++;
+}
+
+void GeometryArena::bind() {
+  // the index buffer changes when the arena grows or compacts
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, vertex_buffer);
+}
+
+ArenaDrawCommand GeometryArena::command(u32 mesh, u32 instances,
+                                        u32 base_instance) {
+  if (mesh >= entries.size() || entries[mesh].index_count == 0) {
+    return ArenaDrawCommand{0, 0, 0, 0, 0};
+  }
+
+  const Entry &entry = entries[mesh];
+  return ArenaDrawCommand{
+      entry.index_count,
+      instances,
+      index_alloc.offset(entry.index_block),
+      (i32)vertex_alloc.offset(entry.vertex_block),
+      base_instance,
+  };
+}
+
+void GeometryArena::draw(u32 mesh, u32 instances, u32 base_instance) {
+  ArenaDrawCommand cmd = command(mesh, instances, base_instance);
+  if (cmd.count == 0) {
+    return;
+  }
+
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, cmd.count / 3 * cmd.instance_count);
+  glDrawElementsInstancedBaseVertexBaseInstance(
+      GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+      (void *)(sizeof(u32) * cmd.first_index), cmd.instance_count,
+      cmd.base_vertex, cmd.base_instance);
+}
+
+void GeometryArena::multi_draw(const ArrayList<ArenaDrawCommand> &commands) {
+  if (commands.empty()) {
+    return;
+  }
+
+  usize size = sizeof(ArenaDrawCommand) * commands.size();
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+  if (size > indirect_capacity) {
+    indirect_capacity = std::max(size, indirect_capacity * 2);
+  }
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, indirect_capacity, nullptr,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, commands.data());
+  RENDER_STAT_UPLOAD(size);
+
+#if defined(RAMA_RENDER_STATS_ENABLED)
+  RENDER_STAT(draw_calls, 1);
+  for (auto &cmd : commands) {
+    RENDER_STAT(triangles, cmd.count / 3 * cmd.instance_count);
+  }
+#endif
+
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                              commands.size(), 0);
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+ArenaStats GeometryArena::stats() {
+  auto fragmentation = [](const TlsfAllocator &alloc) {
+    u32 free = alloc.total() - alloc.used_units();
+    return free > 0 ? 1.0f - (f32)alloc.largest_free() / free : 0.0f;
+  };
+
+  ArenaStats result;
+  result.meshes = live;
+  result.vertex_capacity = vertex_alloc.total();
+  result.vertex_used = vertex_alloc.used_units();
+  result.vertex_free_blocks = vertex_alloc.free_blocks();
+  result.vertex_fragmentation = fragmentation(vertex_alloc);
+  result.index_capacity = index_alloc.total();
+  result.index_used = index_alloc.used_units();
+  result.index_free_blocks = index_alloc.free_blocks();
+  result.index_fragmentation = fragmentation(index_alloc);
+  result.defragmentations = defragmentations;
+  return result;
+}
+
+void GeometryArena::draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ArenaStats s = stats();
+
+  ImGui::Begin("Geometry Arena");
+
+  ImGui::Text("%u meshes, %u defragmentations", s.meshes, s.defragmentations);
+
+  auto occupancy = [](const char *label, u32 used, u32 capacity, u32 blocks,
+                      f32 fragmentation, usize unit) {
+    ImGui::SeparatorText(label);
+    f32 fraction = capacity > 0 ? (f32)used / capacity : 0.0f;
+    string overlay = fmt::format("{} / {} ({:.1f} / {:.1f} MB)", used,
+                                 capacity, used * unit / (1024.0 * 1024.0),
+                                 capacity * unit / (1024.0 * 1024.0));
+    ImGui::ProgressBar(fraction, ImVec2(-1, 0), overlay.c_str());
+    ImGui::Text("%u free blocks, %.0f%% fragmented", blocks,
+                fragmentation * 100.0f);
+  };
+
+  occupancy("Vertices", s.vertex_used, s.vertex_capacity,
+            s.vertex_free_blocks, s.vertex_fragmentation, sizeof(ArenaVertex));
+  occupancy("Indices", s.index_used, s.index_capacity, s.index_free_blocks,
+            s.index_fragmentation, sizeof(u32));
+
+  if (ImGui::Button("Defragment")) {
+    defragment();
+  }
+
+  ImGui::End();
+}
+
+string GeometryArena::glsl() {
+  return R"(
+        struct ArenaVertex {
+            vec4 position_u;
+            vec4 normal_v;
+            vec4 tangent;
+        };
+
+        layout(std430, binding = 6) readonly buffer ArenaVertices {
+            ArenaVertex arena_vertices[];
+        };
+
+        // gl_VertexID already includes the draw's base vertex
+        ArenaVertex arena_vertex() { return arena_vertices[gl_VertexID]; }
+
+        vec3 arena_position(ArenaVertex v) { return v.position_u.xyz; }
+        vec2 arena_uv(ArenaVertex v) { return vec2(v.position_u.w, v.normal_v.w); }
+        vec3 arena_normal(ArenaVertex v) { return v.normal_v.xyz; }
+        vec3 arena_tangent(ArenaVertex v) { return v.tangent.xyz; }
+    )";
+}
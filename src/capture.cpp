@@ -0,0 +1,292 @@
+#include <rama/capture.hpp>
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+namespace {
+
+struct Slot {
+  u32 pbo = 0;
+  usize capacity = 0;
+  GLsync fence = nullptr;
+
+  u32 width = 0, height = 0;
+  u64 index = 0;
+  string path;
+};
+
+struct Job {
+  capture::CapturedFrame frame;
+  string path;
+};
+
+ArrayList<Slot> ring;
+u32 head = 0;
+
+u64 frame_index = 0, dropped = 0;
+
+string screenshot_path;
+string recording_directory;
+bool recording = false;
+
+ArrayList<std::thread> encoders;
+std::mutex mutex;
+std::condition_variable wake, idle;
+std::deque<Job> queue;
+u32 busy = 0;
+bool stopping = false;
+capture::Callback callback;
+
+void encode(Job &job) {
+  capture::CapturedFrame &frame = job.frame;
+
+  if (!job.path.empty()) {
+    if (!stbi_write_png(job.path.c_str(), frame.width, frame.height, 4,
+                        frame.pixels.data(), frame.width * 4)) {
+      engine::error("capture: failed to write \"{}\"", job.path);
+    }
+  }
+
+  capture::Callback current;
+  {
+    std::lock_guard lock(mutex);
+    current = callback;
+  }
+
+  if (current) {
+    current(frame);
+  }
+}
+
+void encoder_main() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [] { return stopping || !queue.empty(); });
+      if (queue.empty()) {
+        return;
+      }
+
+      job = std::move(queue.front());
+      queue.pop_front();
+      busy++;
+    }
+
+    encode(job);
+
+    {
+      std::lock_guard lock(mutex);
+      busy--;
+    }
+    idle.notify_all();
+  }
+}
+
+// GL rows start at the bottom, flip while copying out of the mapped buffer
+void resolve(Slot &slot) {
+  Job job;
+  job.path = slot.path;
+  job.frame.index = slot.index;
+  job.frame.width = slot.width;
+  job.frame.height = slot.height;
+
+  usize stride = slot.width * 4;
+  job.frame.pixels.resize(stride * slot.height);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  const u8 *mapped = (const u8 *)glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, stride * slot.height, GL_MAP_READ_BIT);
+
+  if (mapped) {
+    for (u32 y = 0; y < slot.height; y++) {
+      memcpy(job.frame.pixels.data() + y * stride,
+             mapped + (slot.height - 1 - y) * stride, stride);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  if (!mapped) {
+    engine::error("capture: failed to map pixel pack buffer");
+    return;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    queue.push_back(std::move(job));
+  }
+  wake.notify_one();
+}
+
+bool signalled(Slot &slot) {
+  GLenum status = glClientWaitSync(slot.fence, 0, 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void poll() {
+  // slots complete in submission order, starting from the oldest
+  for (u32 i = 1; i <= ring.size(); i++) {
+    Slot &slot = ring[(head + i) % ring.size()];
+    if (slot.fence && signalled(slot)) {
+      resolve(slot);
+    }
+  }
+}
+
+sol::table lib(sol::this_state state) {
+  sol::state_view luaview(state);
+  auto module = luaview.create_table();
+
+  module.set_function("Screenshot", &capture::screenshot);
+  module.set_function("StartRecording", &capture::start_recording);
+  module.set_function("StopRecording", &capture::stop_recording);
+  module.set_function("IsRecording", &capture::is_recording);
+  module.set_function("DroppedFrames", &capture::dropped_frames);
+
+  return module;
+}
+
+} // namespace
+
+namespace capture {
+
+void init(u32 ring_size, u32 encoder_threads) {
+  ring.resize(std::max(2u, ring_size));
+  for (auto &slot : ring) {
+    glGenBuffers(1, &slot.pbo);
+  }
+
+  if (encoder_threads == 0) {
+    encoder_threads = std::max(1u, std::thread::hardware_concurrency() / 4);
+  }
+
+  stopping = false;
+  for (u32 i = 0; i < encoder_threads; i++) {
+    encoders.emplace_back(encoder_main);
+  }
+}
+
+void shutdown() {
+  // flush whatever is still in flight so recordings are not truncated
+  for (auto &slot : ring) {
+    if (slot.fence) {
+      glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    }
+  }
+  poll();
+
+  {
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [] { return queue.empty() && busy == 0; });
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (auto &encoder : encoders) {
+    encoder.join();
+  }
+  encoders.clear();
+
+  for (auto &slot : ring) {
+    glDeleteBuffers(1, &slot.pbo);
+  }
+  ring.clear();
+}
+
+void frame(Framebuffer &framebuffer) {
+  if (ring.empty()) {
+    return;
+  }
+
+  poll();
+
+  if (screenshot_path.empty() && !recording) {
+    return;
+  }
+
+  frame_index++;
+
+  u32 next = (head + 1) % ring.size();
+  Slot &slot = ring[next];
+
+  // every slot is still in flight, drop instead of stalling on the GPU
+  if (slot.fence) {
+    dropped++;
+    return;
+  }
+
+  head = next;
+
+  slot.width = framebuffer.width;
+  slot.height = framebuffer.height;
+  slot.index = frame_index;
+
+  if (!screenshot_path.empty()) {
+    slot.path = screenshot_path;
+    screenshot_path.clear();
+  } else {
+    slot.path =
+        fmt::format("{}/frame_{:06}.png", recording_directory, frame_index);
+  }
+
+  usize size = (usize)slot.width * slot.height * 4;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  if (size > slot.capacity) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    slot.capacity = size;
+  }
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, slot.width, slot.height, GL_RGBA, GL_UNSIGNED_BYTE,
+               nullptr);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void screenshot(string path) { screenshot_path = engine::get_path(path); }
+
+void start_recording(string directory) {
+  recording_directory = engine::get_path(directory);
+
+  std::error_code error;
+  std::filesystem::create_directories(recording_directory, error);
+  if (error) {
+    engine::error("capture: could not create \"{}\": {}", recording_directory,
+                  error.message());
+    return;
+  }
+
+  recording = true;
+}
+
+void stop_recording() { recording = false; }
+
+bool is_recording() { return recording; }
+
+void set_callback(Callback fn) {
+  std::lock_guard lock(mutex);
+  callback = fn;
+}
+
+u64 dropped_frames() { return dropped; }
+
+void RegisterLuaModule(sol::state &state) {
+  state.require("capture", sol::c_call<decltype(&lib), &lib>, false);
+}
+
+} // namespace capture
@@ -0,0 +1,145 @@
+#include <rama/drawlist.hpp>
+
+#include <rama/jobs.hpp>
+#include <rama/profiler.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+bool packet_order(const DrawPacket &a, const DrawPacket &b) {
+  return a.key < b.key;
+}
+
+f32 max_scale(const Mat4 &model) {
+  f32 x = glm::length(Vec3f(model[0]));
+  f32 y = glm::length(Vec3f(model[1]));
+  f32 z = glm::length(Vec3f(model[2]));
+  return std::max(x, std::max(y, z));
+}
+
+} // namespace
+
+Frustum Frustum::make(Mat4 viewproj) {
+  Frustum result;
+
+  Vec4f row0(viewproj[0][0], viewproj[1][0], viewproj[2][0], viewproj[3][0]);
+  Vec4f row1(viewproj[0][1], viewproj[1][1], viewproj[2][1], viewproj[3][1]);
+  Vec4f row2(viewproj[0][2], viewproj[1][2], viewproj[2][2], viewproj[3][2]);
+  Vec4f row3(viewproj[0][3], viewproj[1][3], viewproj[2][3], viewproj[3][3]);
+
+  result.planes[0] = row3 + row0; // left
+  result.planes[1] = row3 - row0; // right
+  result.planes[2] = row3 + row1; // bottom
+  result.planes[3] = row3 - row1; // top
+  result.planes[4] = row3 + row2; // near
+  result.planes[5] = row3 - row2; // far
+
+  for (auto &plane : result.planes) {
+    plane /= glm::length(Vec3f(plane));
+  }
+
+  return result;
+}
+
+bool Frustum::intersects_sphere(Vec3f center, f32 radius) const {
+  for (auto &plane : planes) {
+    if (glm::dot(Vec3f(plane), center) + plane.w < -radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+DrawList DrawList::make() {
+  DrawList result;
+  result.lists.resize(jobs::thread_count());
+  return result;
+}
+
+void DrawList::destroy() {
+  items.clear();
+  lists.clear();
+  merged.clear();
+}
+
+void DrawList::add(Mesh &mesh, Shader &shader, Mat4 model) {
+  add(mesh, shader, model, 0);
+}
+
+void DrawList::add(Mesh &mesh, Shader &shader, Mat4 model, u32 material) {
+  items.push_back(DrawItem{&mesh, &shader, model, material});
+}
+
+void DrawList::clear() { items.clear(); }
+
+void DrawList::build(Mat4 perspective, Mat4 view) {
+  Frustum frustum = Frustum::make(perspective * view);
+
+  lists.resize(jobs::thread_count());
+  for (auto &list : lists) {
+    list.clear();
+  }
+
+  jobs::parallel_for(
+      items.size(), partition_size, [&](u32 begin, u32 end, u32 worker) {
+        CommandList &list = lists[worker];
+
+        for (u32 i = begin; i < end; i++) {
+          const DrawItem &item = items[i];
+
+          Vec3f center = Vec3f(item.model * Vec4f(item.mesh->center, 1));
+          f32 radius = item.mesh->radius * max_scale(item.model);
+
+          if (!frustum.intersects_sphere(center, radius)) {
+            continue;
+          }
+
+          // state first (program, then vao), then front to back
+          f32 depth = std::max(0.0f, -(view * Vec4f(center, 1)).z);
+          u64 key = (u64)(item.shader->program & 0xFFFF) << 48 |
+                    (u64)(item.mesh->vao & 0xFFFF) << 32 |
+                    std::bit_cast<u32>(depth);
+
+          list.push(DrawPacket{key, item.mesh, item.shader, item.model,
+                               item.material});
+        }
+      });
+
+  jobs::parallel_for(lists.size(), 1, [&](u32 begin, u32 end, u32) {
+    for (u32 i = begin; i < end; i++) {
+      std::sort(lists[i].packets.begin(), lists[i].packets.end(), packet_order);
+    }
+  });
+
+  merged.clear();
+  for (auto &list : lists) {
+    usize middle = merged.size();
+    merged.insert(merged.end(), list.packets.begin(), list.packets.end());
+    std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end(),
+                       packet_order);
+  }
+
+  visible = merged.size();
+  culled = items.size() - visible;
+}
+
+void DrawList::submit(Mat4 perspective, Mat4 view) {
+  GPU_SCOPE("DrawList");
+
+  Shader *bound = nullptr;
+
+  for (auto &packet : merged) {
+    if (packet.shader != bound) {
+      bound = packet.shader;
+      bound->bind();
+      bound->uniform("perspective", perspective);
+      bound->uniform("view", view);
+    }
+
+    bound->uniform("model", packet.model);
+    packet.mesh->draw_instanced(1, packet.material);
+  }
+}
@@ -5,10 +5,21 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
-
+#include <thread>
+
+#include <rama/capture.hpp>
+#include <rama/gpu_memory.hpp>
+#include <rama/jobs.hpp>
+#include <rama/postprocess.hpp>
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+#include <rama/resolution.hpp>
 #include <rama/scripting.hpp>
+#include <rama/shaders.hpp>
 
 #include <SDL3/SDL_main.h>
 
@@ -56,10 +67,184 @@ bool mouselock = false;
 
 bool keyboard_block = false, mouse_block = false;
 
-f32 dt = 0.0;
+using Clock = std::chrono::steady_clock;
+
+f32 dt = 0.0, raw_dt = 0.0;
+f32 max_dt = 0.1f;
+f32 dt_smoothing = 0.0f;
+
+engine::VSync vsync = engine::VSync::on;
+f32 target_fps = 0.0f;
+Clock::time_point frame_deadline;
+
+constexpr u32 frame_history_size = 240;
+Array<f32, frame_history_size> frame_history = {};
+u32 frame_history_count = 0, frame_history_next = 0;
 
 string exe_path = "";
 
+// headless runs render a fixed number of frames into the game framebuffer
+// through SDL's offscreen (EGL) video driver and then exit
+bool headless = false;
+u32 headless_frames = 600;
+constexpr f32 headless_dt = 1.0f / 60.0f;
+
+// offline tools such as LightmapBaker::bake: the script runs once with no
+// window and no GL context, then the process exits
+string bake_script;
+
+// shipping runs skip the editor shell: the game draws straight into the
+// window, and ImGui only exists once engine::enable_imgui() asks for it
+#ifdef RAMA_SHIPPING
+bool shipping = true;
+#else
+bool shipping = false;
+#endif
+
+bool imgui_ready = false;
+// between ImGui::NewFrame and ImGui::Render
+bool imgui_in_frame = false;
+bool in_game_frame = false;
+
+PostProcess *post_process = nullptr;
+
+void parse_options(int argc, char **argv) {
+  if (const char *env = SDL_getenv("RAMA_HEADLESS"); env && *env) {
+    headless = string(env) != "0";
+  }
+
+  if (const char *env = SDL_getenv("RAMA_SHIPPING"); env && *env) {
+    shipping = string(env) != "0";
+  }
+
+  if (const char *env = SDL_getenv("RAMA_FRAMES"); env && *env) {
+    headless_frames = std::max(1, std::atoi(env));
+  }
+
+  for (i32 i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg == "--headless") {
+      headless = true;
+    } else if (arg == "--shipping") {
+      shipping = true;
+    } else if (arg == "--editor") {
+      shipping = false;
+    } else if (arg == "--bake" && i + 1 < argc) {
+      bake_script = argv[++i];
+    } else if (arg == "--frames" && i + 1 < argc) {
+      headless_frames = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--size" && i + 1 < argc) {
+      i32 w = 0, h = 0;
+      if (std::sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+        sdl_width = w;
+        sdl_height = h;
+      }
+    }
+  }
+}
+
+void apply_vsync() {
+  if (!context) {
+    return;
+  }
+
+  if (headless) {
+    SDL_GL_SetSwapInterval(0);
+    return;
+  }
+
+  i32 interval = 0;
+  switch (vsync) {
+  case engine::VSync::off:
+    interval = 0;
+    break;
+  case engine::VSync::on:
+    interval = 1;
+    break;
+  case engine::VSync::adaptive:
+    interval = -1;
+    break;
+  }
+
+  if (!SDL_GL_SetSwapInterval(interval)) {
+    if (vsync == engine::VSync::adaptive) {
+      engine::warning("Adaptive vsync unsupported, falling back to vsync: {}",
+                      SDL_GetError());
+      SDL_GL_SetSwapInterval(1);
+    } else {
+      engine::error("SDL_GL_SetSwapInterval: {}", SDL_GetError());
+    }
+  }
+}
+
+void push_frame_time(f32 seconds) {
+  frame_history[frame_history_next] = seconds * 1000.0f;
+  frame_history_next = (frame_history_next + 1) % frame_history_size;
+  frame_history_count = std::min(frame_history_count + 1, frame_history_size);
+}
+
+void record_frame(f32 seconds) {
+  raw_dt = seconds;
+  push_frame_time(seconds);
+
+  f32 clamped = std::clamp(seconds, 0.0f, max_dt);
+  if (dt_smoothing > 0.0f && dt > 0.0f) {
+    dt += (clamped - dt) * (1.0f - dt_smoothing);
+  } else {
+    dt = clamped;
+  }
+}
+
+// Sleeps for the bulk of the remaining frame and spins the last stretch,
+// since the OS scheduler routinely overshoots short sleeps by a millisecond.
+void limit_frame_rate() {
+  if (target_fps <= 0.0f) {
+    return;
+  }
+
+  constexpr auto spin_window = std::chrono::microseconds(1500);
+  auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<f64>(1.0 / target_fps));
+
+  auto now = Clock::now();
+  frame_deadline += period;
+
+  // more than a frame behind, resync instead of bursting to catch up
+  if (now - frame_deadline > period) {
+    frame_deadline = now;
+    return;
+  }
+
+  if (frame_deadline - now > spin_window) {
+    std::this_thread::sleep_for(frame_deadline - now - spin_window);
+  }
+
+  while (Clock::now() < frame_deadline) {
+  }
+}
+
+void imgui_new_frame() {
+  ImGui_ImplOpenGL3_NewFrame();
+  ImGui_ImplSDL3_NewFrame();
+  ImGui::NewFrame();
+  imgui_in_frame = true;
+}
+
+void init_imgui() {
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
+  io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
+  io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
+
+  ImGui_ImplSDL3_InitForOpenGL(window, context);
+  ImGui_ImplOpenGL3_Init(glslVersion.c_str());
+
+  imgui_ready = true;
+}
+
 bool opengl_shader_error(string idname, u32 id) {
   i32 success;
   glGetShaderiv(id, GL_COMPILE_STATUS, &success);
@@ -179,15 +364,19 @@ Texture Texture::make(string path) {
   result.data = stbi_load(path.c_str(), &w, &h, &ncomp, 0);
 
   u32 format = GL_RG;
+  const char *format_name = "RG8";
   switch (ncomp) {
   case 2:
     format = GL_RG;
+    format_name = "RG8";
     break;
   case 3:
     format = GL_RGB;
+    format_name = "RGB8";
     break;
   case 4:
     format = GL_RGBA;
+    format_name = "RGBA8";
     break;
   }
 
@@ -207,61 +396,31 @@ Texture Texture::make(string path) {
   glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format, GL_UNSIGNED_BYTE,
                result.data);
 
+  // RG is stored as two channels, anything else as the source has them
+  gpu_memory::track(gpu_memory::Category::texture, result.GLid,
+                    (usize)w * h * std::max(ncomp, 2), format_name, path, w,
+                    h);
+
   result.path = path;
   return result;
 }
 
 void Texture::destroy() {
+  gpu_memory::release(gpu_memory::Category::texture, GLid);
   glDeleteTextures(1, &GLid);
   stbi_image_free(data);
 }
 
 void Texture::bind(i32 unit) {
+  RENDER_STAT(texture_binds, 1);
   unit = GL_TEXTURE0 + unit;
   glActiveTexture(unit);
   glBindTexture(GL_TEXTURE_2D, GLid);
 }
 
 Shader Shader::load(string path) {
-  path = engine::get_path(path);
-  string vShaderCode, fShaderCode;
-  std::ifstream ifs(path);
-  if (ifs.is_open()) {
-    enum class line_type_ {
-      none = 0,
-      vertex,
-      fragment,
-      version
-    } line_type = line_type_::none;
-
-    assert(fShaderCode.empty());
-    assert(vShaderCode.empty());
-
-    string line;
-    while (std::getline(ifs, line)) {
-      if (line == "@vertex") {
-        line_type = line_type_::vertex;
-        continue;
-      } else if (line == "@fragment") {
-        line_type = line_type_::fragment;
-        continue;
-      }
-
-      if (line_type == line_type_::vertex) {
-        vShaderCode += line;
-        vShaderCode += "\n";
-      } else if (line_type == line_type_::fragment) {
-        fShaderCode += line;
-        fShaderCode += "\n";
-      }
-    }
-
-    ifs.close();
-  } else {
-    std::cout << "Failed to open shader file: " << path << '\n';
-  }
-
-  return Shader::make_with_version(vShaderCode, fShaderCode);
+  ShaderSource source = ShaderSource::load(path);
+  return Shader::make_with_version(source.vertex, source.fragment);
 }
 
 Shader Shader::make(string vertex_src, string fragment_src) {
@@ -302,33 +461,47 @@ Shader Shader::make_with_version(string vertex_src, string fragment_src) {
 
 void Shader::destroy() { glDeleteProgram(program); }
 
-void Shader::bind() { glUseProgram(program); }
+void Shader::bind() {
+  RENDER_STAT(state_changes, 1);
+  glUseProgram(program);
+}
 
 void Shader::uniform(string name, Mat4 val) {
+  RENDER_STAT(uniform_uploads, 1);
   i32 loc = glGetUniformLocation(program, name.c_str());
   glUniformMatrix4fv(loc, 1, false, glm::value_ptr(val));
 }
 
 void Shader::uniform(string name, Vec3f val) {
+  RENDER_STAT(uniform_uploads, 1);
   i32 loc = glGetUniformLocation(program, name.c_str());
   glUniform3fv(loc, 1, glm::value_ptr(val));
 }
 
 void Shader::uniform(string name, Vec2f val) {
+  RENDER_STAT(uniform_uploads, 1);
   i32 loc = glGetUniformLocation(program, name.c_str());
   glUniform2fv(loc, 1, glm::value_ptr(val));
 }
 
 void Shader::uniform(string name, f32 val) {
+  RENDER_STAT(uniform_uploads, 1);
   i32 loc = glGetUniformLocation(program, name.c_str());
   glUniform1f(loc, val);
 }
 
-void Shader::uniform(string name, Texture val) {
+void Shader::uniform(string name, const Texture &val) {
+  RENDER_STAT(uniform_uploads, 1);
   i32 loc = glGetUniformLocation(program, name.c_str());
   glUniform1i(loc, val.unit);
 }
 
+void Shader::sampler(string name, i32 unit) {
+  RENDER_STAT(uniform_uploads, 1);
+  i32 loc = glGetUniformLocation(program, name.c_str());
+  glUniform1i(loc, unit);
+}
+
 Mesh Mesh::load(string path) {
   path = engine::get_path(path);
   Assimp::Importer importer;
@@ -348,9 +521,37 @@ Mesh Mesh::load(string path) {
   ArrayList<Vec3f> tangents;
   ArrayList<Vec3f> bitangents;
   ArrayList<u32> indices;
+  ArrayList<Vec4u> bone_ids;
+  ArrayList<Vec4f> bone_weights;
+  ArrayList<Vec2f> uv2s;
+  bool has_uv2 = false;
+
+  // bones refer to joints by their node's depth-first index, which is the
+  // order Skeleton::load uses. every node takes a number, so repeated or
+  // empty names do not shift the ones after them
+  UnorderedMap<string, u32> joints;
+  u32 node_count = 0;
+  bool has_bones = false;
+
+  std::function<void(aiNode * node)> index_node;
+  index_node = [&](aiNode *node) -> void {
+    joints.emplace(node->mName.C_Str(), node_count++);
+    for (u32 i = 0; i < node->mNumChildren; i++) {
+      index_node(node->mChildren[i]);
+    }
+  };
+
+  if (scene) {
+    index_node(scene->mRootNode);
+    for (u32 i = 0; i < scene->mNumMeshes; i++) {
+      has_bones |= scene->mMeshes[i]->HasBones();
+    }
+  }
 
   std::function<void(aiMesh * mesh)> process_mesh;
   process_mesh = [&](aiMesh *mesh) {
+    u32 base = vertices.size();
+
     for (u32 i = 0; i < mesh->mNumVertices; i++) {
       vertices.push_back(Vec3f(mesh->mVertices[i].x, mesh->mVertices[i].y,
                                mesh->mVertices[i].z));
@@ -373,12 +574,56 @@ Mesh Mesh::load(string path) {
       } else {
         uvs.push_back(Vec2f(0));
       }
+
+      if (mesh->mTextureCoords[1]) {
+        uv2s.push_back(
+            Vec2f(mesh->mTextureCoords[1][i].x, mesh->mTextureCoords[1][i].y));
+        has_uv2 = true;
+      } else {
+        uv2s.push_back(Vec2f(0));
+      }
     }
 
     for (u32 i = 0; i < mesh->mNumFaces; i++) {
       aiFace face = mesh->mFaces[i];
       for (u32 j = 0; j < face.mNumIndices; j++) {
-        indices.push_back(face.mIndices[j]);
+        indices.push_back(base + face.mIndices[j]);
+      }
+    }
+
+    if (!has_bones) {
+      return;
+    }
+
+    bone_ids.resize(vertices.size(), Vec4u(0));
+    bone_weights.resize(vertices.size(), Vec4f(0));
+
+    // keep the four strongest influences per vertex
+    for (u32 i = 0; i < mesh->mNumBones; i++) {
+      aiBone *bone = mesh->mBones[i];
+      auto it = joints.find(bone->mName.C_Str());
+      if (it == joints.end()) {
+        engine::error("Mesh::load: bone \"{}\" has no node",
+                      bone->mName.C_Str());
+        continue;
+      }
+      u32 joint = it->second;
+
+      for (u32 j = 0; j < bone->mNumWeights; j++) {
+        u32 v = base + bone->mWeights[j].mVertexId;
+        f32 weight = bone->mWeights[j].mWeight;
+
+        u32 weakest = 0;
+        for (u32 k = 1; k < 4; k++) {
+          if (bone_weights[v][k] < bone_weights[v][weakest]) {
+            weakest = k;
+          }
+        }
+
+        if (weight > bone_weights[v][weakest]) {
+          bone_ids[v][weakest] = joint;
+          bone_weights[v][weakest] = weight;
+        }
       }
     }
   };
@@ -397,12 +642,32 @@ Mesh Mesh::load(string path) {
 
   process_node(scene->mRootNode);
 
-  return Mesh::make(vertices, uvs, normals, tangents, bitangents, indices);
+  for (auto &weights : bone_weights) {
+    f32 total = weights.x + weights.y + weights.z + weights.w;
+    weights = total > 0.0f ? weights / total : Vec4f(1, 0, 0, 0);
+  }
+
+  Mesh result = Mesh::make(vertices, uvs, normals, tangents, bitangents,
+                           indices, bone_ids, bone_weights);
+  if (has_uv2) {
+    result.set_uv2(uv2s);
+  }
+  gpu_memory::set_path(gpu_memory::Category::mesh, result.vao, path);
+
+  return result;
 }
 
 Mesh Mesh::make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
                 ArrayList<Vec3f> normals, ArrayList<Vec3f> tangents,
                 ArrayList<Vec3f> bitangents, ArrayList<u32> indices) {
+  return Mesh::make(vertices, uvs, normals, tangents, bitangents, indices, {},
+                    {});
+}
+
+Mesh Mesh::make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
+                ArrayList<Vec3f> normals, ArrayList<Vec3f> tangents,
+                ArrayList<Vec3f> bitangents, ArrayList<u32> indices,
+                ArrayList<Vec4u> bone_ids, ArrayList<Vec4f> bone_weights) {
   Mesh result;
   result.vertices = vertices;
   result.uvs = uvs;
@@ -410,6 +675,21 @@ Mesh Mesh::make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
   result.tangents = tangents;
   result.bitangents = bitangents;
   result.indices = indices;
+  result.bone_ids = bone_ids;
+  result.bone_weights = bone_weights;
+
+  if (!vertices.empty()) {
+    Vec3f min = vertices[0], max = vertices[0];
+    for (auto &v : vertices) {
+      min = glm::min(min, v);
+      max = glm::max(max, v);
+    }
+
+    result.center = (min + max) * 0.5f;
+    for (auto &v : vertices) {
+      result.radius = std::max(result.radius, glm::length(v - result.center));
+    }
+  }
 
   usize size = 0;
 
@@ -418,6 +698,8 @@ Mesh Mesh::make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
   size += sizeof(result.normals[0]) * result.normals.size();
   size += sizeof(result.tangents[0]) * result.tangents.size();
   size += sizeof(result.bitangents[0]) * result.bitangents.size();
+  size += sizeof(Vec4u) * result.bone_ids.size();
+  size += sizeof(Vec4f) * result.bone_weights.size();
 
   glGenVertexArrays(1, &result.vao);
   glBindVertexArray(result.vao);
@@ -467,22 +749,90 @@ Mesh Mesh::make(ArrayList<Vec3f> vertices, ArrayList<Vec2f> uvs,
                         (void *)i);
   i += sizeof(result.bitangents[0]) * result.bitangents.size();
 
+  if (result.skinned()) {
+    glBufferSubData(GL_ARRAY_BUFFER, i, sizeof(Vec4u) * result.bone_ids.size(),
+                    result.bone_ids.data());
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 4, GL_UNSIGNED_INT, sizeof(Vec4u), (void *)i);
+    i += sizeof(Vec4u) * result.bone_ids.size();
+
+    glBufferSubData(GL_ARRAY_BUFFER, i,
+                    sizeof(Vec4f) * result.bone_weights.size(),
+                    result.bone_weights.data());
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4f), (void *)i);
+    i += sizeof(Vec4f) * result.bone_weights.size();
+  }
+
   glGenBuffers(1, &result.ibo);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.ibo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                sizeof(result.indices[0]) * result.indices.size(),
                result.indices.data(), GL_STATIC_DRAW);
 
+  RENDER_STAT_UPLOAD(size);
+  RENDER_STAT_UPLOAD(sizeof(result.indices[0]) * result.indices.size());
+
+  result.track_memory();
+
   return result;
 }
 
 void Mesh::destroy() {
+  gpu_memory::release(gpu_memory::Category::mesh, vao);
   glDeleteVertexArrays(1, &vao);
   glDeleteBuffers(1, &vbo);
   glDeleteBuffers(1, &ibo);
+  if (uv2_vbo) {
+    glDeleteBuffers(1, &uv2_vbo);
+  }
+}
+
+void Mesh::set_uv2(ArrayList<Vec2f> uv2) {
+  if (uv2.size() != vertices.size()) {
+    engine::error("Mesh::set_uv2: {} coordinates for {} vertices", uv2.size(),
+                  vertices.size());
+    return;
+  }
+
+  uv2s = std::move(uv2);
+
+  if (!uv2_vbo) {
+    glGenBuffers(1, &uv2_vbo);
+  }
+
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, uv2_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(Vec2f) * uv2s.size(), uv2s.data(),
+               GL_STATIC_DRAW);
+  RENDER_STAT_UPLOAD(sizeof(Vec2f) * uv2s.size());
+  track_memory();
+  glEnableVertexAttribArray(7);
+  glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, sizeof(Vec2f), (void *)0);
+  glBindVertexArray(0);
+}
+
+void Mesh::track_memory() {
+  usize bytes = 0;
+  bytes += sizeof(Vec3f) * vertices.size();
+  bytes += sizeof(Vec2f) * uvs.size();
+  bytes += sizeof(Vec3f) * normals.size();
+  bytes += sizeof(Vec3f) * tangents.size();
+  bytes += sizeof(Vec3f) * bitangents.size();
+  bytes += sizeof(Vec4u) * bone_ids.size();
+  bytes += sizeof(Vec4f) * bone_weights.size();
+  bytes += sizeof(u32) * indices.size();
+  bytes += sizeof(Vec2f) * uv2s.size();
+
+  gpu_memory::track(gpu_memory::Category::mesh, vao, bytes,
+                    fmt::format("{} verts, {} tris", vertices.size(),
+                                indices.size() / 3),
+                    "");
 }
 
 void Mesh::draw() {
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, indices.size() / 3);
   glBindVertexArray(vao);
 
   glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
@@ -490,6 +840,18 @@ void Mesh::draw() {
   glBindVertexArray(0);
 }
 
+void Mesh::draw_instanced(u32 instances, u32 base_instance) {
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, indices.size() / 3 * instances);
+  glBindVertexArray(vao);
+
+  glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indices.size(),
+                                      GL_UNSIGNED_INT, 0, instances,
+                                      base_instance);
+
+  glBindVertexArray(0);
+}
+
 Sprite Sprite::make(string path) {
   Sprite result;
 
@@ -566,21 +928,47 @@ Mat4 Camera2D::GetPerspective() {
                     1000.0f);
 }
 
-Framebuffer Framebuffer::make(bool depth_test = false) {
+namespace {
+
+// colour plus the D24S8 depth renderbuffer every Framebuffer has
+void track_framebuffer(const Framebuffer &framebuffer) {
+  usize colour = framebuffer.hdr ? 6 : 3;
+  usize bytes = (usize)framebuffer.width * framebuffer.height * (colour + 4);
+  gpu_memory::track(gpu_memory::Category::framebuffer, framebuffer.fbo, bytes,
+                    framebuffer.hdr ? "RGB16F + D24S8" : "RGB8 + D24S8", "",
+                    framebuffer.width, framebuffer.height);
+}
+
+void framebuffer_storage(u32 texture, bool hdr, u32 w, u32 h) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  if (hdr) {
+    // no alpha: blended draws would leave it below 1 and the editor shows
+    // the game view with alpha blending
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, w, h, 0, GL_RGB, GL_FLOAT,
+                 NULL);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE,
+                 NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+} // namespace
+
+Framebuffer Framebuffer::make(bool depth_test, bool hdr) {
   Framebuffer result;
 
   result.depth_test = depth_test;
+  result.hdr = hdr;
+  result.width = game_width;
+  result.height = game_height;
 
   glGenFramebuffers(1, &result.fbo);
   glBindFramebuffer(GL_FRAMEBUFFER, result.fbo);
 
   glGenTextures(1, &result.albedo);
-  glBindTexture(GL_TEXTURE_2D, result.albedo);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, game_width, game_height, 0, GL_RGB,
-               GL_UNSIGNED_BYTE, NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
+  framebuffer_storage(result.albedo, hdr, game_width, game_height);
   glBindTexture(GL_TEXTURE_2D, 0);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                          result.albedo, 0);
@@ -599,14 +987,26 @@ Framebuffer Framebuffer::make(bool depth_test = false) {
 
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  track_framebuffer(result);
   return result;
 }
 
-void Framebuffer::destroy() { glDeleteFramebuffers(1, &fbo); }
+void Framebuffer::destroy() {
+  gpu_memory::release(gpu_memory::Category::framebuffer, fbo);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &albedo);
+  glDeleteRenderbuffers(1, &rbo);
+}
 
-void Framebuffer::bind() { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
+void Framebuffer::bind() {
+  RENDER_STAT(state_changes, 1);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
 
-void Framebuffer::unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+void Framebuffer::unbind() {
+  RENDER_STAT(state_changes, 1);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
 void Framebuffer::clear(f32 r, f32 b, f32 g) {
   glClearColor(r, g, b, 1.0f);
@@ -622,13 +1022,15 @@ void Framebuffer::clear(f32 r, f32 b, f32 g) {
 void Framebuffer::UpdateSize(f32 w, f32 h) {
   w = std::max(1.0f, w);
   h = std::max(1.0f, h);
+  if ((u32)w == width && (u32)h == height) {
+    return;
+  }
+
+  width = w;
+  height = h;
   bind();
 
-  glBindTexture(GL_TEXTURE_2D, albedo);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE,
-               NULL);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  framebuffer_storage(albedo, hdr, w, h);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
                          albedo, 0);
   glBindTexture(GL_TEXTURE_2D, 0);
@@ -640,6 +1042,8 @@ void Framebuffer::UpdateSize(f32 w, f32 h) {
   glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
   unbind();
+
+  track_framebuffer(*this);
 }
 
 namespace {
@@ -649,6 +1053,59 @@ LineInstancing lineinstancing;
 namespace engine {
 f32 DeltaTime() { return dt; }
 
+f32 RawDeltaTime() { return raw_dt; }
+
+void set_vsync(VSync mode) {
+  vsync = mode;
+  apply_vsync();
+}
+
+VSync get_vsync() { return vsync; }
+
+void set_target_fps(f32 fps) {
+  target_fps = std::max(0.0f, fps);
+  frame_deadline = Clock::now();
+}
+
+f32 get_target_fps() { return target_fps; }
+
+void set_max_delta_time(f32 value) { max_dt = std::max(0.0f, value); }
+
+void set_delta_time_smoothing(f32 smoothing) {
+  dt_smoothing = std::clamp(smoothing, 0.0f, 0.99f);
+}
+
+FrameStats get_frame_stats() {
+  FrameStats result;
+  result.samples = frame_history_count;
+
+  if (frame_history_count == 0) {
+    return result;
+  }
+
+  ArrayList<f32> sorted(frame_history.begin(),
+                        frame_history.begin() + frame_history_count);
+  std::sort(sorted.begin(), sorted.end());
+
+  auto percentile = [&](f32 p) {
+    usize i = (usize)(p * (sorted.size() - 1) + 0.5f);
+    return sorted[i];
+  };
+
+  f32 total = 0;
+  for (f32 ms : sorted) {
+    total += ms;
+  }
+
+  result.average = total / sorted.size();
+  result.p50 = percentile(0.50f);
+  result.p95 = percentile(0.95f);
+  result.p99 = percentile(0.99f);
+  result.max = sorted.back();
+
+  return result;
+}
+
 Vec3f safe_normalize(Vec3f val) {
   f32 length = glm::length(val);
   return length > 0 ? val / length : Vec3f(0);
@@ -772,13 +1229,65 @@ string get_GLSLVersion() { return glslVersion; }
 
 Vec2f get_game_size() { return Vec2f(game_width, game_height); }
 
+Vec2f get_render_size() {
+  return glm::max(glm::floor(get_game_size() * resolution::get_scale()),
+                  Vec2f(1));
+}
+
 void set_framebuffer(Framebuffer &frame) {}
 
+void set_post_process(PostProcess *post) { post_process = post; }
+
+PostProcess *get_post_process() { return post_process; }
+
 void set_clear_color(f32 x, f32 y, f32 z) { clearcolor = Vec3f(x, y, z); }
 
+bool is_headless() { return headless; }
+
+bool is_shipping() { return shipping; }
+
+void enable_imgui() {
+  if (imgui_ready) {
+    return;
+  }
+
+  init_imgui();
+
+  // asked for from inside update() or draw(), join the frame in progress
+  if (in_game_frame) {
+    imgui_new_frame();
+  }
+}
+
+bool imgui_enabled() { return imgui_ready; }
+
+bool imgui_available() {
+  if (!imgui_ready && in_game_frame) {
+    enable_imgui();
+  }
+  return imgui_in_frame;
+}
+
 } // namespace engine
 
 int main(int argc, char **argv) {
+  parse_options(argc, argv);
+
+  if (!bake_script.empty()) {
+    const char *base = SDL_GetBasePath();
+    exe_path = string(base ? base : "");
+
+    jobs::init();
+    scripting::setup();
+    i32 e = scripting::load(bake_script);
+    jobs::shutdown();
+    return e < 0 ? 1 : 0;
+  }
+
+  if (headless) {
+    SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+  }
+
   if (!SDL_Init(SDL_INIT_VIDEO)) {
     std::cout << "SDL_Error: " << SDL_GetError() << "\n";
     return 1;
@@ -788,8 +1297,10 @@ int main(int argc, char **argv) {
   exe_path = string(exe_path_ptr);
   delete exe_path_ptr;
 
-  window = SDL_CreateWindow(title.c_str(), sdl_width, sdl_height,
-                            SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL);
+  SDL_WindowFlags window_flags = SDL_WINDOW_OPENGL;
+  window_flags |= headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE;
+
+  window = SDL_CreateWindow(title.c_str(), sdl_width, sdl_height, window_flags);
 
   if (!window) {
     std::cout << "SDL_Error: " << SDL_GetError() << "\n";
@@ -800,7 +1311,14 @@ int main(int argc, char **argv) {
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 6);
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
-  auto context = SDL_GL_CreateContext(window);
+  context = SDL_GL_CreateContext(window);
+  if (!context) {
+    // software rasterisers such as llvmpipe commonly stop at 4.5
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 5);
+    glslVersion = "#version 450\n";
+    context = SDL_GL_CreateContext(window);
+  }
+
   if (!context) {
     std::cout << "SDL_Error: " << "Failed to initialize OpenGL context"
               << std::endl;
@@ -813,6 +1331,8 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  apply_vsync();
+
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
 
@@ -825,36 +1345,53 @@ int main(int argc, char **argv) {
   prevkeyboard = new bool[keyboardsize];
   memset(prevkeyboard, 0, keyboardsize);
 
-  IMGUI_CHECKVERSION();
-  ImGui::CreateContext();
-  ImGuiIO &io = ImGui::GetIO();
-  (void)io;
-  io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
-  io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
-  io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
-
-  ImGui_ImplSDL3_InitForOpenGL(engine::get_window(), engine::get_gpu_context());
-  string ver = engine::get_GLSLVersion();
-  ImGui_ImplOpenGL3_Init(ver.c_str());
+  if (!shipping) {
+    init_imgui();
+  }
 
   dt = 0;
-  std::chrono::high_resolution_clock clock;
-  auto current = clock.now(), previous = clock.now();
+  auto current = Clock::now(), previous = Clock::now();
+  frame_deadline = current;
 
-  auto framebuffer = Framebuffer::make(true);
+  // floating point so post-processing has HDR colour to work with
+  auto framebuffer = Framebuffer::make(true, true);
 
+  // dynamic resolution upscales the game framebuffer into this one
+  auto output = Framebuffer::make(false);
+  resolution::init();
+
+  // the window's own framebuffer, for shipping runs
+  Framebuffer backbuffer{};
+  backbuffer.depth_test = true;
+
+  jobs::init();
+  profiler::init();
+  capture::init();
   scripting::setup();
 
   if (i32 e = init(); e < 0) {
     return e;
   }
 
+  ArrayList<f32> headless_times;
+  if (headless) {
+    engine::info("Headless: rendering {} frames at {}x{}", headless_frames,
+                 sdl_width, sdl_height);
+    headless_times.reserve(headless_frames);
+    game_width = sdl_width;
+    game_height = sdl_height;
+    framebuffer.UpdateSize(game_width, game_height);
+    output.UpdateSize(game_width, game_height);
+  }
+
   while (running) {
     mousedelta = Vec2f(0);
 
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
-      ImGui_ImplSDL3_ProcessEvent(&event);
+      if (imgui_ready) {
+        ImGui_ImplSDL3_ProcessEvent(&event);
+      }
 
       switch (event.type) {
       case SDL_EVENT_QUIT:
@@ -892,49 +1429,138 @@ int main(int argc, char **argv) {
     }
 
     previous = current;
-    current = clock.now();
+    current = Clock::now();
 
-    dt = std::chrono::duration<float>(current - previous).count();
+    if (headless) {
+      // fixed timestep so every run simulates the same frames
+      dt = raw_dt = headless_dt;
+    } else {
+      record_frame(std::chrono::duration<f32>(current - previous).count());
+    }
 
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplSDL3_NewFrame();
-    ImGui::NewFrame();
-    ImGui::DockSpaceOverViewport();
+    resolution::update(raw_dt * 1000.0f);
+    Vec2f render_size = engine::get_render_size();
 
-    ImGui::Begin("Game View");
+    if (imgui_ready) {
+      imgui_new_frame();
+    }
 
-    mouse_block = !ImGui::IsWindowFocused();
-    keyboard_block = !ImGui::IsWindowFocused();
+    Framebuffer *target = &framebuffer;
+
+    if (headless) {
+      mouse_block = true;
+      keyboard_block = true;
+    } else if (shipping) {
+      game_width = sdl_width;
+      game_height = sdl_height;
+      backbuffer.width = sdl_width;
+      backbuffer.height = sdl_height;
+      render_size = engine::get_render_size();
+
+      // upscaling and post-processing need the scene in a texture first
+      if (resolution::is_active() || post_process) {
+        framebuffer.UpdateSize(game_width, game_height);
+      } else {
+        target = &backbuffer;
+      }
 
-    game_width = ImGui::GetContentRegionAvail().x;
-    game_height = ImGui::GetContentRegionAvail().y;
+      // there is no game view to focus, only keep out of ImGui's way
+      mouse_block = imgui_ready && ImGui::GetIO().WantCaptureMouse;
+      keyboard_block = imgui_ready && ImGui::GetIO().WantCaptureKeyboard;
+    } else {
+      ImGui::DockSpaceOverViewport();
 
-    framebuffer.UpdateSize(game_width, game_height);
-    glViewport(0, 0, game_width, game_height);
+      ImGui::Begin("Game View");
+
+      mouse_block = !ImGui::IsWindowFocused();
+      keyboard_block = !ImGui::IsWindowFocused();
+
+      game_width = ImGui::GetContentRegionAvail().x;
+      game_height = ImGui::GetContentRegionAvail().y;
+
+      framebuffer.UpdateSize(game_width, game_height);
+      output.UpdateSize(game_width, game_height);
+
+      // the size may have changed since update() picked the scale
+      render_size = engine::get_render_size();
+
+      ImVec2 pos = ImGui::GetCursorScreenPos();
+      u32 shown = resolution::is_active() ? output.albedo : framebuffer.albedo;
 
-    ImVec2 pos = ImGui::GetCursorScreenPos();
+      ImGui::GetWindowDrawList()->AddImage(
+          (void *)(isize)shown, ImVec2(pos.x, pos.y),
+          ImVec2(pos.x + game_width, pos.y + game_height), ImVec2(0, 1),
+          ImVec2(1, 0));
 
-    ImGui::GetWindowDrawList()->AddImage(
-        (void *)(isize)framebuffer.albedo, ImVec2(pos.x, pos.y),
-        ImVec2(pos.x + game_width, pos.y + game_height), ImVec2(0, 1),
-        ImVec2(1, 0));
+      ImGui::End();
+    }
 
-    ImGui::End();
+    profiler::begin_frame();
 
-    framebuffer.bind();
-    framebuffer.clear(clearcolor.x, clearcolor.y, clearcolor.z);
+    profiler::begin("Game View");
+    target->bind();
+    glViewport(0, 0, render_size.x, render_size.y);
+    target->clear(clearcolor.x, clearcolor.y, clearcolor.z);
+    in_game_frame = true;
     update();
     draw();
+    in_game_frame = false;
+    profiler::end();
+
+    if (post_process) {
+      bool direct = shipping && !headless && !resolution::is_active();
+      post_process->apply(framebuffer, direct ? backbuffer : framebuffer);
+    }
 
-    ImGui::Render();
+    if (imgui_ready) {
+      ImGui::Render();
+      imgui_in_frame = false;
+    }
 
     framebuffer.unbind();
 
-    glClearColor(clearcolor.x, clearcolor.y, clearcolor.z, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (shipping && !headless) {
+      if (resolution::is_active()) {
+        resolution::upscale(framebuffer, backbuffer);
+      }
+      capture::frame(backbuffer);
+    } else if (resolution::is_active()) {
+      resolution::upscale(framebuffer, output);
+      capture::frame(output);
+    } else {
+      capture::frame(framebuffer);
+    }
 
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    SDL_GL_SwapWindow(window);
+    if (headless) {
+      profiler::end_frame();
+      glFlush();
+
+      f32 cpu = std::chrono::duration<f32>(Clock::now() - current).count();
+      headless_times.push_back(cpu * 1000.0f);
+      push_frame_time(cpu);
+
+      if (headless_times.size() >= headless_frames) {
+        running = false;
+      }
+    } else {
+      if (!shipping) {
+        glClearColor(clearcolor.x, clearcolor.y, clearcolor.z, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      }
+
+      // shipping runs draw debug ImGui windows over the game
+      if (imgui_ready) {
+        profiler::begin("ImGui");
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler::end();
+      }
+
+      profiler::end_frame();
+      SDL_GL_SwapWindow(window);
+      limit_frame_rate();
+    }
+
+    render_stats::end_frame();
 
     prevkeyboard = (bool *)memcpy(prevkeyboard, keyboard,
                                   keyboardsize * sizeof(*keyboard));
@@ -942,11 +1568,37 @@ int main(int argc, char **argv) {
 
   shutdown(); // shutdown game
 
+  if (headless && !headless_times.empty()) {
+    std::sort(headless_times.begin(), headless_times.end());
+
+    f32 total = 0;
+    for (f32 ms : headless_times) {
+      total += ms;
+    }
+
+    auto percentile = [&](f32 p) {
+      return headless_times[(usize)(p * (headless_times.size() - 1) + 0.5f)];
+    };
+
+    engine::info("Headless: {} frames, cpu ms avg {:.3f} p50 {:.3f} p95 {:.3f} "
+                 "p99 {:.3f} max {:.3f}",
+                 headless_times.size(), total / headless_times.size(),
+                 percentile(0.50f), percentile(0.95f), percentile(0.99f),
+                 headless_times.back());
+  }
+
+  jobs::shutdown();
+  capture::shutdown();
+  profiler::shutdown();
+  resolution::shutdown();
   framebuffer.destroy();
+  output.destroy();
 
-  ImGui_ImplOpenGL3_Shutdown();
-  ImGui_ImplSDL3_Shutdown();
-  ImGui::DestroyContext();
+  if (imgui_ready) {
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplSDL3_Shutdown();
+    ImGui::DestroyContext();
+  }
 
   delete[] prevkeyboard;
 
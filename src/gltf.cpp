@@ -0,0 +1,322 @@
+#include <rama/gltf.hpp>
+
+#include <rama/drawlist.hpp>
+#include <rama/material.hpp>
+#include <rama/render_stats.hpp>
+
+#include <chrono>
+#include <filesystem>
+
+#include <nlohmann/json.hpp>
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+// stb is implemented in engine.cpp and capture.cpp, json comes from the
+// nlohmann package
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_INCLUDE_JSON
+#define TINYGLTF_NO_INCLUDE_STB_IMAGE
+#define TINYGLTF_NO_INCLUDE_STB_IMAGE_WRITE
+#include <tiny_gltf.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+f64 elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<f64, std::milli>(Clock::now() - start).count();
+}
+
+i32 attribute_location(const string &name) {
+  static const UnorderedMap<string, i32> locations = {
+      {"POSITION", 0}, {"TEXCOORD_0", 1}, {"NORMAL", 2},
+      {"TANGENT", 3},  {"JOINTS_0", 5},   {"WEIGHTS_0", 6},
+  };
+
+  auto it = locations.find(name);
+  return it != locations.end() ? it->second : -1;
+}
+
+Mat4 node_transform(const tinygltf::Node &node) {
+  if (node.matrix.size() == 16) {
+    Mat4 result;
+    for (u32 i = 0; i < 16; i++) {
+      result[i / 4][i % 4] = (f32)node.matrix[i];
+    }
+    return result;
+  }
+
+  Mat4 result(1);
+  if (node.translation.size() == 3) {
+    result = glm::translate(result, Vec3f(node.translation[0],
+                                          node.translation[1],
+                                          node.translation[2]));
+  }
+  if (node.rotation.size() == 4) {
+    result *= glm::mat4_cast(Quat((f32)node.rotation[3], (f32)node.rotation[0],
+                                  (f32)node.rotation[1],
+                                  (f32)node.rotation[2]));
+  }
+  if (node.scale.size() == 3) {
+    result = glm::scale(result,
+                        Vec3f(node.scale[0], node.scale[1], node.scale[2]));
+  }
+  return result;
+}
+
+} // namespace
+
+GltfModel GltfModel::load(string path, MaterialTable *materials) {
+  path = engine::get_path(path);
+  auto start = Clock::now();
+
+  tinygltf::TinyGLTF loader;
+  tinygltf::Model gltf;
+  string err, warn;
+
+  bool binary = std::filesystem::path(path).extension() == ".glb";
+  bool ok = binary ? loader.LoadBinaryFromFile(&gltf, &err, &warn, path)
+                   : loader.LoadASCIIFromFile(&gltf, &err, &warn, path);
+
+  if (!warn.empty()) {
+    engine::warning("glTF: {}", warn);
+  }
+
+  GltfModel result;
+
+  if (!ok) {
+    engine::error("glTF error: {}", err);
+    return result;
+  }
+
+  // buffer views go to the GPU as they are
+  result.buffers.resize(gltf.bufferViews.size(), 0);
+  glGenBuffers(result.buffers.size(), result.buffers.data());
+
+  for (u32 i = 0; i < gltf.bufferViews.size(); i++) {
+    const auto &view = gltf.bufferViews[i];
+    const auto &buffer = gltf.buffers[view.buffer];
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, result.buffers[i]);
+    glBufferData(GL_COPY_WRITE_BUFFER, view.byteLength,
+                 buffer.data.data() + view.byteOffset, GL_STATIC_DRAW);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  ArrayList<u32> material_of(gltf.materials.size(), 0);
+  if (materials) {
+    auto texture = [&](i32 index) -> i32 {
+      if (index < 0 || gltf.textures[index].source < 0) {
+        return -1;
+      }
+
+      i32 source = gltf.textures[index].source;
+      const auto &image = gltf.images[source];
+      if (image.component != 4 || image.bits != 8) {
+        engine::warning("glTF: image {} isn't RGBA8, skipped", source);
+        return -1;
+      }
+
+      return materials->texture(fmt::format("{}#image{}", path, source),
+                                image.image.data(), image.width,
+                                image.height);
+    };
+
+    for (u32 i = 0; i < gltf.materials.size(); i++) {
+      const auto &material = gltf.materials[i];
+      const auto &pbr = material.pbrMetallicRoughness;
+
+      MaterialParams params;
+      params.albedo = Vec4f(pbr.baseColorFactor[0], pbr.baseColorFactor[1],
+                            pbr.baseColorFactor[2], pbr.baseColorFactor[3]);
+      params.emissive =
+          Vec4f(material.emissiveFactor[0], material.emissiveFactor[1],
+                material.emissiveFactor[2], 1.0f);
+      params.roughness = pbr.roughnessFactor;
+      params.metallic = pbr.metallicFactor;
+      params.albedo_layer = texture(pbr.baseColorTexture.index);
+      params.normal_layer = texture(material.normalTexture.index);
+
+      material_of[i] = materials->add(params);
+    }
+  }
+
+  ArrayList<u32> first_primitive(gltf.meshes.size());
+
+  for (u32 m = 0; m < gltf.meshes.size(); m++) {
+    first_primitive[m] = result.primitives.size();
+
+    for (const auto &source : gltf.meshes[m].primitives) {
+      Primitive primitive{};
+      primitive.mode = source.mode >= 0 ? source.mode : GL_TRIANGLES;
+      primitive.material =
+          source.material >= 0 ? material_of[source.material] : 0;
+
+      glGenVertexArrays(1, &primitive.vao);
+      glBindVertexArray(primitive.vao);
+
+      for (const auto &[name, index] : source.attributes) {
+        i32 location = attribute_location(name);
+        const auto &accessor = gltf.accessors[index];
+        if (location < 0 || accessor.bufferView < 0) {
+          continue;
+        }
+
+        const auto &view = gltf.bufferViews[accessor.bufferView];
+        i32 stride = accessor.ByteStride(view);
+        i32 components = tinygltf::GetNumComponentsInType(accessor.type);
+
+        // glTF component types are the GL enums
+        glBindBuffer(GL_ARRAY_BUFFER, result.buffers[accessor.bufferView]);
+        if (location == 5) {
+          glVertexAttribIPointer(location, components, accessor.componentType,
+                                 stride, (void *)accessor.byteOffset);
+        } else {
+          glVertexAttribPointer(location, components, accessor.componentType,
+                                accessor.normalized ? GL_TRUE : GL_FALSE,
+                                stride, (void *)accessor.byteOffset);
+        }
+        glEnableVertexAttribArray(location);
+
+        if (location == 0) {
+          primitive.count = accessor.count;
+
+          // POSITION always carries its bounds
+          if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+            Vec3f min(accessor.minValues[0], accessor.minValues[1],
+                      accessor.minValues[2]);
+            Vec3f max(accessor.maxValues[0], accessor.maxValues[1],
+                      accessor.maxValues[2]);
+            primitive.center = (min + max) * 0.5f;
+            primitive.radius = glm::length(max - min) * 0.5f;
+          }
+        }
+      }
+
+      if (source.indices >= 0) {
+        const auto &accessor = gltf.accessors[source.indices];
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
+                     result.buffers[accessor.bufferView]);
+        primitive.count = accessor.count;
+        primitive.index_type = accessor.componentType;
+        primitive.index_offset = accessor.byteOffset;
+      }
+
+      glBindVertexArray(0);
+      result.primitives.push_back(primitive);
+    }
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  std::function<void(i32 node, Mat4 parent)> visit;
+  visit = [&](i32 index, Mat4 parent) -> void {
+    const auto &node = gltf.nodes[index];
+    Mat4 transform = parent * node_transform(node);
+
+    if (node.mesh >= 0) {
+      u32 first = first_primitive[node.mesh];
+      u32 count = gltf.meshes[node.mesh].primitives.size();
+      for (u32 p = first; p < first + count; p++) {
+        result.instances.push_back(Instance{p, transform});
+      }
+    }
+
+    for (i32 child : node.children) {
+      visit(child, transform);
+    }
+  };
+
+  if (!gltf.scenes.empty()) {
+    i32 scene = gltf.defaultScene >= 0 ? gltf.defaultScene : 0;
+    for (i32 node : gltf.scenes[scene].nodes) {
+      visit(node, Mat4(1));
+    }
+  }
+
+  result.load_ms = elapsed_ms(start);
+  engine::info("glTF: loaded \"{}\" ({} primitives, {} buffers) in {:.2f} ms",
+               path, result.primitives.size(), result.buffers.size(),
+               result.load_ms);
+
+  return result;
+}
+
+void GltfModel::destroy() {
+  for (auto &primitive : primitives) {
+    glDeleteVertexArrays(1, &primitive.vao);
+  }
+  glDeleteBuffers(buffers.size(), buffers.data());
+
+  buffers.clear();
+  primitives.clear();
+  instances.clear();
+}
+
+void GltfModel::draw_instance(Shader &shader, const Instance &instance,
+                              Mat4 model) {
+  const Primitive &primitive = primitives[instance.primitive];
+
+  shader.uniform("model", model);
+  glBindVertexArray(primitive.vao);
+
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, primitive.count / 3);
+  if (primitive.index_type != 0) {
+    glDrawElementsInstancedBaseInstance(
+        primitive.mode, primitive.count, primitive.index_type,
+        (void *)primitive.index_offset, 1, primitive.material);
+  } else {
+    glDrawArraysInstancedBaseInstance(primitive.mode, 0, primitive.count, 1,
+                                      primitive.material);
+  }
+}
+
+void GltfModel::draw(Shader &shader, Mat4 model) {
+  for (const auto &instance : instances) {
+    draw_instance(shader, instance, model * instance.transform);
+  }
+
+  glBindVertexArray(0);
+}
+
+void GltfModel::draw(Shader &shader, Mat4 model, Mat4 perspective,
+                     Mat4 view) {
+  Frustum frustum = Frustum::make(perspective * view);
+
+  for (const auto &instance : instances) {
+    const Primitive &primitive = primitives[instance.primitive];
+    Mat4 transform = model * instance.transform;
+
+    if (primitive.radius >= 0.0f) {
+      Vec3f center = Vec3f(transform * Vec4f(primitive.center, 1));
+      f32 scale = std::max(glm::length(Vec3f(transform[0])),
+                           std::max(glm::length(Vec3f(transform[1])),
+                                    glm::length(Vec3f(transform[2]))));
+      if (!frustum.intersects_sphere(center, primitive.radius * scale)) {
+        continue;
+      }
+    }
+
+    draw_instance(shader, instance, transform);
+  }
+
+  glBindVertexArray(0);
+}
+
+void GltfModel::benchmark(string path) {
+  GltfModel model = GltfModel::load(path);
+  f64 gltf_ms = model.load_ms;
+  model.destroy();
+
+  auto start = Clock::now();
+  Mesh mesh = Mesh::load(path);
+  f64 assimp_ms = elapsed_ms(start);
+  mesh.destroy();
+
+  engine::info("glTF: \"{}\" TinyGLTF {:.2f} ms, Assimp {:.2f} ms ({:.1f}x)",
+               path, gltf_ms, assimp_ms,
+               gltf_ms > 0 ? assimp_ms / gltf_ms : 0.0);
+}
@@ -0,0 +1,282 @@
+#include <rama/gpu_memory.hpp>
+
+#include <rama/engine.hpp>
+
+#include <algorithm>
+
+namespace {
+
+using gpu_memory::Category;
+using gpu_memory::Resource;
+
+constexpr u32 category_count = (u32)Category::count;
+
+UnorderedMap<u64, Resource> resources;
+Array<usize, category_count> totals = {};
+Array<usize, category_count> peaks = {};
+Array<u32, category_count> counts = {};
+usize peak_total = 0;
+
+u64 key(Category category, u32 name) {
+  return ((u64)category << 32) | name;
+}
+
+void update_peaks(Category category) {
+  u32 c = (u32)category;
+  peaks[c] = std::max(peaks[c], totals[c]);
+  peak_total = std::max(peak_total, gpu_memory::total());
+}
+
+string format_bytes(usize bytes) {
+  if (bytes >= 1024 * 1024) {
+    return fmt::format("{:.2f} MiB", bytes / (1024.0 * 1024.0));
+  }
+  if (bytes >= 1024) {
+    return fmt::format("{:.1f} KiB", bytes / 1024.0);
+  }
+  return fmt::format("{} B", bytes);
+}
+
+sol::table lib(sol::this_state state) {
+  sol::state_view luaview(state);
+  auto module = luaview.create_table();
+
+  module.set_function("DrawPanel", &gpu_memory::draw_panel);
+
+  module.set_function("GetTotals", [](sol::this_state state) {
+    sol::state_view luaview(state);
+    auto table = luaview.create_table();
+
+    for (u32 c = 0; c < category_count; c++) {
+      auto entry = luaview.create_table();
+      entry["bytes"] = totals[c];
+      entry["high_water"] = peaks[c];
+      entry["count"] = counts[c];
+      table[gpu_memory::category_name((Category)c)] = entry;
+    }
+
+    table["bytes"] = gpu_memory::total();
+    table["high_water"] = peak_total;
+
+    return table;
+  });
+
+  module.set_function("GetLargest", [](u32 limit, sol::this_state state) {
+    sol::state_view luaview(state);
+    auto table = luaview.create_table();
+
+    for (auto &resource : gpu_memory::largest(limit)) {
+      auto entry = luaview.create_table();
+      entry["category"] = gpu_memory::category_name(resource.category);
+      entry["bytes"] = resource.bytes;
+      entry["format"] = resource.format;
+      entry["path"] = resource.path;
+      entry["width"] = resource.width;
+      entry["height"] = resource.height;
+      table.add(entry);
+    }
+
+    return table;
+  });
+
+  return module;
+}
+
+} // namespace
+
+namespace gpu_memory {
+
+void track(Category category, u32 name, usize bytes, string format,
+           string path, u32 width, u32 height) {
+  u32 c = (u32)category;
+  auto it = resources.find(key(category, name));
+
+  if (it == resources.end()) {
+    Resource resource;
+    resource.category = category;
+    resource.name = name;
+    it = resources.emplace(key(category, name), resource).first;
+    counts[c]++;
+  } else {
+    totals[c] -= it->second.bytes;
+    // keep the owner a resize does not know about
+    if (path.empty()) {
+      path = it->second.path;
+    }
+  }
+
+  Resource &resource = it->second;
+  resource.bytes = bytes;
+  resource.format = std::move(format);
+  resource.path = std::move(path);
+  resource.width = width;
+  resource.height = height;
+
+  totals[c] += bytes;
+  update_peaks(category);
+}
+
+void set_path(Category category, u32 name, string path) {
+  auto it = resources.find(key(category, name));
+  if (it != resources.end()) {
+    it->second.path = std::move(path);
+  }
+}
+
+void release(Category category, u32 name) {
+  auto it = resources.find(key(category, name));
+  if (it == resources.end()) {
+    return;
+  }
+
+  u32 c = (u32)category;
+  totals[c] -= it->second.bytes;
+  counts[c]--;
+  resources.erase(it);
+}
+
+usize total(Category category) { return totals[(u32)category]; }
+
+usize total() {
+  usize result = 0;
+  for (usize t : totals) {
+    result += t;
+  }
+  return result;
+}
+
+usize high_water(Category category) { return peaks[(u32)category]; }
+
+usize high_water() { return peak_total; }
+
+u32 count(Category category) { return counts[(u32)category]; }
+
+const char *category_name(Category category) {
+  switch (category) {
+  case Category::texture:
+    return "texture";
+  case Category::mesh:
+    return "mesh";
+  case Category::framebuffer:
+    return "framebuffer";
+  default:
+    return "unknown";
+  }
+}
+
+ArrayList<Resource> largest(u32 limit) {
+  ArrayList<Resource> result;
+  result.reserve(resources.size());
+  for (auto &[_, resource] : resources) {
+    result.push_back(resource);
+  }
+
+  std::sort(result.begin(), result.end(),
+            [](const Resource &a, const Resource &b) {
+              return a.bytes > b.bytes;
+            });
+
+  if (limit > 0 && result.size() > limit) {
+    result.resize(limit);
+  }
+  return result;
+}
+
+void draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ImGui::Begin("GPU Memory");
+
+  ImGui::Text("Total: %s (peak %s)", format_bytes(total()).c_str(),
+              format_bytes(peak_total).c_str());
+  for (u32 c = 0; c < category_count; c++) {
+    ImGui::BulletText("%s: %u, %s (peak %s)", category_name((Category)c),
+                      counts[c], format_bytes(totals[c]).c_str(),
+                      format_bytes(peaks[c]).c_str());
+  }
+  ImGui::Separator();
+
+  static i32 shown = 50;
+  ImGui::SliderInt("Shown", &shown, 10, 500);
+
+  ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Sortable |
+                          ImGuiTableFlags_Resizable |
+                          ImGuiTableFlags_ScrollY;
+  if (ImGui::BeginTable("resources", 5, flags, ImVec2(0, 300))) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Owner");
+    ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableSetupColumn("Format", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableSetupColumn("Bytes",
+                            ImGuiTableColumnFlags_WidthFixed |
+                                ImGuiTableColumnFlags_DefaultSort |
+                                ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableHeadersRow();
+
+    // the largest `shown` resources, then ordered by the clicked column
+    ArrayList<Resource> rows = largest(shown);
+
+    ImGuiTableSortSpecs *specs = ImGui::TableGetSortSpecs();
+    if (specs && specs->SpecsCount > 0) {
+      const ImGuiTableColumnSortSpecs &spec = specs->Specs[0];
+      bool ascending = spec.SortDirection == ImGuiSortDirection_Ascending;
+
+      std::stable_sort(rows.begin(), rows.end(), [&](const Resource &a,
+                                                     const Resource &b) {
+        const Resource &x = ascending ? a : b;
+        const Resource &y = ascending ? b : a;
+        switch (spec.ColumnIndex) {
+        case 0:
+          return x.path < y.path;
+        case 1:
+          return x.category < y.category;
+        case 2:
+          return x.format < y.format;
+        case 3:
+          return (u64)x.width * x.height < (u64)y.width * y.height;
+        default:
+          return x.bytes < y.bytes;
+        }
+      });
+    }
+
+    for (auto &resource : rows) {
+      ImGui::TableNextRow();
+
+      ImGui::TableNextColumn();
+      if (resource.path.empty()) {
+        ImGui::Text("(%s %u)", category_name(resource.category),
+                    resource.name);
+      } else {
+        ImGui::TextUnformatted(resource.path.c_str());
+      }
+
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(category_name(resource.category));
+
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(resource.format.c_str());
+
+      ImGui::TableNextColumn();
+      if (resource.width > 0) {
+        ImGui::Text("%ux%u", resource.width, resource.height);
+      }
+
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(format_bytes(resource.bytes).c_str());
+    }
+
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+}
+
+void RegisterLuaModule(sol::state &state) {
+  state.require("gpu_memory", sol::c_call<decltype(&lib), &lib>, false);
+}
+
+} // namespace gpu_memory
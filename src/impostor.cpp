@@ -0,0 +1,397 @@
+#include <rama/impostor.hpp>
+
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+namespace {
+
+// octahedral mapping with y up, mirrored by the GLSL in ImpostorSet
+Vec3f octahedral_decode(Vec2f uv) {
+  Vec2f p = uv * 2.0f - 1.0f;
+  Vec3f n(p.x, 1.0f - std::abs(p.x) - std::abs(p.y), p.y);
+
+  f32 t = std::max(-n.y, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.z += n.z >= 0.0f ? -t : t;
+
+  return glm::normalize(n);
+}
+
+// the up vector both the bake and the billboard use for a view direction
+Vec3f view_up(Vec3f dir) {
+  return std::abs(dir.y) > 0.99f ? Vec3f(0, 0, 1) : Vec3f(0, 1, 0);
+}
+
+// frames share edges with no gutter, so mips stop while a frame is still
+// 4 texels wide; below that a texel would average neighbouring frames
+u32 make_atlas(u32 size, u32 frame_size) {
+  i32 max_level = std::max(0, (i32)std::log2((f32)frame_size) - 2);
+
+  u32 texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max_level);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+} // namespace
+
+Impostor Impostor::bake(Mesh &mesh, Vec4f colour, u32 frames, u32 frame_size) {
+  return bake(mesh, nullptr, colour, frames, frame_size);
+}
+
+Impostor Impostor::bake(Mesh &mesh, Texture &texture, u32 frames,
+                        u32 frame_size) {
+  return bake(mesh, &texture, Vec4f(1), frames, frame_size);
+}
+
+Impostor Impostor::bake(Mesh &mesh, Texture *texture, Vec4f colour,
+                        u32 frames, u32 frame_size) {
+  string vtx_shader = R"(
+        layout(location = 0) in vec3 position;
+        layout(location = 1) in vec2 tex_coord;
+        layout(location = 2) in vec3 vertex_normal;
+
+        uniform mat4 perspective;
+        uniform mat4 view;
+
+        out vec2 uv;
+        out vec3 normal;
+
+        void main() {
+            uv = tex_coord;
+            normal = vertex_normal;
+            gl_Position = perspective * view * vec4(position, 1.0);
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec2 uv;
+        in vec3 normal;
+
+        uniform sampler2D diffuse;
+        uniform float use_texture;
+        uniform vec3 colour_rgb;
+        uniform float colour_a;
+
+        layout(location = 0) out vec4 albedo_out;
+        layout(location = 1) out vec4 normal_out;
+
+        void main() {
+            vec4 colour = vec4(colour_rgb, colour_a);
+            if (use_texture > 0.5) {
+                colour *= texture(diffuse, uv);
+            }
+            if (colour.a < 0.5) {
+                discard;
+            }
+
+            albedo_out = vec4(colour.rgb, 1.0);
+            normal_out = vec4(normalize(normal) * 0.5 + 0.5, 1.0);
+        }
+    )";
+
+  Impostor result;
+  result.frames = frames;
+  result.center = mesh.center;
+  result.radius = std::max(mesh.radius, 1e-4f);
+
+  u32 size = frames * frame_size;
+  result.albedo = make_atlas(size, frame_size);
+  result.normal = make_atlas(size, frame_size);
+
+  Shader shader = Shader::make_with_version(vtx_shader, frg_shader);
+
+  // the bake runs mid-frame, so put back whatever was bound
+  i32 previous_fbo, viewport[4];
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  u32 fbo, depth;
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         result.albedo, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         result.normal, 0);
+
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+
+  u32 buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, buffers);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    engine::error("Impostor: bake framebuffer is incomplete");
+  }
+
+  glClearColor(0, 0, 0, 0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
+
+  shader.bind();
+  shader.uniform("colour_rgb", Vec3f(colour));
+  shader.uniform("colour_a", colour.a);
+  shader.uniform("use_texture", texture ? 1.0f : 0.0f);
+  if (texture) {
+    texture->bind(0);
+    shader.sampler("diffuse", 0);
+  }
+
+  f32 r = result.radius;
+  shader.uniform("perspective", glm::ortho(-r, r, -r, r, 0.0f, 4.0f * r));
+
+  for (u32 y = 0; y < frames; y++) {
+    for (u32 x = 0; x < frames; x++) {
+      Vec3f dir = octahedral_decode((Vec2f(x, y) + 0.5f) / (f32)frames);
+      Vec3f eye = result.center + dir * 2.0f * r;
+
+      glViewport(x * frame_size, y * frame_size, frame_size, frame_size);
+      shader.uniform("view", glm::lookAt(eye, result.center, view_up(dir)));
+      mesh.draw();
+    }
+  }
+
+  glDeleteRenderbuffers(1, &depth);
+  glDeleteFramebuffers(1, &fbo);
+  shader.destroy();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  for (u32 texture_id : {result.albedo, result.normal}) {
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return result;
+}
+
+void Impostor::destroy() {
+  glDeleteTextures(1, &albedo);
+  glDeleteTextures(1, &normal);
+}
+
+ImpostorSet ImpostorSet::make(Mesh &mesh, Impostor &impostor) {
+  string vtx_shader = R"(
+        layout(location = 0) in vec4 instance_pos_scale;
+        layout(location = 1) in vec4 instance_rotation;
+
+        uniform mat4 perspective;
+        uniform mat4 view;
+        uniform vec3 camera_pos;
+
+        uniform vec3 impostor_center;
+        uniform float impostor_radius;
+        uniform float frames;
+
+        out vec2 frame_uv;
+        out vec2 frame_base;
+        out vec2 frame_weights;
+        out vec4 rotation;
+
+        vec3 rotate(vec4 q, vec3 v) {
+            return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+        }
+
+        vec2 octahedral_encode(vec3 n) {
+            n /= abs(n.x) + abs(n.y) + abs(n.z);
+            vec2 p = n.xz;
+            if (n.y < 0.0) {
+                vec2 s = vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+                p = (1.0 - abs(p.yx)) * s;
+            }
+            return p * 0.5 + 0.5;
+        }
+
+        void main() {
+            float scale = instance_pos_scale.w;
+            vec3 center = instance_pos_scale.xyz
+                        + rotate(instance_rotation, impostor_center * scale);
+
+            // the view direction in the mesh's own space picks the frames
+            vec3 to_camera = normalize(camera_pos - center);
+            vec4 inverse = vec4(-instance_rotation.xyz, instance_rotation.w);
+            vec3 dir = rotate(inverse, to_camera);
+
+            vec2 grid = octahedral_encode(dir) * frames - 0.5;
+            frame_base = floor(grid);
+            frame_weights = grid - frame_base;
+
+            // same basis as the bake, so the quad lines up with the frames
+            vec3 up_ref = abs(dir.y) > 0.99 ? vec3(0, 0, 1) : vec3(0, 1, 0);
+            vec3 right = normalize(cross(up_ref, dir));
+            vec3 up = cross(dir, right);
+
+            vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+            vec3 offset = (right * corner.x + up * corner.y)
+                        * impostor_radius * scale;
+
+            frame_uv = corner * 0.5 + 0.5;
+            rotation = instance_rotation;
+
+            vec3 world = center + rotate(instance_rotation, offset);
+            gl_Position = perspective * view * vec4(world, 1.0);
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec2 frame_uv;
+        in vec2 frame_base;
+        in vec2 frame_weights;
+        in vec4 rotation;
+
+        uniform sampler2D albedo_atlas;
+        uniform sampler2D normal_atlas;
+        uniform float frames;
+        uniform vec3 sun_direction;
+
+        out vec4 fragColor;
+
+        vec3 rotate(vec4 q, vec3 v) {
+            return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+        }
+
+        void main() {
+            vec4 albedo = vec4(0.0);
+            vec3 normal = vec3(0.0);
+
+            // blend the four nearest baked views
+            for (int i = 0; i < 4; i++) {
+                vec2 step = vec2(i & 1, i >> 1);
+                vec2 frame = clamp(frame_base + step, 0.0, frames - 1.0);
+                vec2 w2 = mix(1.0 - frame_weights, frame_weights, step);
+                float w = w2.x * w2.y;
+
+                vec2 uv = (frame + frame_uv) / frames;
+                albedo += texture(albedo_atlas, uv) * w;
+                normal += (texture(normal_atlas, uv).xyz * 2.0 - 1.0) * w;
+            }
+
+            if (albedo.a < 0.5) {
+                discard;
+            }
+
+            vec3 n = normalize(rotate(rotation, normal));
+            float diffuse = max(dot(n, -normalize(sun_direction)), 0.0);
+            fragColor = vec4(albedo.rgb / albedo.a * (0.2 + 0.8 * diffuse),
+                             1.0);
+        }
+    )";
+
+  ImpostorSet result;
+  result.mesh = &mesh;
+  result.impostor = &impostor;
+  result.shader = Shader::make_with_version(vtx_shader, frg_shader);
+
+  glGenVertexArrays(1, &result.vao);
+  glBindVertexArray(result.vao);
+
+  glGenBuffers(1, &result.vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+
+  // Instance is {pos, scale, rotation}, glm::quat is stored x, y, z, w
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)offsetof(Instance, pos));
+  glVertexAttribDivisor(0, 1);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)offsetof(Instance, rotation));
+  glVertexAttribDivisor(1, 1);
+
+  glBindVertexArray(0);
+
+  return result;
+}
+
+void ImpostorSet::destroy() {
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  shader.destroy();
+}
+
+void ImpostorSet::add(Vec3f pos, Quat rotation, f32 scale) {
+  instances.push_back(Instance{pos, scale, rotation});
+}
+
+void ImpostorSet::clear() { instances.clear(); }
+
+void ImpostorSet::draw(Shader &mesh_shader, Mat4 perspective, Mat4 view) {
+  Vec3f camera_pos = Vec3f(glm::inverse(view)[3]);
+  f32 distance2 = distance * distance;
+
+  near_count = 0;
+  far.clear();
+
+  mesh_shader.bind();
+  mesh_shader.uniform("perspective", perspective);
+  mesh_shader.uniform("view", view);
+
+  for (const Instance &instance : instances) {
+    Vec3f d = instance.pos - camera_pos;
+    if (glm::dot(d, d) > distance2) {
+      far.push_back(instance);
+      continue;
+    }
+
+    Mat4 model = glm::translate(Mat4(1), instance.pos) *
+                 glm::mat4_cast(instance.rotation) *
+                 glm::scale(Mat4(1), Vec3f(instance.scale));
+    mesh_shader.uniform("model", model);
+    mesh->draw();
+    near_count++;
+  }
+
+  far_count = far.size();
+  if (far.empty()) {
+    return;
+  }
+
+  GPU_SCOPE("Impostors");
+
+  usize size = sizeof(Instance) * far.size();
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (size > vbo_capacity) {
+    vbo_capacity = std::max(size, vbo_capacity * 2);
+  }
+  glBufferData(GL_ARRAY_BUFFER, vbo_capacity, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, size, far.data());
+  RENDER_STAT_UPLOAD(size);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  shader.bind();
+  shader.uniform("perspective", perspective);
+  shader.uniform("view", view);
+  shader.uniform("camera_pos", camera_pos);
+  shader.uniform("impostor_center", impostor->center);
+  shader.uniform("impostor_radius", impostor->radius);
+  shader.uniform("frames", (f32)impostor->frames);
+  shader.uniform("sun_direction", sun_direction);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, impostor->albedo);
+  shader.sampler("albedo_atlas", 0);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, impostor->normal);
+  shader.sampler("normal_atlas", 1);
+
+  glBindVertexArray(vao);
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, 2 * far.size());
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, far.size());
+  glBindVertexArray(0);
+}
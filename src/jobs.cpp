@@ -0,0 +1,148 @@
+#include <rama/jobs.hpp>
+
+#include <rama/engine.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct Task {
+  const jobs::Range *fn = nullptr;
+  u32 count = 0;
+  u32 batch_size = 1;
+  std::atomic<u32> next = 0;
+  std::atomic<u32> done = 0;
+};
+
+ArrayList<std::thread> workers;
+
+std::mutex mutex;
+std::mutex dispatch_mutex;
+std::condition_variable wake, finished;
+
+Task task;
+u64 generation = 0;
+u32 active = 0;
+bool stopping = false;
+
+thread_local bool inside_job = false;
+thread_local u32 worker_index = 0;
+
+void run_batches() {
+  inside_job = true;
+
+  while (true) {
+    u32 begin = task.next.fetch_add(task.batch_size);
+    if (begin >= task.count) {
+      break;
+    }
+
+    u32 end = std::min(begin + task.batch_size, task.count);
+    (*task.fn)(begin, end, worker_index);
+    task.done.fetch_add(end - begin);
+  }
+
+  inside_job = false;
+}
+
+void worker_main(u32 index) {
+  worker_index = index;
+  u64 seen = 0;
+
+  while (true) {
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+
+      seen = generation;
+      active++;
+    }
+
+    run_batches();
+
+    {
+      std::lock_guard lock(mutex);
+      active--;
+    }
+    finished.notify_all();
+  }
+}
+} // namespace
+
+namespace jobs {
+
+void init(u32 count) {
+  if (!workers.empty()) {
+    return;
+  }
+
+  if (count == 0) {
+    u32 hardware = std::thread::hardware_concurrency();
+    count = hardware > 1 ? hardware - 1 : 0;
+  }
+
+  stopping = false;
+  for (u32 i = 0; i < count; i++) {
+    workers.emplace_back(worker_main, i + 1);
+  }
+
+  engine::info("jobs: started {} worker threads", count);
+}
+
+void shutdown() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+
+u32 thread_count() { return workers.size() + 1; }
+
+void parallel_for(u32 count, u32 batch_size, const Range &fn) {
+  if (count == 0) {
+    return;
+  }
+
+  batch_size = std::max(1u, batch_size);
+
+  if (workers.empty() || inside_job || count <= batch_size) {
+    fn(0, count, worker_index);
+    return;
+  }
+
+  std::lock_guard dispatch(dispatch_mutex);
+
+  {
+    std::unique_lock lock(mutex);
+    // a worker that woke late for the previous task may still be reading it
+    finished.wait(lock, [] { return active == 0; });
+
+    task.fn = &fn;
+    task.count = count;
+    task.batch_size = batch_size;
+    task.next = 0;
+    task.done = 0;
+    generation++;
+  }
+  wake.notify_all();
+
+  run_batches();
+
+  std::unique_lock lock(mutex);
+  finished.wait(lock, [&] { return task.done == count && active == 0; });
+}
+
+} // namespace jobs
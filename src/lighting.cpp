@@ -0,0 +1,395 @@
+#include <rama/lighting.hpp>
+
+#include <rama/jobs.hpp>
+#include <rama/render_stats.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct GPULight {
+  Vec4f pos_radius;
+  Vec4f colour_intensity;
+  Vec4f direction_type;
+  Vec4f cone; // cos inner, cos outer
+};
+
+// view space spheres of the lights touching one depth slice, padded to a
+// multiple of four with lanes that can never pass the test
+struct SliceLights {
+  ArrayList<f32> x, y, z, r2;
+  ArrayList<u32> index;
+
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    r2.clear();
+    index.clear();
+  }
+
+  void push(Vec3f center, f32 radius_sq, u32 i) {
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    r2.push_back(radius_sq);
+    index.push_back(i);
+  }
+
+  void pad() {
+    while (index.size() % 4 != 0) {
+      push(Vec3f(0), -1.0f, 0);
+    }
+  }
+};
+
+struct ClusterBounds {
+  f32 min_x, min_y, min_z, max_x, max_y, max_z;
+};
+
+void bin_cluster(const ClusterBounds &b, const SliceLights &lights,
+                 ArrayList<u32> &out) {
+  u32 count = lights.index.size();
+
+#if defined(__SSE2__)
+  __m128 zero = _mm_setzero_ps();
+  __m128 min_x = _mm_set1_ps(b.min_x), max_x = _mm_set1_ps(b.max_x);
+  __m128 min_y = _mm_set1_ps(b.min_y), max_y = _mm_set1_ps(b.max_y);
+  __m128 min_z = _mm_set1_ps(b.min_z), max_z = _mm_set1_ps(b.max_z);
+
+  for (u32 i = 0; i < count; i += 4) {
+    __m128 cx = _mm_loadu_ps(lights.x.data() + i);
+    __m128 cy = _mm_loadu_ps(lights.y.data() + i);
+    __m128 cz = _mm_loadu_ps(lights.z.data() + i);
+    __m128 r2 = _mm_loadu_ps(lights.r2.data() + i);
+
+    // distance from the sphere centre to the box, per axis
+    __m128 dx = _mm_max_ps(
+        _mm_max_ps(_mm_sub_ps(min_x, cx), _mm_sub_ps(cx, max_x)), zero);
+    __m128 dy = _mm_max_ps(
+        _mm_max_ps(_mm_sub_ps(min_y, cy), _mm_sub_ps(cy, max_y)), zero);
+    __m128 dz = _mm_max_ps(
+        _mm_max_ps(_mm_sub_ps(min_z, cz), _mm_sub_ps(cz, max_z)), zero);
+
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                           _mm_mul_ps(dz, dz));
+
+    u32 mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+    while (mask) {
+      out.push_back(lights.index[i + std::countr_zero(mask)]);
+      mask &= mask - 1;
+    }
+  }
+#else
+  for (u32 i = 0; i < count; i++) {
+    f32 dx = std::max({b.min_x - lights.x[i], lights.x[i] - b.max_x, 0.0f});
+    f32 dy = std::max({b.min_y - lights.y[i], lights.y[i] - b.max_y, 0.0f});
+    f32 dz = std::max({b.min_z - lights.z[i], lights.z[i] - b.max_z, 0.0f});
+
+    if (dx * dx + dy * dy + dz * dz <= lights.r2[i]) {
+      out.push_back(lights.index[i]);
+    }
+  }
+#endif
+}
+
+template <typename T> void upload(u32 ssbo, const ArrayList<T> &data) {
+  // never leave a binding with a zero sized store
+  usize size = std::max<usize>(sizeof(T) * data.size(), 16);
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  if (!data.empty()) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(T) * data.size(),
+                    data.data());
+    RENDER_STAT_UPLOAD(sizeof(T) * data.size());
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+ArrayList<GPULight> gpu_lights;
+ArrayList<Vec4f> view_spheres;
+ArrayList<SliceLights> slice_lights;
+ArrayList<ArrayList<u32>> worker_indices;
+ArrayList<u32> cluster_worker;
+
+} // namespace
+
+ClusteredLighting ClusteredLighting::make(u32 x, u32 y, u32 z) {
+  ClusteredLighting result;
+  result.dims = Vec3u(std::max(1u, x), std::max(1u, y), std::max(1u, z));
+
+  glGenBuffers(1, &result.light_ssbo);
+  glGenBuffers(1, &result.grid_ssbo);
+  glGenBuffers(1, &result.index_ssbo);
+
+  return result;
+}
+
+void ClusteredLighting::destroy() {
+  glDeleteBuffers(1, &light_ssbo);
+  glDeleteBuffers(1, &grid_ssbo);
+  glDeleteBuffers(1, &index_ssbo);
+}
+
+void ClusteredLighting::add_point(Vec3f pos, Vec3f colour, f32 intensity,
+                                  f32 radius) {
+  Light light;
+  light.type = LightType::point;
+  light.pos = pos;
+  light.colour = colour;
+  light.intensity = intensity;
+  light.radius = radius;
+  lights.push_back(light);
+}
+
+void ClusteredLighting::add_spot(Vec3f pos, Vec3f direction, Vec3f colour,
+                                 f32 intensity, f32 radius, f32 inner_angle,
+                                 f32 outer_angle) {
+  Light light;
+  light.type = LightType::spot;
+  light.pos = pos;
+  light.direction = engine::safe_normalize(direction);
+  light.colour = colour;
+  light.intensity = intensity;
+  light.radius = radius;
+  light.inner_angle = inner_angle;
+  light.outer_angle = outer_angle;
+  lights.push_back(light);
+}
+
+void ClusteredLighting::clear() { lights.clear(); }
+
+void ClusteredLighting::build_clusters(FPSCamera &camera) {
+  Vec2f size = engine::get_game_size();
+
+  near = camera.near;
+  far = camera.far;
+  fov = camera.fov;
+  aspect = size.x / std::max(1.0f, size.y);
+
+  Mat4 inverse = glm::inverse(camera.GetPerspective());
+
+  u32 count = dims.x * dims.y * dims.z;
+  min_x.resize(count);
+  min_y.resize(count);
+  min_z.resize(count);
+  max_x.resize(count);
+  max_y.resize(count);
+  max_z.resize(count);
+
+  for (u32 z = 0; z < dims.z; z++) {
+    // exponential slices keep clusters roughly cubic along the view ray
+    f32 slice_near = near * std::pow(far / near, (f32)z / dims.z);
+    f32 slice_far = near * std::pow(far / near, (f32)(z + 1) / dims.z);
+
+    for (u32 y = 0; y < dims.y; y++) {
+      for (u32 x = 0; x < dims.x; x++) {
+        u32 i = x + y * dims.x + z * dims.x * dims.y;
+
+        Vec3f lo(INFINITY), hi(-INFINITY);
+        for (u32 corner = 0; corner < 4; corner++) {
+          f32 nx = -1.0f + 2.0f * (f32)(x + (corner & 1)) / dims.x;
+          f32 ny = -1.0f + 2.0f * (f32)(y + (corner >> 1)) / dims.y;
+
+          Vec4f p = inverse * Vec4f(nx, ny, -1.0f, 1.0f);
+          Vec3f ray = Vec3f(p) / p.w;
+
+          for (f32 depth : {slice_near, slice_far}) {
+            Vec3f point = ray * (depth / -ray.z);
+            lo = glm::min(lo, point);
+            hi = glm::max(hi, point);
+          }
+        }
+
+        min_x[i] = lo.x;
+        min_y[i] = lo.y;
+        min_z[i] = lo.z;
+        max_x[i] = hi.x;
+        max_y[i] = hi.y;
+        max_z[i] = hi.z;
+      }
+    }
+  }
+}
+
+void ClusteredLighting::update(FPSCamera &camera) {
+  Vec2f size = engine::get_game_size();
+  f32 current_aspect = size.x / std::max(1.0f, size.y);
+
+  if (camera.near != near || camera.far != far || camera.fov != fov ||
+      current_aspect != aspect) {
+    build_clusters(camera);
+  }
+
+  Mat4 view = camera.GetView();
+  u32 light_count = lights.size();
+
+  gpu_lights.resize(light_count);
+  view_spheres.resize(light_count);
+
+  jobs::parallel_for(light_count, 1024, [&](u32 begin, u32 end, u32) {
+    for (u32 i = begin; i < end; i++) {
+      const Light &light = lights[i];
+
+      gpu_lights[i] = GPULight{
+          Vec4f(light.pos, light.radius),
+          Vec4f(light.colour, light.intensity),
+          Vec4f(light.direction, (f32)light.type),
+          Vec4f(std::cos(glm::radians(light.inner_angle)),
+                std::cos(glm::radians(light.outer_angle)), 0, 0),
+      };
+
+      view_spheres[i] = Vec4f(Vec3f(view * Vec4f(light.pos, 1)), light.radius);
+    }
+  });
+
+  u32 slice_size = dims.x * dims.y;
+  slice_lights.resize(dims.z);
+
+  jobs::parallel_for(dims.z, 1, [&](u32 begin, u32 end, u32) {
+    for (u32 z = begin; z < end; z++) {
+      SliceLights &slice = slice_lights[z];
+      slice.clear();
+
+      // every cluster in a slice shares the same depth range
+      f32 lo = min_z[z * slice_size], hi = max_z[z * slice_size];
+
+      for (u32 i = 0; i < light_count; i++) {
+        Vec4f sphere = view_spheres[i];
+        if (sphere.z + sphere.w >= lo && sphere.z - sphere.w <= hi) {
+          slice.push(Vec3f(sphere), sphere.w * sphere.w, i);
+        }
+      }
+
+      slice.pad();
+    }
+  });
+
+  u32 cluster_count = slice_size * dims.z;
+  grid.resize(cluster_count * 2);
+  cluster_worker.resize(cluster_count);
+
+  worker_indices.resize(jobs::thread_count());
+  for (auto &list : worker_indices) {
+    list.clear();
+  }
+
+  jobs::parallel_for(cluster_count, dims.x, [&](u32 begin, u32 end, u32 worker) {
+    ArrayList<u32> &out = worker_indices[worker];
+
+    for (u32 i = begin; i < end; i++) {
+      ClusterBounds bounds{min_x[i], min_y[i], min_z[i],
+                           max_x[i], max_y[i], max_z[i]};
+
+      u32 start = out.size();
+      bin_cluster(bounds, slice_lights[i / slice_size], out);
+
+      grid[i * 2 + 0] = start;
+      grid[i * 2 + 1] = out.size() - start;
+      cluster_worker[i] = worker;
+    }
+  });
+
+  // stitch the per-worker lists together and rebase the cluster offsets
+  ArrayList<u32> base(worker_indices.size());
+  indices.clear();
+  for (u32 w = 0; w < worker_indices.size(); w++) {
+    base[w] = indices.size();
+    indices.insert(indices.end(), worker_indices[w].begin(),
+                   worker_indices[w].end());
+  }
+
+  for (u32 i = 0; i < cluster_count; i++) {
+    grid[i * 2] += base[cluster_worker[i]];
+  }
+
+  upload(light_ssbo, gpu_lights);
+  upload(grid_ssbo, grid);
+  upload(index_ssbo, indices);
+}
+
+void ClusteredLighting::bind() {
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, light_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, grid_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, index_ssbo);
+}
+
+void ClusteredLighting::apply(Shader &shader) {
+  shader.uniform("cluster_dims", Vec3f(dims));
+  shader.uniform("cluster_depth", Vec2f(near, far));
+  shader.uniform("cluster_screen", engine::get_render_size());
+}
+
+string ClusteredLighting::glsl() {
+  return R"(
+        struct ClusterLight {
+            vec4 pos_radius;
+            vec4 colour_intensity;
+            vec4 direction_type;
+            vec4 cone;
+        };
+
+        layout(std430, binding = 1) readonly buffer ClusterLights {
+            ClusterLight cluster_lights[];
+        };
+
+        layout(std430, binding = 2) readonly buffer ClusterGrid {
+            uint cluster_grid[];
+        };
+
+        layout(std430, binding = 3) readonly buffer ClusterIndices {
+            uint cluster_indices[];
+        };
+
+        uniform vec3 cluster_dims;
+        uniform vec2 cluster_depth;
+        uniform vec2 cluster_screen;
+
+        uint cluster_index(vec2 frag_coord, float view_depth) {
+            float slice = log(view_depth / cluster_depth.x)
+                        / log(cluster_depth.y / cluster_depth.x) * cluster_dims.z;
+
+            vec3 cell = vec3(frag_coord / cluster_screen * cluster_dims.xy, slice);
+            uvec3 c = uvec3(clamp(cell, vec3(0), cluster_dims - 1.0));
+            uvec3 dims = uvec3(cluster_dims);
+
+            return c.x + c.y * dims.x + c.z * dims.x * dims.y;
+        }
+
+        // view_depth is the positive distance along the camera forward axis
+        vec3 clustered_lighting(vec3 world_pos, vec3 normal, vec3 albedo, float view_depth) {
+            uint cluster = cluster_index(gl_FragCoord.xy, view_depth);
+            uint offset = cluster_grid[cluster * 2];
+            uint count = cluster_grid[cluster * 2 + 1];
+
+            vec3 result = vec3(0);
+            for (uint i = 0; i < count; i++) {
+                ClusterLight light = cluster_lights[cluster_indices[offset + i]];
+
+                vec3 to_light = light.pos_radius.xyz - world_pos;
+                float dist = length(to_light);
+                vec3 l = to_light / max(dist, 1e-4);
+
+                float window = clamp(1.0 - pow(dist / light.pos_radius.w, 4.0), 0.0, 1.0);
+                float attenuation = window * window / (dist * dist + 1.0);
+
+                if (light.direction_type.w > 0.5) {
+                    float spot = dot(-l, light.direction_type.xyz);
+                    attenuation *= smoothstep(light.cone.y, light.cone.x, spot);
+                }
+
+                result += albedo * light.colour_intensity.rgb * light.colour_intensity.w
+                        * max(dot(normal, l), 0.0) * attenuation;
+            }
+
+            return result;
+        }
+    )";
+}
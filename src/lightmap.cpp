@@ -0,0 +1,1275 @@
+#include <rama/lightmap.hpp>
+
+#include <rama/jobs.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+#include <glm/gtc/constants.hpp>
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using json = nlohmann::json;
+
+constexpr u32 max_leaf_size = 4;
+constexpr u32 sah_bins = 12;
+constexpr u32 stack_size = 256;
+
+struct Bounds {
+  Vec3f min = Vec3f(FLT_MAX), max = Vec3f(-FLT_MAX);
+
+  void grow(Vec3f p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+
+  void grow(const Bounds &b) {
+    min = glm::min(min, b.min);
+    max = glm::max(max, b.max);
+  }
+
+  f32 area() const {
+    if (min.x > max.x) {
+      return 0.0f;
+    }
+    Vec3f d = max - min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+};
+
+struct BuildNode {
+  Bounds bounds;
+  u32 first = 0, count = 0;
+  i32 left = -1, right = -1;
+};
+
+// binned SAH over triangle references, later collapsed into a 4 wide tree
+struct BinaryBuilder {
+  const ArrayList<Bounds> &boxes;
+  const ArrayList<Vec3f> &centroids;
+  ArrayList<u32> &order;
+  ArrayList<BuildNode> nodes;
+
+  u32 build(u32 first, u32 count) {
+    u32 index = nodes.size();
+    nodes.emplace_back();
+
+    Bounds bounds, centroid_bounds;
+    for (u32 i = first; i < first + count; i++) {
+      bounds.grow(boxes[order[i]]);
+      centroid_bounds.grow(centroids[order[i]]);
+    }
+
+    nodes[index].bounds = bounds;
+    nodes[index].first = first;
+    nodes[index].count = count;
+
+    if (count <= max_leaf_size) {
+      return index;
+    }
+
+    Vec3f extent = centroid_bounds.max - centroid_bounds.min;
+    u32 axis = 0;
+    if (extent.y > extent[axis]) {
+      axis = 1;
+    }
+    if (extent.z > extent[axis]) {
+      axis = 2;
+    }
+
+    u32 *begin = order.data() + first;
+    u32 *end = begin + count;
+    u32 *mid = begin + count / 2;
+
+    if (extent[axis] > 0.0f) {
+      f32 lo = centroid_bounds.min[axis];
+      f32 to_bin = sah_bins / extent[axis];
+      auto bin_of = [&](u32 t) {
+        u32 bin = (centroids[t][axis] - lo) * to_bin;
+        return std::min(sah_bins - 1, bin);
+      };
+
+      Bounds bin_bounds[sah_bins];
+      u32 bin_counts[sah_bins] = {};
+      for (u32 *t = begin; t != end; t++) {
+        u32 b = bin_of(*t);
+        bin_bounds[b].grow(boxes[*t]);
+        bin_counts[b]++;
+      }
+
+      // right to left sweep first, then score every split on the way back
+      f32 right_area[sah_bins];
+      u32 right_count[sah_bins];
+      Bounds acc;
+      u32 n = 0;
+      for (u32 b = sah_bins - 1; b > 0; b--) {
+        acc.grow(bin_bounds[b]);
+        n += bin_counts[b];
+        right_area[b] = acc.area();
+        right_count[b] = n;
+      }
+
+      f32 best_cost = FLT_MAX;
+      u32 best_split = 0;
+      acc = Bounds{};
+      n = 0;
+      for (u32 b = 1; b < sah_bins; b++) {
+        acc.grow(bin_bounds[b - 1]);
+        n += bin_counts[b - 1];
+        if (n == 0 || right_count[b] == 0) {
+          continue;
+        }
+        f32 cost = acc.area() * n + right_area[b] * right_count[b];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_split = b;
+        }
+      }
+
+      if (best_split == 0) {
+        std::nth_element(begin, mid, end, [&](u32 a, u32 b) {
+          return centroids[a][axis] < centroids[b][axis];
+        });
+      } else {
+        mid = std::partition(begin, end,
+                             [&](u32 t) { return bin_of(t) < best_split; });
+      }
+    }
+
+    if (mid == begin || mid == end) {
+      mid = begin + count / 2;
+    }
+
+    u32 left_count = mid - begin;
+    i32 left = build(first, left_count);
+    i32 right = build(first + left_count, count - left_count);
+    nodes[index].left = left;
+    nodes[index].right = right;
+
+    return index;
+  }
+};
+
+u32 collapse(const ArrayList<BuildNode> &binary, u32 root,
+             ArrayList<LightmapBaker::Node> &nodes) {
+  // open the largest inner children until there are four
+  u32 children[4];
+  u32 n = 0;
+  if (binary[root].left < 0) {
+    children[n++] = root;
+  } else {
+    children[n++] = binary[root].left;
+    children[n++] = binary[root].right;
+  }
+
+  while (n < 4) {
+    i32 best = -1;
+    f32 best_area = -1.0f;
+    for (u32 k = 0; k < n; k++) {
+      const BuildNode &c = binary[children[k]];
+      if (c.left >= 0 && c.bounds.area() > best_area) {
+        best = k;
+        best_area = c.bounds.area();
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+
+    u32 opened = children[best];
+    children[best] = binary[opened].left;
+    children[n++] = binary[opened].right;
+  }
+
+  u32 index = nodes.size();
+  nodes.emplace_back();
+
+  LightmapBaker::Node node;
+  for (u32 k = 0; k < 4; k++) {
+    node.min_x[k] = node.min_y[k] = node.min_z[k] = 0.0f;
+    node.max_x[k] = node.max_y[k] = node.max_z[k] = 0.0f;
+    node.child[k] = -1;
+    node.count[k] = 0;
+  }
+
+  for (u32 k = 0; k < n; k++) {
+    const BuildNode &c = binary[children[k]];
+    node.min_x[k] = c.bounds.min.x;
+    node.min_y[k] = c.bounds.min.y;
+    node.min_z[k] = c.bounds.min.z;
+    node.max_x[k] = c.bounds.max.x;
+    node.max_y[k] = c.bounds.max.y;
+    node.max_z[k] = c.bounds.max.z;
+
+    if (c.left < 0) {
+      node.child[k] = ~(i32)c.first;
+      node.count[k] = c.count;
+    } else {
+      node.child[k] = collapse(binary, children[k], nodes);
+    }
+  }
+
+  nodes[index] = node;
+  return index;
+}
+
+// one PCG step, used both to seed and to advance the per texel generators
+u32 pcg_hash(u32 v) {
+  u32 state = v * 747796405u + 2891336453u;
+  u32 word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+struct Random {
+  u32 state;
+
+  f32 next() {
+    state = pcg_hash(state);
+    return (state >> 8) * (1.0f / 16777216.0f);
+  }
+};
+
+Vec3f cosine_sample(Vec3f n, Random &rng) {
+  f32 phi = 2.0f * glm::pi<f32>() * rng.next();
+  f32 r2 = rng.next();
+  f32 r = std::sqrt(r2);
+
+  // branchless orthonormal basis, Duff et al. 2017
+  f32 sign = std::copysign(1.0f, n.z);
+  f32 a = -1.0f / (sign + n.z);
+  f32 b = n.x * n.y * a;
+  Vec3f t(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+  Vec3f s(b, sign + n.y * n.y * a, -n.y);
+
+  return glm::normalize(t * (r * std::cos(phi)) + s * (r * std::sin(phi)) +
+                        n * std::sqrt(std::max(0.0f, 1.0f - r2)));
+}
+
+bool intersect(const LightmapBaker::Triangle &tri, Vec3f origin, Vec3f dir,
+               f32 &t, f32 &u, f32 &v) {
+  Vec3f p = glm::cross(dir, tri.e2);
+  f32 det = glm::dot(tri.e1, p);
+  if (std::abs(det) < 1e-12f) {
+    return false;
+  }
+
+  f32 inv_det = 1.0f / det;
+  Vec3f s = origin - tri.v0;
+  f32 hit_u = glm::dot(s, p) * inv_det;
+  if (hit_u < 0.0f || hit_u > 1.0f) {
+    return false;
+  }
+
+  Vec3f q = glm::cross(s, tri.e1);
+  f32 hit_v = glm::dot(dir, q) * inv_det;
+  if (hit_v < 0.0f || hit_u + hit_v > 1.0f) {
+    return false;
+  }
+
+  f32 hit_t = glm::dot(tri.e2, q) * inv_det;
+  if (hit_t <= 0.0f || hit_t >= t) {
+    return false;
+  }
+
+  t = hit_t;
+  u = hit_u;
+  v = hit_v;
+  return true;
+}
+
+f32 edge(Vec2f a, Vec2f b, Vec2f p) {
+  return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+// shelf packing of `sizes` into the unit square, tallest first, with
+// `gutter` around every rectangle. returns false when they do not fit.
+bool shelf_pack(const ArrayList<Vec2f> &sizes, const ArrayList<u32> &order,
+                f32 scale, f32 gutter, ArrayList<Vec2f> &placed) {
+  f32 x = gutter, y = gutter, row = 0.0f;
+
+  for (u32 i : order) {
+    Vec2f size = sizes[i] * scale;
+    if (x + size.x + gutter > 1.0f) {
+      x = gutter;
+      y += row + gutter;
+      row = 0.0f;
+    }
+    if (x + size.x + gutter > 1.0f || y + size.y + gutter > 1.0f) {
+      return false;
+    }
+
+    placed[i] = Vec2f(x, y);
+    x += size.x + gutter;
+    row = std::max(row, size.y);
+  }
+
+  return true;
+}
+
+// every triangle as its own chart in the unit square, three UV2 corners per
+// triangle in index order
+ArrayList<Vec2f> lay_out_charts(const ArrayList<Vec3f> &positions,
+                                const ArrayList<u32> &indices,
+                                u32 resolution) {
+  u32 count = indices.size() / 3;
+
+  // every triangle laid flat in its own plane, first edge along x
+  ArrayList<Vec2f> corners(count * 3, Vec2f(0));
+  ArrayList<Vec2f> sizes(count, Vec2f(0));
+
+  for (u32 t = 0; t < count; t++) {
+    Vec3f p0 = positions[indices[t * 3]];
+    Vec3f e1 = positions[indices[t * 3 + 1]] - p0;
+    Vec3f e2 = positions[indices[t * 3 + 2]] - p0;
+
+    f32 length = glm::length(e1);
+    Vec3f n = glm::cross(e1, e2);
+    if (length < 1e-8f || glm::length(n) < 1e-12f) {
+      continue;
+    }
+
+    Vec3f x = e1 / length;
+    Vec3f y = glm::normalize(glm::cross(n, x));
+    Vec2f c(glm::dot(e2, x), glm::dot(e2, y));
+
+    f32 min_x = std::min(0.0f, c.x);
+    corners[t * 3] = Vec2f(-min_x, 0);
+    corners[t * 3 + 1] = Vec2f(length - min_x, 0);
+    corners[t * 3 + 2] = Vec2f(c.x - min_x, c.y);
+    sizes[t] = Vec2f(std::max(length, c.x) - min_x, c.y);
+  }
+
+  ArrayList<u32> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](u32 a, u32 b) { return sizes[a].y > sizes[b].y; });
+
+  f32 largest = 1e-8f;
+  for (Vec2f size : sizes) {
+    largest = std::max(largest, std::max(size.x, size.y));
+  }
+
+  // the largest scale whose shelves still fit, with a two texel gutter
+  f32 gutter = 2.0f / resolution;
+  ArrayList<Vec2f> placed(count, Vec2f(0));
+  f32 lo = 0.0f, hi = 1.0f / largest;
+  for (u32 i = 0; i < 24; i++) {
+    f32 scale = (lo + hi) * 0.5f;
+    if (shelf_pack(sizes, order, scale, gutter, placed)) {
+      lo = scale;
+    } else {
+      hi = scale;
+    }
+  }
+
+  if (lo <= 0.0f || !shelf_pack(sizes, order, lo, gutter, placed)) {
+    engine::error("LightmapBaker::unwrap: {} triangles do not fit {}x{}",
+                  count, resolution, resolution);
+  }
+
+  ArrayList<Vec2f> result(count * 3);
+  for (u32 t = 0; t < count * 3; t++) {
+    result[t] = placed[t / 3] + corners[t] * lo;
+  }
+  return result;
+}
+
+} // namespace
+
+Lightmap Lightmap::load(string path) {
+  string full = engine::get_path(path);
+
+  i32 w, h, ncomp;
+  u8 *data = stbi_load(full.c_str(), &w, &h, &ncomp, 4);
+  if (!data) {
+    engine::error("Failed to load lightmap: \"{}\"", full);
+    return {};
+  }
+
+  ArrayList<u8> pixels(data, data + (usize)w * h * 4);
+  stbi_image_free(data);
+
+  ArrayList<Vec4f> scale_offsets;
+  std::ifstream ifs(full + ".json");
+  json meta = json::parse(ifs, nullptr, false);
+  if (meta.is_discarded() || !meta.contains("scale_offsets")) {
+    engine::error("Lightmap::load: missing or invalid sidecar \"{}.json\"",
+                  full);
+  } else {
+    // the shader decodes with rgbm_range, so a lightmap encoded with another
+    // range would come out uniformly too bright or too dark
+    f32 range = meta.value("range", rgbm_range);
+    if (range != rgbm_range) {
+      engine::error("Lightmap::load: \"{}\" is encoded with range {}, "
+                    "expected {}",
+                    full, range, rgbm_range);
+    }
+
+    for (auto &so : meta["scale_offsets"]) {
+      scale_offsets.push_back(Vec4f(so[0].get<f32>(), so[1].get<f32>(),
+                                    so[2].get<f32>(), so[3].get<f32>()));
+    }
+  }
+
+  return Lightmap::make(pixels, w, h, scale_offsets);
+}
+
+Lightmap Lightmap::make(const ArrayList<u8> &rgbm, u32 width, u32 height,
+                        ArrayList<Vec4f> scale_offsets) {
+  Lightmap result;
+  result.width = width;
+  result.height = height;
+  result.scale_offsets = std::move(scale_offsets);
+
+  glGenTextures(1, &result.texture);
+  glBindTexture(GL_TEXTURE_2D, result.texture);
+  // no mipmaps: they would bleed neighbouring charts into each other
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, rgbm.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return result;
+}
+
+void Lightmap::destroy() {
+  if (texture) {
+    glDeleteTextures(1, &texture);
+    texture = 0;
+  }
+}
+
+Vec4f Lightmap::scale_offset(u32 receiver) {
+  if (receiver >= scale_offsets.size()) {
+    engine::error("Lightmap: no receiver {}", receiver);
+    return Vec4f(0);
+  }
+  return scale_offsets[receiver];
+}
+
+void Lightmap::apply(Shader &shader, u32 receiver, i32 unit) {
+  Vec4f so = scale_offset(receiver);
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  shader.sampler("lightmap", unit);
+  shader.uniform("lightmap_scale", Vec2f(so.x, so.y));
+  shader.uniform("lightmap_offset", Vec2f(so.z, so.w));
+}
+
+string Lightmap::glsl() {
+  return fmt::format(R"(
+        uniform sampler2D lightmap;
+        uniform vec2 lightmap_scale;
+        uniform vec2 lightmap_offset;
+
+        vec3 sample_lightmap(vec2 uv2) {{
+            vec2 uv = uv2 * lightmap_scale + lightmap_offset;
+            vec4 rgbm = texture(lightmap, uv);
+            return rgbm.rgb * rgbm.a * {:.1f};
+        }}
+    )",
+                     rgbm_range);
+}
+
+u32 LightmapBaker::add(Geometry geometry, Mat4 model, Vec3f albedo,
+                       bool receiver) {
+  Instance instance;
+  instance.geometry = std::move(geometry);
+  instance.model = model;
+  instance.albedo = albedo;
+  instance.receiver = receiver;
+  instances.push_back(std::move(instance));
+  return instances.size() - 1;
+}
+
+u32 LightmapBaker::add(Mesh &mesh, Mat4 model, Vec3f albedo, bool receiver) {
+  return add(geometry(mesh), model, albedo, receiver);
+}
+
+LightmapBaker::Geometry LightmapBaker::Geometry::load(string path) {
+  path = engine::get_path(path);
+  Assimp::Importer importer;
+  // the flags of Mesh::load, so the vertices and UV2 match the drawn mesh
+  const aiScene *scene = importer.ReadFile(
+      path, aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals |
+                aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+                aiProcess_FlipUVs | aiProcess_OptimizeMeshes |
+                aiProcess_SortByPType);
+
+  if (!scene) {
+    engine::error("Assimp error: {}", importer.GetErrorString());
+    return {};
+  }
+
+  Geometry result;
+  bool has_uv2 = false;
+
+  std::function<void(aiNode * node)> process_node;
+  process_node = [&](aiNode *node) -> void {
+    for (u32 m = 0; m < node->mNumMeshes; m++) {
+      aiMesh *mesh = scene->mMeshes[node->mMeshes[m]];
+      u32 base = result.positions.size();
+
+      for (u32 i = 0; i < mesh->mNumVertices; i++) {
+        result.positions.push_back(Vec3f(
+            mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
+        result.normals.push_back(Vec3f(mesh->mNormals[i].x,
+                                       mesh->mNormals[i].y,
+                                       mesh->mNormals[i].z));
+
+        if (mesh->mTextureCoords[1]) {
+          result.uv2.push_back(Vec2f(mesh->mTextureCoords[1][i].x,
+                                     mesh->mTextureCoords[1][i].y));
+          has_uv2 = true;
+        } else {
+          result.uv2.push_back(Vec2f(0));
+        }
+      }
+
+      for (u32 i = 0; i < mesh->mNumFaces; i++) {
+        aiFace face = mesh->mFaces[i];
+        for (u32 j = 0; j < face.mNumIndices; j++) {
+          result.indices.push_back(base + face.mIndices[j]);
+        }
+      }
+    }
+
+    for (u32 i = 0; i < node->mNumChildren; i++) {
+      process_node(node->mChildren[i]);
+    }
+  };
+
+  process_node(scene->mRootNode);
+
+  if (!has_uv2) {
+    result.uv2.clear();
+  }
+  return result;
+}
+
+LightmapBaker::Geometry LightmapBaker::geometry(Mesh &mesh) {
+  Geometry result;
+  result.positions = mesh.vertices;
+  result.normals = mesh.normals;
+  result.uv2 = mesh.uv2s;
+  result.indices = mesh.indices;
+  return result;
+}
+
+void LightmapBaker::clear() {
+  instances.clear();
+  triangles.clear();
+  nodes.clear();
+  texels.clear();
+  direct.clear();
+  accumulated.clear();
+  passes = 0;
+}
+
+bool LightmapBaker::build() {
+  texels.clear();
+  direct.clear();
+  accumulated.clear();
+  passes = 0;
+
+  if (instances.empty()) {
+    engine::error("LightmapBaker: nothing to bake");
+    return false;
+  }
+
+  build_bvh();
+  if (!pack()) {
+    return false;
+  }
+
+  for (u32 i = 0; i < instances.size(); i++) {
+    if (instances[i].receiver) {
+      rasterize(i);
+    }
+  }
+
+  direct.assign(texels.size(), Vec3f(0));
+  accumulated.assign(texels.size(), Vec3f(0));
+
+  engine::info("LightmapBaker: {} texels, {} triangles, {} BVH nodes",
+               texels.size(), triangles.size(), nodes.size());
+  return true;
+}
+
+bool LightmapBaker::pack() {
+  ArrayList<u32> receivers;
+  ArrayList<f32> areas;
+
+  for (u32 i = 0; i < instances.size(); i++) {
+    Instance &instance = instances[i];
+    instance.scale_offset = Vec4f(0);
+    if (!instance.receiver) {
+      continue;
+    }
+
+    Geometry &geometry = instance.geometry;
+    if (geometry.uv2.size() != geometry.positions.size()) {
+      engine::warning("LightmapBaker: mesh {} has no UV2 channel and only "
+                      "casts shadows, see LightmapBaker::unwrap",
+                      i);
+      instance.receiver = false;
+      continue;
+    }
+
+    f32 area = 0.0f;
+    const ArrayList<Vec3f> &p = geometry.positions;
+    const ArrayList<u32> &idx = geometry.indices;
+    for (u32 t = 0; t + 2 < idx.size(); t += 3) {
+      Mat4 &m = instance.model;
+      Vec3f a = Vec3f(m * Vec4f(p[idx[t]], 1));
+      Vec3f b = Vec3f(m * Vec4f(p[idx[t + 1]], 1));
+      Vec3f c = Vec3f(m * Vec4f(p[idx[t + 2]], 1));
+      area += 0.5f * glm::length(glm::cross(b - a, c - a));
+    }
+
+    receivers.push_back(i);
+    areas.push_back(area);
+  }
+
+  u32 max_inner = resolution > 2 * padding + 2 ? resolution - 2 * padding : 2;
+  f32 density = texels_per_unit;
+
+  for (u32 attempt = 0; attempt < 64; attempt++) {
+    ArrayList<u32> sides(receivers.size());
+    for (u32 r = 0; r < receivers.size(); r++) {
+      u32 inner = (u32)std::ceil(std::sqrt(areas[r]) * density);
+      sides[r] = std::clamp(inner, 2u, max_inner) + 2 * padding;
+    }
+
+    ArrayList<u32> order(receivers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](u32 a, u32 b) { return sides[a] > sides[b]; });
+
+    bool fits = true;
+    u32 x = 0, y = 0, row = 0;
+    ArrayList<Vec2u> placed(receivers.size());
+    for (u32 r : order) {
+      if (x + sides[r] > resolution) {
+        x = 0;
+        y += row;
+        row = 0;
+      }
+      if (y + sides[r] > resolution) {
+        fits = false;
+        break;
+      }
+      placed[r] = Vec2u(x, y);
+      x += sides[r];
+      row = std::max(row, sides[r]);
+    }
+
+    if (!fits) {
+      density *= 0.9f;
+      continue;
+    }
+
+    f32 res = resolution;
+    for (u32 r = 0; r < receivers.size(); r++) {
+      f32 inner = sides[r] - 2 * padding;
+      instances[receivers[r]].scale_offset =
+          Vec4f(inner / res, inner / res, (placed[r].x + padding) / res,
+                (placed[r].y + padding) / res);
+    }
+
+    if (density < texels_per_unit) {
+      engine::warning("LightmapBaker: lowered density to {} texels per unit "
+                      "to fit {}x{}",
+                      density, resolution, resolution);
+    }
+    return true;
+  }
+
+  engine::error("LightmapBaker: {} receivers do not fit a {}x{} lightmap",
+                receivers.size(), resolution, resolution);
+  return false;
+}
+
+void LightmapBaker::rasterize(u32 index) {
+  Instance &instance = instances[index];
+  Geometry &mesh = instance.geometry;
+  Mat3 normal_matrix = glm::transpose(glm::inverse(Mat3(instance.model)));
+  bool has_normals = mesh.normals.size() == mesh.positions.size();
+
+  f32 res = resolution;
+  Vec2f scale = Vec2f(instance.scale_offset.x, instance.scale_offset.y) * res;
+  Vec2f offset = Vec2f(instance.scale_offset.z, instance.scale_offset.w) * res;
+
+  // tiles never overlap, so coverage only has to be tracked per tile
+  u32 tile_x = offset.x, tile_y = offset.y;
+  u32 tile_w = std::ceil(scale.x), tile_h = std::ceil(scale.y);
+  tile_w = std::min(tile_w, resolution - tile_x);
+  tile_h = std::min(tile_h, resolution - tile_y);
+  ArrayList<u8> covered((usize)tile_w * tile_h, 0);
+
+  for (u32 t = 0; t + 2 < mesh.indices.size(); t += 3) {
+    u32 i0 = mesh.indices[t], i1 = mesh.indices[t + 1],
+        i2 = mesh.indices[t + 2];
+
+    Vec2f p0 = mesh.uv2[i0] * scale + offset;
+    Vec2f p1 = mesh.uv2[i1] * scale + offset;
+    Vec2f p2 = mesh.uv2[i2] * scale + offset;
+
+    f32 area = edge(p0, p1, p2);
+    if (std::abs(area) < 1e-12f) {
+      continue;
+    }
+
+    Vec3f v0 = Vec3f(instance.model * Vec4f(mesh.positions[i0], 1));
+    Vec3f v1 = Vec3f(instance.model * Vec4f(mesh.positions[i1], 1));
+    Vec3f v2 = Vec3f(instance.model * Vec4f(mesh.positions[i2], 1));
+
+    Vec3f face = glm::cross(v1 - v0, v2 - v0);
+    if (glm::length(face) < 1e-12f) {
+      continue;
+    }
+    face = glm::normalize(face);
+
+    Vec3f n0 = face, n1 = face, n2 = face;
+    if (has_normals) {
+      n0 = normal_matrix * mesh.normals[i0];
+      n1 = normal_matrix * mesh.normals[i1];
+      n2 = normal_matrix * mesh.normals[i2];
+    }
+
+    Vec2f lo = glm::min(p0, glm::min(p1, p2));
+    Vec2f hi = glm::max(p0, glm::max(p1, p2));
+    i32 x0 = std::max((i32)std::floor(lo.x), (i32)tile_x);
+    i32 y0 = std::max((i32)std::floor(lo.y), (i32)tile_y);
+    i32 x1 = std::min((i32)std::ceil(hi.x), (i32)(tile_x + tile_w));
+    i32 y1 = std::min((i32)std::ceil(hi.y), (i32)(tile_y + tile_h));
+
+    for (i32 y = y0; y < y1; y++) {
+      for (i32 x = x0; x < x1; x++) {
+        Vec2f centre(x + 0.5f, y + 0.5f);
+        f32 w0 = edge(p1, p2, centre) / area;
+        f32 w1 = edge(p2, p0, centre) / area;
+        f32 w2 = 1.0f - w0 - w1;
+        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+          continue;
+        }
+
+        u8 &cover = covered[(y - tile_y) * tile_w + (x - tile_x)];
+        if (cover) {
+          continue;
+        }
+        cover = 1;
+
+        Texel texel;
+        texel.pos = v0 * w0 + v1 * w1 + v2 * w2;
+        texel.normal = glm::normalize(n0 * w0 + n1 * w1 + n2 * w2);
+        texel.pixel = y * resolution + x;
+        texels.push_back(texel);
+      }
+    }
+  }
+}
+
+void LightmapBaker::build_bvh() {
+  triangles.clear();
+  nodes.clear();
+
+  for (u32 i = 0; i < instances.size(); i++) {
+    Instance &instance = instances[i];
+    Geometry &mesh = instance.geometry;
+    Mat3 normal_matrix = glm::transpose(glm::inverse(Mat3(instance.model)));
+    bool has_normals = mesh.normals.size() == mesh.positions.size();
+
+    for (u32 t = 0; t + 2 < mesh.indices.size(); t += 3) {
+      u32 i0 = mesh.indices[t], i1 = mesh.indices[t + 1],
+          i2 = mesh.indices[t + 2];
+
+      Vec3f v0 = Vec3f(instance.model * Vec4f(mesh.positions[i0], 1));
+      Vec3f v1 = Vec3f(instance.model * Vec4f(mesh.positions[i1], 1));
+      Vec3f v2 = Vec3f(instance.model * Vec4f(mesh.positions[i2], 1));
+
+      Vec3f face = glm::cross(v1 - v0, v2 - v0);
+      if (glm::length(face) < 1e-12f) {
+        continue;
+      }
+      face = glm::normalize(face);
+
+      Triangle tri;
+      tri.v0 = v0;
+      tri.e1 = v1 - v0;
+      tri.e2 = v2 - v0;
+      tri.n0 = tri.n1 = tri.n2 = face;
+      if (has_normals) {
+        tri.n0 = normal_matrix * mesh.normals[i0];
+        tri.n1 = normal_matrix * mesh.normals[i1];
+        tri.n2 = normal_matrix * mesh.normals[i2];
+      }
+      tri.instance = i;
+      triangles.push_back(tri);
+    }
+  }
+
+  if (triangles.empty()) {
+    return;
+  }
+
+  ArrayList<Bounds> boxes(triangles.size());
+  ArrayList<Vec3f> centroids(triangles.size());
+  for (u32 i = 0; i < triangles.size(); i++) {
+    Triangle &tri = triangles[i];
+    boxes[i].grow(tri.v0);
+    boxes[i].grow(tri.v0 + tri.e1);
+    boxes[i].grow(tri.v0 + tri.e2);
+    centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+  }
+
+  ArrayList<u32> order(triangles.size());
+  std::iota(order.begin(), order.end(), 0);
+
+  BinaryBuilder builder{boxes, centroids, order, {}};
+  builder.build(0, triangles.size());
+
+  ArrayList<Triangle> sorted(triangles.size());
+  for (u32 i = 0; i < order.size(); i++) {
+    sorted[i] = triangles[order[i]];
+  }
+  triangles = std::move(sorted);
+
+  collapse(builder.nodes, 0, nodes);
+
+  Bounds &scene = builder.nodes[0].bounds;
+  epsilon = std::max(glm::length(scene.max - scene.min) * 1e-4f, 1e-5f);
+}
+
+bool LightmapBaker::trace(Vec3f origin, Vec3f dir, f32 max_t, bool any,
+                          f32 &t, u32 &triangle, Vec2f &barycentric) {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  Vec3f inv;
+  for (u32 a = 0; a < 3; a++) {
+    f32 d = std::abs(dir[a]) > 1e-9f ? dir[a] : std::copysign(1e-9f, dir[a]);
+    inv[a] = 1.0f / d;
+  }
+
+  t = max_t;
+  bool hit = false;
+
+  u32 stack[stack_size];
+  u32 top = 0;
+  stack[top++] = 0;
+
+#if defined(__SSE2__)
+  __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y),
+         oz = _mm_set1_ps(origin.z);
+  __m128 ix = _mm_set1_ps(inv.x), iy = _mm_set1_ps(inv.y),
+         iz = _mm_set1_ps(inv.z);
+  __m128 zero = _mm_setzero_ps();
+#endif
+
+  while (top > 0) {
+    const Node &node = nodes[stack[--top]];
+
+    alignas(16) f32 entry[4];
+    u32 mask = 0;
+
+#if defined(__SSE2__)
+    // slab test against all four children at once
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_x), ox), ix);
+    __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_x), ox), ix);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_y), oy), iy);
+    __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_y), oy), iy);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min_z), oz), iz);
+    __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max_z), oz), iz);
+
+    __m128 tnear = _mm_max_ps(
+        _mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)),
+        _mm_max_ps(_mm_min_ps(t1z, t2z), zero));
+    __m128 tfar = _mm_min_ps(
+        _mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)),
+        _mm_min_ps(_mm_max_ps(t1z, t2z), _mm_set1_ps(t)));
+
+    mask = _mm_movemask_ps(_mm_cmple_ps(tnear, tfar));
+    _mm_store_ps(entry, tnear);
+#else
+    for (u32 k = 0; k < 4; k++) {
+      f32 t1x = (node.min_x[k] - origin.x) * inv.x;
+      f32 t2x = (node.max_x[k] - origin.x) * inv.x;
+      f32 t1y = (node.min_y[k] - origin.y) * inv.y;
+      f32 t2y = (node.max_y[k] - origin.y) * inv.y;
+      f32 t1z = (node.min_z[k] - origin.z) * inv.z;
+      f32 t2z = (node.max_z[k] - origin.z) * inv.z;
+
+      f32 tnear = std::max(
+          std::max(std::min(t1x, t2x), std::min(t1y, t2y)),
+          std::max(std::min(t1z, t2z), 0.0f));
+      f32 tfar = std::min(std::min(std::max(t1x, t2x), std::max(t1y, t2y)),
+                          std::min(std::max(t1z, t2z), t));
+
+      entry[k] = tnear;
+      mask |= (tnear <= tfar ? 1u : 0u) << k;
+    }
+#endif
+
+    // leaves are tested right away, inner children pushed far to near
+    u32 inner[4];
+    f32 inner_near[4];
+    u32 inner_count = 0;
+
+    for (u32 k = 0; k < 4; k++) {
+      if (!(mask & (1u << k))) {
+        continue;
+      }
+
+      if (node.child[k] >= 0) {
+        u32 slot = inner_count++;
+        while (slot > 0 && inner_near[slot - 1] < entry[k]) {
+          inner[slot] = inner[slot - 1];
+          inner_near[slot] = inner_near[slot - 1];
+          slot--;
+        }
+        inner[slot] = node.child[k];
+        inner_near[slot] = entry[k];
+        continue;
+      }
+
+      u32 first = ~node.child[k];
+      for (u32 i = first; i < first + node.count[k]; i++) {
+        f32 u, v;
+        if (intersect(triangles[i], origin, dir, t, u, v)) {
+          hit = true;
+          triangle = i;
+          barycentric = Vec2f(u, v);
+          if (any) {
+            return true;
+          }
+        }
+      }
+    }
+
+    for (u32 k = 0; k < inner_count && top < stack_size; k++) {
+      stack[top++] = inner[k];
+    }
+  }
+
+  return hit;
+}
+
+Vec3f LightmapBaker::direct_light(Vec3f pos, Vec3f normal) {
+  Vec3f result(0);
+  Vec3f origin = pos + normal * epsilon;
+
+  f32 t;
+  u32 triangle;
+  Vec2f barycentric;
+
+  Vec3f l = -glm::normalize(sun_direction);
+  f32 ndotl = glm::dot(normal, l);
+  if (ndotl > 0.0f &&
+      !trace(origin, l, FLT_MAX, true, t, triangle, barycentric)) {
+    result += sun_colour * ndotl;
+  }
+
+  // the same falloff ClusteredLighting shades with
+  for (Light &light : lights) {
+    Vec3f to_light = light.pos - pos;
+    f32 dist = glm::length(to_light);
+    if (dist <= 0.0f || dist >= light.radius) {
+      continue;
+    }
+
+    l = to_light / dist;
+    ndotl = glm::dot(normal, l);
+    if (ndotl <= 0.0f) {
+      continue;
+    }
+
+    f32 window =
+        glm::clamp(1.0f - std::pow(dist / light.radius, 4.0f), 0.0f, 1.0f);
+    f32 attenuation = window * window / (dist * dist + 1.0f);
+
+    if (light.type == LightType::spot) {
+      f32 spot = glm::dot(-l, glm::normalize(light.direction));
+      attenuation *=
+          glm::smoothstep(std::cos(glm::radians(light.outer_angle)),
+                          std::cos(glm::radians(light.inner_angle)), spot);
+    }
+
+    if (attenuation <= 0.0f ||
+        trace(origin, l, dist, true, t, triangle, barycentric)) {
+      continue;
+    }
+
+    result += light.colour * light.intensity * ndotl * attenuation;
+  }
+
+  return result;
+}
+
+void LightmapBaker::refine() {
+  if (texels.empty()) {
+    return;
+  }
+
+  bool first_pass = passes == 0;
+  u32 pass_seed = pcg_hash(passes + 1);
+
+  jobs::parallel_for(texels.size(), 64, [&](u32 begin, u32 end, u32) {
+    for (u32 i = begin; i < end; i++) {
+      Texel &texel = texels[i];
+      if (first_pass) {
+        direct[i] = direct_light(texel.pos, texel.normal);
+      }
+
+      Random rng{pcg_hash(i * 0x9E3779B9u ^ pass_seed)};
+      Vec3f sum(0);
+
+      // cosine sampled paths; with that pdf a diffuse surface's estimate is
+      // just albedo times what arrives, no pi terms
+      for (u32 s = 0; s < samples_per_pass; s++) {
+        Vec3f pos = texel.pos, normal = texel.normal;
+        Vec3f throughput(1);
+
+        for (u32 depth = 0;; depth++) {
+          Vec3f dir = cosine_sample(normal, rng);
+
+          f32 t;
+          u32 hit;
+          Vec2f uv;
+          if (!trace(pos + normal * epsilon, dir, FLT_MAX, false, t, hit,
+                     uv)) {
+            sum += throughput * sky;
+            break;
+          }
+
+          // light leaving the hit would be one bounce more than asked for;
+          // only the sky is counted on the last segment
+          if (depth >= bounces) {
+            break;
+          }
+
+          Triangle &tri = triangles[hit];
+          Vec3f hit_normal = glm::normalize(tri.n0 * (1.0f - uv.x - uv.y) +
+                                            tri.n1 * uv.x + tri.n2 * uv.y);
+          if (glm::dot(hit_normal, dir) > 0.0f) {
+            hit_normal = -hit_normal;
+          }
+
+          pos = pos + normal * epsilon + dir * t;
+          normal = hit_normal;
+          throughput *= instances[tri.instance].albedo;
+          sum += throughput * direct_light(pos, normal);
+
+          if (glm::dot(throughput, Vec3f(1)) < 1e-3f) {
+            break;
+          }
+        }
+      }
+
+      accumulated[i] += sum;
+    }
+  });
+
+  passes++;
+}
+
+ArrayList<u8> LightmapBaker::encode() {
+  usize pixels = (usize)resolution * resolution;
+  ArrayList<Vec3f> colour(pixels, Vec3f(0));
+  ArrayList<u8> filled(pixels, 0);
+
+  f32 inv_samples = passes ? 1.0f / (passes * samples_per_pass) : 0.0f;
+  for (u32 i = 0; i < texels.size(); i++) {
+    colour[texels[i].pixel] = direct[i] + accumulated[i] * inv_samples;
+    filled[texels[i].pixel] = 1;
+  }
+
+  // grow every chart into its padding so bilinear filtering at the edges
+  // never reads unlit texels
+  for (u32 iteration = 0; iteration <= padding; iteration++) {
+    ArrayList<u8> next = filled;
+
+    for (i32 y = 0; y < (i32)resolution; y++) {
+      for (i32 x = 0; x < (i32)resolution; x++) {
+        if (filled[y * resolution + x]) {
+          continue;
+        }
+
+        Vec3f sum(0);
+        u32 count = 0;
+        for (i32 dy = -1; dy <= 1; dy++) {
+          for (i32 dx = -1; dx <= 1; dx++) {
+            i32 nx = x + dx, ny = y + dy;
+            if (nx < 0 || ny < 0 || nx >= (i32)resolution ||
+                ny >= (i32)resolution || !filled[ny * resolution + nx]) {
+              continue;
+            }
+            sum += colour[ny * resolution + nx];
+            count++;
+          }
+        }
+
+        if (count) {
+          colour[y * resolution + x] = sum / (f32)count;
+          next[y * resolution + x] = 1;
+        }
+      }
+    }
+
+    filled = std::move(next);
+  }
+
+  ArrayList<u8> result(pixels * 4, 0);
+  for (usize i = 0; i < pixels; i++) {
+    if (!filled[i]) {
+      continue;
+    }
+
+    Vec3f c = colour[i] / Lightmap::rgbm_range;
+    f32 m = glm::clamp(std::max(c.r, std::max(c.g, c.b)), 1e-6f, 1.0f);
+    m = std::ceil(m * 255.0f) / 255.0f;
+    Vec3f rgb = glm::clamp(c / m, 0.0f, 1.0f);
+
+    result[i * 4 + 0] = (u8)std::round(rgb.r * 255.0f);
+    result[i * 4 + 1] = (u8)std::round(rgb.g * 255.0f);
+    result[i * 4 + 2] = (u8)std::round(rgb.b * 255.0f);
+    result[i * 4 + 3] = (u8)(m * 255.0f + 0.5f);
+  }
+
+  return result;
+}
+
+Lightmap LightmapBaker::result() {
+  ArrayList<Vec4f> scale_offsets;
+  for (Instance &instance : instances) {
+    scale_offsets.push_back(instance.scale_offset);
+  }
+  return Lightmap::make(encode(), resolution, resolution, scale_offsets);
+}
+
+bool LightmapBaker::save(string path) {
+  string full = engine::get_path(path);
+
+  ArrayList<u8> data = encode();
+  if (!stbi_write_png(full.c_str(), resolution, resolution, 4, data.data(),
+                      resolution * 4)) {
+    engine::error("LightmapBaker: failed to write \"{}\"", full);
+    return false;
+  }
+
+  json meta;
+  meta["width"] = resolution;
+  meta["height"] = resolution;
+  meta["range"] = Lightmap::rgbm_range;
+  meta["passes"] = passes;
+  meta["scale_offsets"] = json::array();
+  for (Instance &instance : instances) {
+    Vec4f so = instance.scale_offset;
+    meta["scale_offsets"].push_back({so.x, so.y, so.z, so.w});
+  }
+
+  std::ofstream ofs(full + ".json");
+  if (!ofs) {
+    engine::error("LightmapBaker: failed to write \"{}.json\"", full);
+    return false;
+  }
+  ofs << meta.dump(2);
+
+  engine::info("LightmapBaker: saved \"{}\" after {} passes", full, passes);
+  return true;
+}
+
+bool LightmapBaker::bake(string path, u32 count) {
+  if (!build()) {
+    return false;
+  }
+
+  engine::info("LightmapBaker: {} texels, {} BVH nodes", texel_count(),
+               node_count());
+  for (u32 i = 0; i < count; i++) {
+    refine();
+    engine::info("LightmapBaker: pass {}/{}", i + 1, count);
+  }
+
+  return save(path);
+}
+
+Mesh LightmapBaker::unwrap(Mesh &mesh, u32 resolution) {
+  u32 count = mesh.indices.size() / 3;
+  ArrayList<Vec2f> charts = lay_out_charts(mesh.vertices, mesh.indices,
+                                           resolution);
+
+  usize n = mesh.vertices.size();
+
+  ArrayList<Vec3f> vertices, normals, tangents, bitangents;
+  ArrayList<Vec2f> uvs, uv2s;
+  ArrayList<u32> indices;
+  ArrayList<Vec4u> bone_ids;
+  ArrayList<Vec4f> bone_weights;
+
+  for (u32 t = 0; t < count; t++) {
+    for (u32 k = 0; k < 3; k++) {
+      u32 i = mesh.indices[t * 3 + k];
+
+      vertices.push_back(mesh.vertices[i]);
+      uvs.push_back(mesh.uvs.size() == n ? mesh.uvs[i] : Vec2f(0));
+      normals.push_back(mesh.normals.size() == n ? mesh.normals[i] : Vec3f(0));
+      if (mesh.tangents.size() == n) {
+        tangents.push_back(mesh.tangents[i]);
+      }
+      if (mesh.bitangents.size() == n) {
+        bitangents.push_back(mesh.bitangents[i]);
+      }
+      if (mesh.skinned()) {
+        bone_ids.push_back(mesh.bone_ids[i]);
+        bone_weights.push_back(mesh.bone_weights[i]);
+      }
+
+      uv2s.push_back(charts[t * 3 + k]);
+      indices.push_back(indices.size());
+    }
+  }
+
+  Mesh result = Mesh::make(vertices, uvs, normals, tangents, bitangents,
+                           indices, bone_ids, bone_weights);
+  result.set_uv2(uv2s);
+  return result;
+}
+
+LightmapBaker::Geometry LightmapBaker::unwrap(const Geometry &geometry,
+                                              u32 resolution) {
+  u32 count = geometry.indices.size() / 3;
+  usize n = geometry.positions.size();
+
+  Geometry result;
+  result.uv2 =
+      lay_out_charts(geometry.positions, geometry.indices, resolution);
+  for (u32 t = 0; t < count; t++) {
+    for (u32 k = 0; k < 3; k++) {
+      u32 i = geometry.indices[t * 3 + k];
+      result.positions.push_back(geometry.positions[i]);
+      result.normals.push_back(
+          geometry.normals.size() == n ? geometry.normals[i] : Vec3f(0));
+      result.indices.push_back(result.indices.size());
+    }
+  }
+  return result;
+}
@@ -0,0 +1,222 @@
+#include <rama/material.hpp>
+
+#include <rama/render_stats.hpp>
+
+#include "stb_image.h"
+
+TextureArray TextureArray::make(u32 width, u32 height, u32 capacity) {
+  TextureArray result;
+  result.width = width;
+  result.height = height;
+  result.capacity = capacity;
+
+  u32 levels = 1;
+  while ((std::max(width, height) >> levels) > 0) {
+    levels++;
+  }
+
+  glGenTextures(1, &result.GLid);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, result.GLid);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height,
+                 capacity);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  return result;
+}
+
+void TextureArray::destroy() { glDeleteTextures(1, &GLid); }
+
+i32 TextureArray::add(string path) {
+  path = engine::get_path(path);
+
+  i32 w, h, ncomp;
+  u8 *data = stbi_load(path.c_str(), &w, &h, &ncomp, 4);
+  if (!data) {
+    engine::error("Failed to load texture data: \"{}\"", path);
+    return -1;
+  }
+
+  i32 layer = add(data, w, h);
+  stbi_image_free(data);
+
+  if (layer < 0) {
+    engine::error("TextureArray: \"{}\" is {}x{}, expected {}x{}", path, w, h,
+                  width, height);
+  }
+
+  return layer;
+}
+
+i32 TextureArray::add(const u8 *rgba, u32 w, u32 h) {
+  if (w != width || h != height) {
+    return -1;
+  }
+
+  if (layers >= capacity) {
+    engine::error("TextureArray: all {} layers are in use", capacity);
+    return -1;
+  }
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, GLid);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layers, width, height, 1,
+                  GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  mipmaps_dirty = true;
+  return layers++;
+}
+
+void TextureArray::bind(i32 unit) {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, GLid);
+
+  // regenerate once after a batch of loads rather than on every add
+  if (mipmaps_dirty) {
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    mipmaps_dirty = false;
+  }
+}
+
+MaterialTable MaterialTable::make(u32 texture_size, u32 max_textures) {
+  MaterialTable result;
+
+  glGenBuffers(1, &result.ssbo);
+  result.textures = TextureArray::make(texture_size, texture_size, max_textures);
+
+  // material 0 is the default, so an unset base instance still renders
+  result.add(MaterialParams{});
+
+  return result;
+}
+
+void MaterialTable::destroy() {
+  glDeleteBuffers(1, &ssbo);
+  textures.destroy();
+}
+
+u32 MaterialTable::add(MaterialParams params) {
+  materials.push_back(params);
+  dirty = true;
+  return materials.size() - 1;
+}
+
+void MaterialTable::set(u32 material, MaterialParams params) {
+  if (material >= materials.size()) {
+    engine::error("MaterialTable::set: no material {}", material);
+    return;
+  }
+
+  materials[material] = params;
+  dirty = true;
+}
+
+MaterialParams MaterialTable::get(u32 material) {
+  if (material >= materials.size()) {
+    engine::error("MaterialTable::get: no material {}", material);
+    return MaterialParams{};
+  }
+
+  return materials[material];
+}
+
+i32 MaterialTable::texture(string path) {
+  if (auto it = texture_layers.find(path); it != texture_layers.end()) {
+    return it->second;
+  }
+
+  i32 layer = textures.add(path);
+  if (layer >= 0) {
+    texture_layers.emplace(path, layer);
+  }
+
+  return layer;
+}
+
+i32 MaterialTable::texture(string key, const u8 *rgba, u32 width,
+                           u32 height) {
+  if (auto it = texture_layers.find(key); it != texture_layers.end()) {
+    return it->second;
+  }
+
+  i32 layer = textures.add(rgba, width, height);
+  if (layer >= 0) {
+    texture_layers.emplace(key, layer);
+  } else {
+    engine::error("MaterialTable: \"{}\" is {}x{}, textures must all be the "
+                  "same size",
+                  key, width, height);
+  }
+
+  return layer;
+}
+
+void MaterialTable::upload() {
+  if (!dirty) {
+    return;
+  }
+
+  usize size = sizeof(MaterialParams) * materials.size();
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+  if (size > capacity) {
+    capacity = std::max(size, capacity * 2);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+  }
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, materials.data());
+  RENDER_STAT_UPLOAD(size);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  dirty = false;
+}
+
+void MaterialTable::bind(Shader &shader, i32 unit) {
+  upload();
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, ssbo);
+  textures.bind(unit);
+  shader.sampler("material_textures", unit);
+}
+
+string MaterialTable::glsl() {
+  return R"(
+        struct Material {
+            vec4 albedo;
+            vec4 emissive;
+            float roughness;
+            float metallic;
+            int albedo_layer;
+            int normal_layer;
+        };
+
+        layout(std430, binding = 4) readonly buffer Materials {
+            Material materials[];
+        };
+
+        uniform sampler2DArray material_textures;
+
+        // in the vertex shader the material comes from the draw's base
+        // instance: `flat out uint material_index = uint(gl_BaseInstance);`
+
+        vec4 material_albedo(Material m, vec2 uv) {
+            vec4 colour = m.albedo;
+            if (m.albedo_layer >= 0) {
+                colour *= texture(material_textures, vec3(uv, m.albedo_layer));
+            }
+            return colour;
+        }
+
+        vec3 material_normal(Material m, vec2 uv, mat3 tbn, vec3 normal) {
+            if (m.normal_layer < 0) {
+                return normal;
+            }
+
+            vec3 n = texture(material_textures, vec3(uv, m.normal_layer)).xyz;
+            return normalize(tbn * (n * 2.0 - 1.0));
+        }
+    )";
+}
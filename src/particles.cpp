@@ -0,0 +1,424 @@
+#include <rama/particles.hpp>
+
+#include <rama/jobs.hpp>
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+#include <chrono>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RAMA_PARTICLES_AVX2 1
+#endif
+
+namespace {
+
+// large enough to amortise dispatch, small enough to balance 1M particles
+constexpr u32 batch_size = 16384;
+
+struct Step {
+  f32 dt;
+  f32 damping;
+  Vec3f gravity;
+};
+
+using Streams = Array<f32 *, ParticlePool::stream_count>;
+
+u32 integrate_scalar(const Streams &s, u32 begin, u32 end, const Step &step) {
+  using P = ParticlePool;
+
+  for (u32 i = begin; i < end; i++) {
+    s[P::vx][i] = s[P::vx][i] * step.damping + step.gravity.x * step.dt;
+    s[P::vy][i] = s[P::vy][i] * step.damping + step.gravity.y * step.dt;
+    s[P::vz][i] = s[P::vz][i] * step.damping + step.gravity.z * step.dt;
+
+    s[P::px][i] += s[P::vx][i] * step.dt;
+    s[P::py][i] += s[P::vy][i] * step.dt;
+    s[P::pz][i] += s[P::vz][i] * step.dt;
+
+    s[P::life][i] -= step.dt;
+    s[P::size][i] += s[P::dsize][i] * step.dt;
+
+    s[P::r][i] += s[P::dr][i] * step.dt;
+    s[P::g][i] += s[P::dg][i] * step.dt;
+    s[P::b][i] += s[P::db][i] * step.dt;
+    s[P::a][i] += s[P::da][i] * step.dt;
+  }
+
+  return end;
+}
+
+#if RAMA_PARTICLES_AVX2
+__attribute__((target("avx2,fma"))) u32
+integrate_avx2(const Streams &s, u32 begin, u32 end, const Step &step) {
+  using P = ParticlePool;
+
+  __m256 dt = _mm256_set1_ps(step.dt);
+  __m256 damping = _mm256_set1_ps(step.damping);
+  __m256 gx = _mm256_set1_ps(step.gravity.x * step.dt);
+  __m256 gy = _mm256_set1_ps(step.gravity.y * step.dt);
+  __m256 gz = _mm256_set1_ps(step.gravity.z * step.dt);
+
+  // v' = v * damping + g * dt, p' = p + v' * dt, x' = x + dx * dt
+  auto velocity = [&](u32 v, u32 p, __m256 g, u32 i) {
+    __m256 vel = _mm256_fmadd_ps(_mm256_loadu_ps(s[v] + i), damping, g);
+    _mm256_storeu_ps(s[v] + i, vel);
+    _mm256_storeu_ps(s[p] + i,
+                     _mm256_fmadd_ps(vel, dt, _mm256_loadu_ps(s[p] + i)));
+  };
+
+  auto rate = [&](u32 x, u32 dx, u32 i) {
+    __m256 value = _mm256_loadu_ps(s[x] + i);
+    _mm256_storeu_ps(s[x] + i,
+                     _mm256_fmadd_ps(_mm256_loadu_ps(s[dx] + i), dt, value));
+  };
+
+  u32 i = begin;
+  for (; i + 8 <= end; i += 8) {
+    velocity(P::vx, P::px, gx, i);
+    velocity(P::vy, P::py, gy, i);
+    velocity(P::vz, P::pz, gz, i);
+
+    _mm256_storeu_ps(s[P::life] + i,
+                     _mm256_sub_ps(_mm256_loadu_ps(s[P::life] + i), dt));
+
+    rate(P::size, P::dsize, i);
+    rate(P::r, P::dr, i);
+    rate(P::g, P::dg, i);
+    rate(P::b, P::db, i);
+    rate(P::a, P::da, i);
+  }
+
+  return i;
+}
+
+bool has_avx2() {
+  static bool result =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return result;
+}
+#endif
+
+void integrate(const Streams &s, u32 begin, u32 end, const Step &step) {
+#if RAMA_PARTICLES_AVX2
+  if (has_avx2()) {
+    begin = integrate_avx2(s, begin, end, step);
+  }
+#endif
+  integrate_scalar(s, begin, end, step);
+}
+
+} // namespace
+
+ParticlePool ParticlePool::make(u32 capacity) {
+  ParticlePool result;
+  result.capacity = capacity;
+
+  for (auto &stream : result.streams) {
+    stream.resize(capacity);
+  }
+
+  return result;
+}
+
+f32 ParticlePool::random() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return (f32)(rng >> 8) / (f32)(1 << 24);
+}
+
+void ParticlePool::move(u32 from, u32 to) {
+  for (auto &stream : streams) {
+    stream[to] = stream[from];
+  }
+}
+
+void ParticlePool::spawn(const EmitterSettings &settings, u32 n) {
+  n = std::min(n, capacity - count);
+
+  for (u32 i = count; i < count + n; i++) {
+    f32 life_span = glm::mix(settings.life_min, settings.life_max, random());
+    f32 inverse = 1.0f / std::max(life_span, 1e-4f);
+
+    Vec3f jitter = Vec3f(random(), random(), random()) * 2.0f - 1.0f;
+    Vec3f vel = settings.velocity + jitter * settings.spread;
+    Vec4f colour = settings.colour_start;
+    Vec4f dcolour = (settings.colour_end - settings.colour_start) * inverse;
+
+    streams[px][i] = settings.pos.x;
+    streams[py][i] = settings.pos.y;
+    streams[pz][i] = settings.pos.z;
+    streams[vx][i] = vel.x;
+    streams[vy][i] = vel.y;
+    streams[vz][i] = vel.z;
+    streams[life][i] = life_span;
+    streams[size][i] = settings.size_start;
+    streams[dsize][i] = (settings.size_end - settings.size_start) * inverse;
+    streams[r][i] = colour.r;
+    streams[g][i] = colour.g;
+    streams[b][i] = colour.b;
+    streams[a][i] = colour.a;
+    streams[dr][i] = dcolour.r;
+    streams[dg][i] = dcolour.g;
+    streams[db][i] = dcolour.b;
+    streams[da][i] = dcolour.a;
+  }
+
+  count += n;
+}
+
+void ParticlePool::update(const EmitterSettings &settings, f32 dt) {
+  if (count == 0) {
+    return;
+  }
+
+  Streams s;
+  for (u32 i = 0; i < stream_count; i++) {
+    s[i] = streams[i].data();
+  }
+
+  Step step{dt, std::max(0.0f, 1.0f - settings.drag * dt), settings.gravity};
+
+  u32 batches = (count + batch_size - 1) / batch_size;
+  batch_alive.assign(batches, 0);
+
+  jobs::parallel_for(count, batch_size, [&](u32 begin, u32 end, u32) {
+    integrate(s, begin, end, step);
+
+    // swap dead particles with the last live one of this batch
+    u32 alive_end = end;
+    for (u32 i = begin; i < alive_end;) {
+      if (s[life][i] > 0.0f) {
+        i++;
+        continue;
+      }
+
+      alive_end--;
+      for (u32 k = 0; k < stream_count; k++) {
+        s[k][i] = s[k][alive_end];
+      }
+    }
+
+    batch_alive[begin / batch_size] = alive_end - begin;
+  });
+
+  close_gaps(batch_size);
+}
+
+// every batch is now [live..., dead...]. fill the dead tails of the early
+// batches with live particles taken from the end of the array.
+void ParticlePool::close_gaps(u32 batch) {
+  u32 total = 0;
+  for (u32 alive : batch_alive) {
+    total += alive;
+  }
+
+  auto is_alive = [&](i64 i) {
+    u32 b = i / batch;
+    return (u32)(i - (i64)b * batch) < batch_alive[b];
+  };
+
+  // first hole at or after i
+  auto next_hole = [&](i64 i) -> i64 {
+    while (i < count) {
+      u32 b = i / batch;
+      i64 hole = (i64)b * batch + batch_alive[b];
+      if (i < hole) {
+        i = hole;
+      }
+      if (i < std::min<i64>((i64)(b + 1) * batch, count)) {
+        return i;
+      }
+      i = (i64)(b + 1) * batch;
+    }
+    return count;
+  };
+
+  // last live particle at or before i
+  auto prev_alive = [&](i64 i) -> i64 {
+    while (i >= 0) {
+      if (is_alive(i)) {
+        return i;
+      }
+      u32 b = i / batch;
+      i = batch_alive[b] > 0 ? (i64)b * batch + batch_alive[b] - 1
+                             : (i64)b * batch - 1;
+    }
+    return -1;
+  };
+
+  i64 hole = next_hole(0);
+  i64 source = prev_alive((i64)count - 1);
+
+  while (hole < source) {
+    move(source, hole);
+    hole = next_hole(hole + 1);
+    source = prev_alive(source - 1);
+  }
+
+  count = total;
+}
+
+ParticleSystem ParticleSystem::make(u32 capacity) {
+  string vtx_shader = R"(
+        layout(location = 0) in vec4 instance_pos_size;
+        layout(location = 1) in vec4 instance_colour;
+
+        uniform mat4 perspective;
+        uniform mat4 view;
+
+        out vec4 colour;
+        out vec2 uv;
+
+        void main() {
+            vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+            vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+            vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+            vec3 world = instance_pos_size.xyz
+                       + (right * corner.x + up * corner.y) * instance_pos_size.w;
+
+            gl_Position = perspective * view * vec4(world, 1.0);
+            colour = instance_colour;
+            uv = corner;
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec4 colour;
+        in vec2 uv;
+
+        out vec4 fragColor;
+
+        void main() {
+            float falloff = 1.0 - smoothstep(0.5, 1.0, length(uv));
+            fragColor = vec4(colour.rgb, colour.a * falloff);
+        }
+    )";
+
+  ParticleSystem result;
+  result.pool = ParticlePool::make(capacity);
+  result.shader = Shader::make_with_version(vtx_shader, frg_shader);
+
+  glGenVertexArrays(1, &result.vao);
+  glBindVertexArray(result.vao);
+
+  glGenBuffers(1, &result.vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4f) * 2, (void *)0);
+  glVertexAttribDivisor(0, 1);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4f) * 2,
+                        (void *)sizeof(Vec4f));
+  glVertexAttribDivisor(1, 1);
+
+  glBindVertexArray(0);
+
+  return result;
+}
+
+void ParticleSystem::destroy() {
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  shader.destroy();
+}
+
+void ParticleSystem::burst(u32 n) { pool.spawn(settings, n); }
+
+void ParticleSystem::update(f32 dt) {
+  pool.update(settings, dt);
+
+  if (emitting) {
+    spawn_accumulator += settings.rate * dt;
+    u32 n = (u32)spawn_accumulator;
+    spawn_accumulator -= n;
+    pool.spawn(settings, n);
+  }
+}
+
+void ParticleSystem::draw(Mat4 perspective, Mat4 view) {
+  u32 count = pool.alive();
+  if (count == 0) {
+    return;
+  }
+
+  GPU_SCOPE("Particles");
+
+  // orphan the previous frame's storage and interleave straight into the
+  // new mapping from the worker threads
+  usize size = sizeof(Vec4f) * 2 * count;
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (size > vbo_capacity) {
+    vbo_capacity = std::max(size, vbo_capacity * 2);
+  }
+  glBufferData(GL_ARRAY_BUFFER, vbo_capacity, nullptr, GL_STREAM_DRAW);
+
+  Vec4f *mapped = (Vec4f *)glMapBufferRange(
+      GL_ARRAY_BUFFER, 0, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+  if (!mapped) {
+    engine::error("ParticleSystem: failed to map instance buffer");
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return;
+  }
+
+  using P = ParticlePool;
+  jobs::parallel_for(count, batch_size, [&](u32 begin, u32 end, u32) {
+    for (u32 i = begin; i < end; i++) {
+      mapped[i * 2 + 0] =
+          Vec4f(pool.stream(P::px)[i], pool.stream(P::py)[i],
+                pool.stream(P::pz)[i], std::max(0.0f, pool.stream(P::size)[i]));
+      mapped[i * 2 + 1] =
+          Vec4f(pool.stream(P::r)[i], pool.stream(P::g)[i],
+                pool.stream(P::b)[i], pool.stream(P::a)[i]);
+    }
+  });
+
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  RENDER_STAT_UPLOAD(size);
+
+  shader.bind();
+  shader.uniform("perspective", perspective);
+  shader.uniform("view", view);
+
+  glDepthMask(GL_FALSE);
+  glBindVertexArray(vao);
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, 2 * count);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+  glBindVertexArray(0);
+  glDepthMask(GL_TRUE);
+}
+
+f64 ParticleSystem::benchmark(u32 count, u32 frames) {
+  EmitterSettings settings;
+  // long lives so the pool stays full for the whole run
+  settings.life_min = 1000.0f;
+  settings.life_max = 2000.0f;
+
+  ParticlePool pool = ParticlePool::make(count);
+  pool.spawn(settings, count);
+
+  using Clock = std::chrono::steady_clock;
+
+  f64 total = 0;
+  for (u32 i = 0; i < frames; i++) {
+    auto start = Clock::now();
+    pool.update(settings, 1.0f / 60.0f);
+    total += std::chrono::duration<f64, std::milli>(Clock::now() - start)
+                 .count();
+  }
+
+  f64 average = frames > 0 ? total / frames : 0;
+  engine::info("Particles: {} particles, {} threads, {:.3f} ms per update",
+               pool.alive(), jobs::thread_count(), average);
+
+  return average;
+}
@@ -320,11 +320,29 @@ namespace physics3d {
         return result;
     }
 
+    Shape Shape::HeightField(const ArrayList<f32>& samples, u32 size, Vec3f offset, Vec3f scale) {
+        Shape result;
+
+        // the scale is baked into the shape, the body matrix stays unscaled
+        result.scale = Vec3f(1.0f);
+        result.settings = new JPH::HeightFieldShapeSettings(
+            samples.data(),
+            JPH::Vec3(offset.x, offset.y, offset.z),
+            JPH::Vec3(scale.x, scale.y, scale.z),
+            size
+        );
+
+        return result;
+    }
+
     Rigidbody Rigidbody::make(Shape shape, Vec3f pos, bool is_static) {
         Rigidbody result;
         result.is_static = is_static;
 
         JPH::ShapeSettings::ShapeResult shaperesult = shape.settings->Create();
+        if (shaperesult.HasError()) {
+            engine::error("Jolt: {}", shaperesult.GetError().c_str());
+        }
         result.ref = shaperesult.Get();
 
         delete shape.settings;
@@ -0,0 +1,562 @@
+#include <rama/postprocess.hpp>
+
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+namespace {
+
+enum UberFeature : u32 {
+  uber_bloom = 1 << 0,
+  uber_tonemap = 1 << 1,
+  uber_grading = 1 << 2,
+  uber_fxaa_luma = 1 << 3,
+};
+
+constexpr const char *uber_defines[] = {"BLOOM", "TONEMAP", "GRADING",
+                                        "FXAA_LUMA"};
+
+usize format_bytes(u32 format) {
+  switch (format) {
+  case GL_RGBA16F:
+    return 8;
+  case GL_RGBA32F:
+    return 16;
+  default:
+    return 4;
+  }
+}
+
+// one triangle covering the screen, shared by every pass
+const char *fullscreen_vertex = R"(
+        out vec2 uv;
+
+        void main() {
+            vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+            uv = p;
+            gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+        }
+    )";
+
+void blit(u32 from, u32 to, Vec2f size) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+  glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+} // namespace
+
+RenderTarget RenderTargetPool::acquire(u32 width, u32 height, u32 format) {
+  for (auto &entry : entries) {
+    RenderTarget &t = entry.target;
+    if (!entry.in_use && t.width == width && t.height == height &&
+        t.format == format) {
+      entry.in_use = true;
+      entry.last_used = frame;
+      return t;
+    }
+  }
+
+  RenderTarget target{0, 0, width, height, format};
+
+  glGenTextures(1, &target.texture);
+  glBindTexture(GL_TEXTURE_2D, target.texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &target.fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         target.texture, 0);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    engine::error("RenderTargetPool: {}x{} target is incomplete", width,
+                  height);
+  }
+
+  entries.push_back(Entry{target, true, frame});
+  return target;
+}
+
+void RenderTargetPool::release(const RenderTarget &target) {
+  for (auto &entry : entries) {
+    if (entry.target.fbo == target.fbo) {
+      entry.in_use = false;
+      return;
+    }
+  }
+}
+
+void RenderTargetPool::end_frame(u32 max_age) {
+  frame++;
+
+  // targets from a size the view no longer has
+  std::erase_if(entries, [&](Entry &entry) {
+    if (entry.in_use || frame - entry.last_used <= max_age) {
+      return false;
+    }
+
+    glDeleteFramebuffers(1, &entry.target.fbo);
+    glDeleteTextures(1, &entry.target.texture);
+    return true;
+  });
+}
+
+void RenderTargetPool::destroy() {
+  for (auto &entry : entries) {
+    glDeleteFramebuffers(1, &entry.target.fbo);
+    glDeleteTextures(1, &entry.target.texture);
+  }
+  entries.clear();
+}
+
+usize RenderTargetPool::bytes() {
+  usize total = 0;
+  for (auto &entry : entries) {
+    const RenderTarget &t = entry.target;
+    total += (usize)t.width * t.height * format_bytes(t.format);
+  }
+  return total;
+}
+
+PostProcess PostProcess::make() {
+  string downsample_shader = R"(
+        in vec2 uv;
+
+        uniform sampler2D source;
+        uniform vec2 texel;
+        uniform vec2 uv_scale;
+        uniform float prefilter;
+        uniform float threshold;
+
+        out vec4 fragColor;
+
+        vec3 tap(vec2 offset) {
+            vec2 p = uv * uv_scale + offset * texel;
+            return texture(source, clamp(p, texel * 0.5,
+                                         uv_scale - texel * 0.5)).rgb;
+        }
+
+        float luma(vec3 c) { return dot(c, vec3(0.2126, 0.7152, 0.0722)); }
+
+        void main() {
+            // 13 taps as five overlapping 2x2 boxes
+            vec3 a = tap(vec2(-2, 2)), b = tap(vec2(0, 2)), c = tap(vec2(2, 2));
+            vec3 d = tap(vec2(-2, 0)), e = tap(vec2(0, 0)), f = tap(vec2(2, 0));
+            vec3 g = tap(vec2(-2, -2)), h = tap(vec2(0, -2));
+            vec3 i = tap(vec2(2, -2));
+            vec3 j = tap(vec2(-1, 1)), k = tap(vec2(1, 1));
+            vec3 l = tap(vec2(-1, -1)), m = tap(vec2(1, -1));
+
+            vec3 boxes[5] = vec3[](
+                (j + k + l + m) * 0.25,
+                (a + b + d + e) * 0.25, (b + c + e + f) * 0.25,
+                (d + e + g + h) * 0.25, (e + f + h + i) * 0.25);
+            float weights[5] = float[](0.5, 0.125, 0.125, 0.125, 0.125);
+
+            vec3 colour = vec3(0.0);
+            float total = 0.0;
+            for (int n = 0; n < 5; n++) {
+                // the first pass weights boxes down by brightness so single
+                // bright pixels do not flicker into large blobs
+                float w = weights[n];
+                if (prefilter > 0.5) {
+                    w /= 1.0 + luma(boxes[n]);
+                }
+                colour += boxes[n] * w;
+                total += w;
+            }
+            colour /= total;
+
+            if (prefilter > 0.5) {
+                // soft knee threshold
+                float knee = threshold * 0.5;
+                float brightness = max(colour.r, max(colour.g, colour.b));
+                float soft = clamp(brightness - threshold + knee, 0.0,
+                                   2.0 * knee);
+                soft = soft * soft / (4.0 * knee + 1e-4);
+                colour *= max(soft, brightness - threshold)
+                        / max(brightness, 1e-4);
+            }
+
+            fragColor = vec4(colour, 1.0);
+        }
+    )";
+
+  string upsample_shader = R"(
+        in vec2 uv;
+
+        uniform sampler2D source;
+        uniform vec2 texel;
+
+        out vec4 fragColor;
+
+        void main() {
+            // 3x3 tent, added on top of the next larger level
+            vec3 c = texture(source, uv).rgb * 4.0;
+            c += texture(source, uv + vec2(-1, 0) * texel).rgb * 2.0;
+            c += texture(source, uv + vec2(1, 0) * texel).rgb * 2.0;
+            c += texture(source, uv + vec2(0, -1) * texel).rgb * 2.0;
+            c += texture(source, uv + vec2(0, 1) * texel).rgb * 2.0;
+            c += texture(source, uv + vec2(-1, -1) * texel).rgb;
+            c += texture(source, uv + vec2(1, -1) * texel).rgb;
+            c += texture(source, uv + vec2(-1, 1) * texel).rgb;
+            c += texture(source, uv + vec2(1, 1) * texel).rgb;
+
+            fragColor = vec4(c / 16.0, 1.0);
+        }
+    )";
+
+  string fxaa_shader = R"(
+        in vec2 uv;
+
+        uniform sampler2D source;
+        uniform vec2 texel;
+
+        out vec4 fragColor;
+
+        const float reduce_min = 1.0 / 128.0;
+        const float reduce_mul = 1.0 / 8.0;
+        const float span_max = 8.0;
+
+        void main() {
+            // luma was written to alpha by the uber pass
+            vec4 centre = texture(source, uv);
+            float nw = texture(source, uv + vec2(-1, -1) * texel).a;
+            float ne = texture(source, uv + vec2(1, -1) * texel).a;
+            float sw = texture(source, uv + vec2(-1, 1) * texel).a;
+            float se = texture(source, uv + vec2(1, 1) * texel).a;
+            float m = centre.a;
+
+            float lo = min(m, min(min(nw, ne), min(sw, se)));
+            float hi = max(m, max(max(nw, ne), max(sw, se)));
+
+            // most pixels are not on an edge, leave them after five taps
+            if (hi - lo < max(0.0312, hi * 0.125)) {
+                fragColor = vec4(centre.rgb, 1.0);
+                return;
+            }
+
+            vec2 dir = vec2(-((nw + ne) - (sw + se)), (nw + sw) - (ne + se));
+            float reduce = max((nw + ne + sw + se) * 0.25 * reduce_mul,
+                               reduce_min);
+            float scale = 1.0 / (min(abs(dir.x), abs(dir.y)) + reduce);
+            dir = clamp(dir * scale, -span_max, span_max) * texel;
+
+            vec3 a = 0.5 * (texture(source, uv + dir * (1.0 / 3.0 - 0.5)).rgb +
+                            texture(source, uv + dir * (2.0 / 3.0 - 0.5)).rgb);
+            vec3 b = a * 0.5 + 0.25 * (texture(source, uv - dir * 0.5).rgb +
+                                       texture(source, uv + dir * 0.5).rgb);
+
+            float luma_b = dot(b, vec3(0.299, 0.587, 0.114));
+            fragColor = vec4(luma_b < lo || luma_b > hi ? a : b, 1.0);
+        }
+    )";
+
+  PostProcess result;
+  result.downsample =
+      Shader::make_with_version(fullscreen_vertex, downsample_shader);
+  result.upsample =
+      Shader::make_with_version(fullscreen_vertex, upsample_shader);
+  result.fxaa_pass = Shader::make_with_version(fullscreen_vertex, fxaa_shader);
+
+  glGenVertexArrays(1, &result.vao);
+
+  return result;
+}
+
+void PostProcess::destroy() {
+  // the main loop must not run a destroyed chain
+  if (engine::get_post_process() == this) {
+    engine::set_post_process(nullptr);
+  }
+
+  pool.destroy();
+  downsample.destroy();
+  upsample.destroy();
+  fxaa_pass.destroy();
+
+  for (auto &[mask, shader] : uber_variants) {
+    shader.destroy();
+  }
+  uber_variants.clear();
+
+  glDeleteVertexArrays(1, &vao);
+}
+
+Shader &PostProcess::uber(u32 mask) {
+  if (auto it = uber_variants.find(mask); it != uber_variants.end()) {
+    return it->second;
+  }
+
+  string uber_shader = R"(
+        in vec2 uv;
+
+        uniform sampler2D scene;
+        uniform vec2 uv_scale;
+
+        uniform sampler2D bloom;
+        uniform float bloom_intensity;
+
+        uniform float exposure;
+
+        uniform float contrast;
+        uniform float saturation;
+        uniform vec3 tint;
+
+        out vec4 fragColor;
+
+        float luma(vec3 c) { return dot(c, vec3(0.2126, 0.7152, 0.0722)); }
+
+        void main() {
+            vec3 colour = texture(scene, uv * uv_scale).rgb;
+
+        #ifdef BLOOM
+            colour += texture(bloom, uv).rgb * bloom_intensity;
+        #endif
+
+        #ifdef TONEMAP
+            // Narkowicz's fit of the ACES filmic curve
+            colour *= exposure;
+            colour = clamp((colour * (2.51 * colour + 0.03)) /
+                           (colour * (2.43 * colour + 0.59) + 0.14), 0.0, 1.0);
+        #endif
+
+        #ifdef GRADING
+            colour *= tint;
+            colour = mix(vec3(luma(colour)), colour, saturation);
+            colour = max((colour - 0.18) * contrast + 0.18, 0.0);
+        #endif
+
+            colour = clamp(colour, 0.0, 1.0);
+
+        #ifdef FXAA_LUMA
+            fragColor = vec4(colour, dot(colour, vec3(0.299, 0.587, 0.114)));
+        #else
+            fragColor = vec4(colour, 1.0);
+        #endif
+        }
+    )";
+
+  string defines;
+  for (u32 i = 0; i < std::size(uber_defines); i++) {
+    if (mask & (1u << i)) {
+      defines += fmt::format("#define {} 1\n", uber_defines[i]);
+    }
+  }
+
+  Shader shader =
+      Shader::make_with_version(fullscreen_vertex, defines + uber_shader);
+  return uber_variants.emplace(mask, shader).first->second;
+}
+
+RenderTarget PostProcess::bloom(Framebuffer &source, Vec2f size) {
+  GPU_SCOPE("Bloom");
+
+  ArrayList<RenderTarget> levels;
+  Vec2u level_size = glm::max(Vec2u(size) / (bloom_quarter_res ? 4u : 2u),
+                              Vec2u(1));
+
+  for (u32 i = 0; i < std::max(bloom_levels, 1u); i++) {
+    levels.push_back(
+        pool.acquire(level_size.x, level_size.y, GL_R11F_G11F_B10F));
+    if (level_size.x < 2 || level_size.y < 2) {
+      break;
+    }
+    level_size /= 2u;
+  }
+
+  downsample.bind();
+  downsample.sampler("source", 0);
+  downsample.uniform("threshold", bloom_threshold);
+  glActiveTexture(GL_TEXTURE0);
+
+  for (u32 i = 0; i < levels.size(); i++) {
+    RenderTarget &target = levels[i];
+
+    Vec2f from_size, from_used;
+    if (i == 0) {
+      glBindTexture(GL_TEXTURE_2D, source.albedo);
+      from_size = Vec2f(source.width, source.height);
+      from_used = size;
+    } else {
+      glBindTexture(GL_TEXTURE_2D, levels[i - 1].texture);
+      from_size = from_used = Vec2f(levels[i - 1].width, levels[i - 1].height);
+    }
+
+    downsample.uniform("texel", 1.0f / from_size);
+    downsample.uniform("uv_scale", from_used / from_size);
+    downsample.uniform("prefilter", i == 0 ? 1.0f : 0.0f);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glViewport(0, 0, target.width, target.height);
+    RENDER_STAT(draw_calls, 1);
+    RENDER_STAT(triangles, 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+
+  upsample.bind();
+  upsample.sampler("source", 0);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+
+  for (u32 i = levels.size() - 1; i > 0; i--) {
+    RenderTarget &from = levels[i];
+    RenderTarget &to = levels[i - 1];
+
+    upsample.uniform("texel", 1.0f / Vec2f(from.width, from.height));
+    glBindTexture(GL_TEXTURE_2D, from.texture);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, to.fbo);
+    glViewport(0, 0, to.width, to.height);
+    RENDER_STAT(draw_calls, 1);
+    RENDER_STAT(triangles, 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    pool.release(from);
+  }
+
+  glDisable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  return levels[0];
+}
+
+void PostProcess::apply(Framebuffer &source, Framebuffer &destination) {
+  Vec2f size = engine::get_render_size();
+  bool in_place = source.fbo == destination.fbo;
+
+  u32 mask = 0;
+  mask |= bloom_enabled && bloom_intensity > 0.0f ? uber_bloom : 0;
+  mask |= tonemap ? uber_tonemap : 0;
+  mask |= grading ? uber_grading : 0;
+  mask |= fxaa ? uber_fxaa_luma : 0;
+
+  if (mask == 0) {
+    if (!in_place) {
+      blit(source.fbo, destination.fbo, size);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    pool.end_frame();
+    return;
+  }
+
+  GPU_SCOPE("Post Process");
+
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glBindVertexArray(vao);
+
+  RenderTarget bloom_target;
+  if (mask & uber_bloom) {
+    bloom_target = bloom(source, size);
+  }
+
+  // the uber pass can only write straight to the destination when FXAA does
+  // not need its output and it is not reading the destination
+  RenderTarget ldr;
+  bool uber_to_destination = !fxaa && !in_place;
+  if (!uber_to_destination) {
+    ldr = pool.acquire(size.x, size.y, GL_RGBA8);
+  }
+
+  {
+    GPU_SCOPE("Uber");
+
+    Shader &shader = uber(mask);
+    shader.bind();
+    shader.uniform("uv_scale", size / Vec2f(source.width, source.height));
+    shader.uniform("bloom_intensity", bloom_intensity);
+    shader.uniform("exposure", exposure);
+    shader.uniform("contrast", contrast);
+    shader.uniform("saturation", saturation);
+    shader.uniform("tint", tint);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.albedo);
+    shader.sampler("scene", 0);
+
+    if (mask & uber_bloom) {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, bloom_target.texture);
+      shader.sampler("bloom", 1);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER,
+                      uber_to_destination ? destination.fbo : ldr.fbo);
+    glViewport(0, 0, size.x, size.y);
+    RENDER_STAT(draw_calls, 1);
+    RENDER_STAT(triangles, 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+
+  if (fxaa) {
+    GPU_SCOPE("FXAA");
+
+    fxaa_pass.bind();
+    fxaa_pass.uniform("texel", 1.0f / size);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, ldr.texture);
+    fxaa_pass.sampler("source", 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, destination.fbo);
+    glViewport(0, 0, size.x, size.y);
+    RENDER_STAT(draw_calls, 1);
+    RENDER_STAT(triangles, 1);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  } else if (in_place) {
+    blit(ldr.fbo, destination.fbo, size);
+  }
+
+  if (ldr.fbo) {
+    pool.release(ldr);
+  }
+  if (bloom_target.fbo) {
+    pool.release(bloom_target);
+  }
+  pool.end_frame();
+
+  glBindVertexArray(0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glEnable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void PostProcess::draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ImGui::Begin("Post Process");
+
+  ImGui::Checkbox("Bloom", &bloom_enabled);
+  ImGui::SliderFloat("Threshold", &bloom_threshold, 0.0f, 4.0f);
+  ImGui::SliderFloat("Intensity", &bloom_intensity, 0.0f, 1.0f);
+  ImGui::Checkbox("Quarter resolution", &bloom_quarter_res);
+
+  ImGui::Separator();
+  ImGui::Checkbox("Tonemap", &tonemap);
+  ImGui::SliderFloat("Exposure", &exposure, 0.1f, 4.0f);
+
+  ImGui::Separator();
+  ImGui::Checkbox("Grading", &grading);
+  ImGui::SliderFloat("Contrast", &contrast, 0.5f, 2.0f);
+  ImGui::SliderFloat("Saturation", &saturation, 0.0f, 2.0f);
+  ImGui::ColorEdit3("Tint", &tint.x);
+
+  ImGui::Separator();
+  ImGui::Checkbox("FXAA", &fxaa);
+
+  ImGui::Separator();
+  ImGui::Text("Uber variants: %u", variant_count());
+  ImGui::Text("Pooled targets: %u (%.1f MB)", pool.count(),
+              pool.bytes() / (1024.0 * 1024.0));
+
+  ImGui::End();
+}
@@ -0,0 +1,215 @@
+#include <rama/profiler.hpp>
+
+#include <rama/engine.hpp>
+
+namespace {
+
+// queries are read back this many frames after they were issued
+constexpr u32 frames_in_flight = 3;
+
+struct Marker {
+  string name;
+  u32 depth;
+  u32 start, end;
+};
+
+struct Frame {
+  ArrayList<u32> pool;
+  u32 used = 0;
+
+  ArrayList<Marker> markers;
+  u32 start = 0, end = 0;
+  bool pending = false;
+};
+
+Array<Frame, frames_in_flight> frames;
+u32 current = 0;
+bool in_frame = false;
+
+Stack<u32> open;
+
+ArrayList<profiler::PassTiming> latest;
+f64 latest_frame_ms = 0;
+
+u32 timestamp(Frame &frame) {
+  if (frame.used == frame.pool.size()) {
+    u32 query;
+    glGenQueries(1, &query);
+    frame.pool.push_back(query);
+  }
+
+  u32 query = frame.pool[frame.used++];
+  glQueryCounter(query, GL_TIMESTAMP);
+  return query;
+}
+
+u64 read(u32 query) {
+  u64 result = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+  return result;
+}
+
+void collect(Frame &frame) {
+  if (!frame.pending) {
+    return;
+  }
+  frame.pending = false;
+
+  // timestamps resolve in order, so if the last one is ready they all are.
+  // if the GPU is further behind than the ring, this frame is dropped.
+  i32 available = 0;
+  glGetQueryObjectiv(frame.end, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    return;
+  }
+
+  latest.clear();
+  for (auto &marker : frame.markers) {
+    f64 ms = (f64)(read(marker.end) - read(marker.start)) / 1e6;
+    latest.push_back(profiler::PassTiming{marker.name, ms, marker.depth});
+  }
+
+  latest_frame_ms = (f64)(read(frame.end) - read(frame.start)) / 1e6;
+}
+
+sol::table lib(sol::this_state state) {
+  sol::state_view luaview(state);
+  auto module = luaview.create_table();
+
+  module.set_function("Begin", &profiler::begin);
+  module.set_function("End", &profiler::end);
+  module.set_function("FrameMS", &profiler::frame_ms);
+  module.set_function("DrawPanel", &profiler::draw_panel);
+
+  module.set_function("GetResults", [](sol::this_state state) {
+    sol::state_view luaview(state);
+    auto table = luaview.create_table();
+
+    for (auto &timing : profiler::results()) {
+      auto entry = luaview.create_table();
+      entry["name"] = timing.name;
+      entry["ms"] = timing.ms;
+      entry["depth"] = timing.depth;
+      table.add(entry);
+    }
+
+    return table;
+  });
+
+  return module;
+}
+
+} // namespace
+
+namespace profiler {
+
+void init() {
+  for (auto &frame : frames) {
+    frame = Frame{};
+  }
+  current = 0;
+}
+
+void shutdown() {
+  for (auto &frame : frames) {
+    if (!frame.pool.empty()) {
+      glDeleteQueries(frame.pool.size(), frame.pool.data());
+    }
+    frame = Frame{};
+  }
+}
+
+void begin_frame() {
+  current = (current + 1) % frames_in_flight;
+
+  Frame &frame = frames[current];
+  collect(frame);
+
+  frame.used = 0;
+  frame.markers.clear();
+  frame.start = timestamp(frame);
+
+  open = {};
+  in_frame = true;
+}
+
+void end_frame() {
+  if (!in_frame) {
+    return;
+  }
+
+  if (!open.empty()) {
+    engine::warning("profiler: {} scope(s) left open at end of frame",
+                    open.size());
+    while (!open.empty()) {
+      end();
+    }
+  }
+
+  Frame &frame = frames[current];
+  frame.end = timestamp(frame);
+  frame.pending = true;
+
+  in_frame = false;
+}
+
+void begin(string name) {
+  if (!in_frame) {
+    return;
+  }
+
+  Frame &frame = frames[current];
+  u32 start = timestamp(frame);
+  frame.markers.push_back(Marker{name, (u32)open.size(), start, start});
+  open.push(frame.markers.size() - 1);
+}
+
+void end() {
+  if (!in_frame || open.empty()) {
+    return;
+  }
+
+  Frame &frame = frames[current];
+  frame.markers[open.top()].end = timestamp(frame);
+  open.pop();
+}
+
+const ArrayList<PassTiming> &results() { return latest; }
+
+f64 frame_ms() { return latest_frame_ms; }
+
+void draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ImGui::Begin("GPU Profiler");
+
+  ImGui::Text("Frame: %.3f ms", latest_frame_ms);
+  ImGui::Separator();
+
+  if (ImGui::BeginTable("passes", 2, ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("Pass");
+    ImGui::TableSetupColumn("GPU ms", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableHeadersRow();
+
+    for (auto &timing : latest) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%*s%s", (i32)timing.depth * 2, "", timing.name.c_str());
+
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", timing.ms);
+    }
+
+    ImGui::EndTable();
+  }
+
+  ImGui::End();
+}
+
+void RegisterLuaModule(sol::state &state) {
+  state.require("profiler", sol::c_call<decltype(&lib), &lib>, false);
+}
+
+} // namespace profiler
@@ -0,0 +1,117 @@
+#include <rama/render_stats.hpp>
+
+#include <rama/engine.hpp>
+
+#include <algorithm>
+
+namespace {
+
+constexpr u32 history_size = 240;
+
+struct History {
+  const char *name;
+  u64 render_stats::Counters::*counter;
+  Array<f32, history_size> values = {};
+};
+
+Array<History, 7> history = {{
+    {"Draw calls", &render_stats::Counters::draw_calls},
+    {"Triangles", &render_stats::Counters::triangles},
+    {"State changes", &render_stats::Counters::state_changes},
+    {"Uniform uploads", &render_stats::Counters::uniform_uploads},
+    {"Buffer uploads", &render_stats::Counters::buffer_uploads},
+    {"Buffer bytes", &render_stats::Counters::buffer_bytes},
+    {"Texture binds", &render_stats::Counters::texture_binds},
+}};
+u32 history_next = 0;
+
+render_stats::Counters latest;
+
+sol::table lib(sol::this_state state) {
+  sol::state_view luaview(state);
+  auto module = luaview.create_table();
+
+  module.set_function("IsEnabled", &render_stats::enabled);
+  module.set_function("DrawPanel", &render_stats::draw_panel);
+
+  module.set_function("GetCounters", [](sol::this_state state) {
+    sol::state_view luaview(state);
+    auto table = luaview.create_table();
+
+    const render_stats::Counters &c = render_stats::last_frame();
+    table["draw_calls"] = c.draw_calls;
+    table["triangles"] = c.triangles;
+    table["state_changes"] = c.state_changes;
+    table["uniform_uploads"] = c.uniform_uploads;
+    table["buffer_uploads"] = c.buffer_uploads;
+    table["buffer_bytes"] = c.buffer_bytes;
+    table["texture_binds"] = c.texture_binds;
+
+    return table;
+  });
+
+  return module;
+}
+
+} // namespace
+
+namespace render_stats {
+
+#if defined(RAMA_RENDER_STATS_ENABLED)
+Counters current;
+#endif
+
+void end_frame() {
+#if defined(RAMA_RENDER_STATS_ENABLED)
+  latest = current;
+  current = Counters{};
+
+  for (auto &entry : history) {
+    entry.values[history_next] = (f32)(latest.*entry.counter);
+  }
+  history_next = (history_next + 1) % history_size;
+#endif
+}
+
+const Counters &last_frame() { return latest; }
+
+void draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration |
+                           ImGuiWindowFlags_AlwaysAutoResize |
+                           ImGuiWindowFlags_NoFocusOnAppearing |
+                           ImGuiWindowFlags_NoNav;
+  ImGui::SetNextWindowBgAlpha(0.6f);
+  ImGui::Begin("Render Stats", nullptr, flags);
+
+  if (!enabled()) {
+    ImGui::TextUnformatted("Render stats are compiled out of this build");
+    ImGui::End();
+    return;
+  }
+
+  for (auto &entry : history) {
+    u64 value = latest.*entry.counter;
+
+    f32 peak = 1.0f;
+    for (f32 v : entry.values) {
+      peak = std::max(peak, v);
+    }
+
+    string overlay = fmt::format("{}: {}", entry.name, value);
+    ImGui::PlotLines(fmt::format("##{}", entry.name).c_str(),
+                     entry.values.data(), history_size, history_next,
+                     overlay.c_str(), 0.0f, peak * 1.1f, ImVec2(240, 36));
+  }
+
+  ImGui::End();
+}
+
+void RegisterLuaModule(sol::state &state) {
+  state.require("render_stats", sol::c_call<decltype(&lib), &lib>, false);
+}
+
+} // namespace render_stats
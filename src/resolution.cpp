@@ -0,0 +1,217 @@
+#include <rama/resolution.hpp>
+
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+namespace {
+
+bool enabled = false;
+f32 target_ms = 1000.0f / 60.0f;
+f32 min_scale = 0.5f, max_scale = 1.0f;
+f32 sharpness = 0.4f;
+
+f32 scale = 1.0f;
+f32 smoothed_ms = 0.0f;
+
+constexpr u32 history_size = 240;
+Array<f32, history_size> scale_history = {};
+u32 history_next = 0;
+
+// the budget band the scale is left alone in, as fractions of target_ms
+constexpr f32 hold_low = 0.8f, hold_high = 1.05f;
+constexpr f32 aim = 0.9f;
+constexpr f32 max_drop = 0.05f, max_rise = 0.01f;
+
+Shader shader;
+u32 vao = 0;
+
+sol::table lib(sol::this_state state) {
+  sol::state_view luaview(state);
+  auto module = luaview.create_table();
+
+  module.set_function("SetEnabled", &resolution::set_enabled);
+  module.set_function("IsEnabled", &resolution::is_enabled);
+  module.set_function("SetTargetMS", &resolution::set_target_ms);
+  module.set_function("GetTargetMS", &resolution::get_target_ms);
+  module.set_function("SetScaleRange", &resolution::set_scale_range);
+  module.set_function("SetSharpness", &resolution::set_sharpness);
+  module.set_function("GetScale", &resolution::get_scale);
+  module.set_function("DrawPanel", &resolution::draw_panel);
+
+  return module;
+}
+
+} // namespace
+
+namespace resolution {
+
+void init() {
+  string vtx_shader = R"(
+        out vec2 uv;
+
+        void main() {
+            // one triangle covering the screen
+            vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+            uv = p;
+            gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec2 uv;
+
+        uniform sampler2D source;
+        uniform vec2 uv_scale;
+        uniform vec2 texel;
+        uniform float sharpness;
+
+        out vec4 fragColor;
+
+        vec3 tap(vec2 p) {
+            // stay inside the drawn region
+            return texture(source, clamp(p, texel * 0.5,
+                                         uv_scale - texel * 0.5)).rgb;
+        }
+
+        void main() {
+            vec2 p = uv * uv_scale;
+
+            vec3 c = tap(p);
+            vec3 n = tap(p + vec2(0.0, texel.y));
+            vec3 s = tap(p - vec2(0.0, texel.y));
+            vec3 e = tap(p + vec2(texel.x, 0.0));
+            vec3 w = tap(p - vec2(texel.x, 0.0));
+
+            vec3 lo = min(c, min(min(n, s), min(e, w)));
+            vec3 hi = max(c, max(max(n, s), max(e, w)));
+
+            // contrast adaptive: edges that are already hard get less
+            vec3 amount = sqrt(clamp(min(lo, 1.0 - hi) / max(hi, 1e-4),
+                                     0.0, 1.0)) * sharpness;
+
+            vec3 sharpened = c + (4.0 * c - n - s - e - w) * amount * 0.25;
+            fragColor = vec4(clamp(sharpened, lo, hi), 1.0);
+        }
+    )";
+
+  shader = Shader::make_with_version(vtx_shader, frg_shader);
+  glGenVertexArrays(1, &vao);
+}
+
+void shutdown() {
+  shader.destroy();
+  glDeleteVertexArrays(1, &vao);
+}
+
+void set_enabled(bool value) {
+  enabled = value;
+  smoothed_ms = 0.0f;
+  if (!enabled) {
+    scale = 1.0f;
+  }
+}
+
+bool is_enabled() { return enabled; }
+
+void set_target_ms(f32 ms) { target_ms = std::max(0.1f, ms); }
+
+f32 get_target_ms() { return target_ms; }
+
+void set_scale_range(f32 min, f32 max) {
+  min_scale = std::clamp(min, 0.1f, 1.0f);
+  max_scale = std::clamp(max, min_scale, 1.0f);
+  scale = std::clamp(scale, min_scale, max_scale);
+}
+
+void set_sharpness(f32 value) { sharpness = std::clamp(value, 0.0f, 1.0f); }
+
+f32 get_scale() { return scale; }
+
+bool is_active() { return enabled || scale != 1.0f; }
+
+void update(f32 frame_ms) {
+  if (!enabled) {
+    return;
+  }
+
+  // GPU time is what resolution changes, frame time may include vsync waits
+  f32 gpu_ms = (f32)profiler::frame_ms();
+  f32 measured = gpu_ms > 0.0f ? gpu_ms : frame_ms;
+
+  if (smoothed_ms <= 0.0f) {
+    smoothed_ms = measured;
+  } else {
+    smoothed_ms += (measured - smoothed_ms) * 0.1f;
+  }
+
+  if (smoothed_ms > target_ms * hold_high ||
+      smoothed_ms < target_ms * hold_low) {
+    // pixel cost goes with the square of the scale
+    f32 desired =
+        scale * std::sqrt(target_ms * aim / std::max(smoothed_ms, 0.01f));
+    scale += std::clamp(desired - scale, -max_drop, max_rise);
+    scale = std::clamp(scale, min_scale, max_scale);
+  }
+
+  scale_history[history_next] = scale;
+  history_next = (history_next + 1) % history_size;
+}
+
+void upscale(Framebuffer &source, Framebuffer &output) {
+  GPU_SCOPE("Upscale");
+
+  Vec2f size = engine::get_render_size();
+
+  glBindFramebuffer(GL_FRAMEBUFFER, output.fbo);
+  glViewport(0, 0, output.width, output.height);
+  glDisable(GL_DEPTH_TEST);
+
+  shader.bind();
+  shader.uniform("uv_scale", size / Vec2f(source.width, source.height));
+  shader.uniform("texel", 1.0f / Vec2f(source.width, source.height));
+  shader.uniform("sharpness", sharpness);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, source.albedo);
+  shader.sampler("source", 0);
+
+  glBindVertexArray(vao);
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, 1);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+
+  glEnable(GL_DEPTH_TEST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ImGui::Begin("Dynamic Resolution");
+
+  bool value = enabled;
+  if (ImGui::Checkbox("Enabled", &value)) {
+    set_enabled(value);
+  }
+
+  ImGui::SliderFloat("Target ms", &target_ms, 4.0f, 50.0f);
+  ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 1.0f);
+
+  Vec2f size = engine::get_render_size();
+  ImGui::Text("Scale: %.2f (%.0fx%.0f)", scale, size.x, size.y);
+  ImGui::Text("Frame: %.2f ms smoothed", smoothed_ms);
+
+  ImGui::PlotLines("##scale", scale_history.data(), history_size,
+                   history_next, nullptr, 0.0f, 1.0f, ImVec2(0, 60));
+
+  ImGui::End();
+}
+
+void RegisterLuaModule(sol::state &state) {
+  state.require("resolution", sol::c_call<decltype(&lib), &lib>, false);
+}
+
+} // namespace resolution
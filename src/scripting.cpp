@@ -1,7 +1,28 @@
 #include <rama/scripting.hpp>
 
+#include <rama/animation.hpp>
+#include <rama/arena.hpp>
+#include <rama/capture.hpp>
+#include <rama/drawlist.hpp>
 #include <rama/engine.hpp>
+#include <rama/gltf.hpp>
+#include <rama/gpu_memory.hpp>
+#include <rama/impostor.hpp>
+#include <rama/lighting.hpp>
+#include <rama/lightmap.hpp>
+#include <rama/material.hpp>
+#include <rama/particles.hpp>
 #include <rama/physics3d.hpp>
+#include <rama/postprocess.hpp>
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+#include <rama/resolution.hpp>
+#include <rama/shaders.hpp>
+#include <rama/shadows.hpp>
+#include <rama/terrain.hpp>
+#include <rama/text.hpp>
+#include <rama/tilemap.hpp>
+#include <rama/transform.hpp>
 
 #include <imgui.h>
 #include <backends/imgui_impl_sdl3.h>
@@ -9,6 +30,9 @@
 #include <misc/cpp/imgui_stdlib.h>
 
 sol::state lua_state;
+// the engine only keeps a raw pointer to the chain, so hold the userdata
+// here until the script replaces it
+sol::object post_process_ref;
 
 bool check_lua_object(sol::object obj) {
     if(!obj.valid()) {
@@ -54,12 +78,54 @@ sol::table libEngine(sol::this_state state) {
     auto module = luaview.create_table();
 
     module.set_function("DeltaTime", &engine::DeltaTime);
+    module.set_function("RawDeltaTime", &engine::RawDeltaTime);
+
+    module.new_enum("VSync",
+        "Off", engine::VSync::off,
+        "On", engine::VSync::on,
+        "Adaptive", engine::VSync::adaptive
+    );
+    module.set_function("SetVSync", &engine::set_vsync);
+    module.set_function("GetVSync", &engine::get_vsync);
+    module.set_function("SetTargetFPS", &engine::set_target_fps);
+    module.set_function("GetTargetFPS", &engine::get_target_fps);
+    module.set_function("SetMaxDeltaTime", &engine::set_max_delta_time);
+    module.set_function("SetDeltaTimeSmoothing", &engine::set_delta_time_smoothing);
+
+    module.set_function("GetFrameStats", [](sol::this_state state) {
+        sol::state_view luaview(state);
+        engine::FrameStats stats = engine::get_frame_stats();
+
+        auto table = luaview.create_table();
+        table["average"] = stats.average;
+        table["p50"] = stats.p50;
+        table["p95"] = stats.p95;
+        table["p99"] = stats.p99;
+        table["max"] = stats.max;
+        table["samples"] = stats.samples;
+        return table;
+    });
 
     module.set_function("Info", [](string msg) { engine::info("{}", msg); });
     module.set_function("Warning", [](string msg) { engine::warning("{}", msg); });
     module.set_function("Error", [](string msg) { engine::error("{}", msg); });
 
     module.set_function("GetGlslVersion", &engine::get_GLSLVersion);
+    module.set_function("IsHeadless", &engine::is_headless);
+    module.set_function("IsShipping", &engine::is_shipping);
+    module.set_function("EnableImGui", &engine::enable_imgui);
+    module.set_function("SetPostProcess", [](sol::object object) {
+        if (!object.is<PostProcess>()) {
+            if (object.valid()) {
+                engine::error("SetPostProcess: expected a PostProcess or nil");
+            }
+            post_process_ref = sol::object();
+            engine::set_post_process(nullptr);
+            return;
+        }
+        post_process_ref = object;
+        engine::set_post_process(&object.as<PostProcess &>());
+    });
 
     module["WorldForward"] = engine::WorldForward; 
     module["WorldRight"] = engine::WorldRight; 
@@ -105,7 +171,10 @@ sol::table libGFX(sol::this_state state) {
         "load", &Mesh::load,
         "make", &Mesh::make,
         "destroy", &Mesh::destroy,
-        "draw", &Mesh::draw
+        "draw", &Mesh::draw,
+        "draw_instanced", &Mesh::draw_instanced,
+        "skinned", &Mesh::skinned,
+        "has_uv2", &Mesh::has_uv2
     );
 
     sol::constructors<Shader()> Shader_ctors;
@@ -120,8 +189,9 @@ sol::table libGFX(sol::this_state state) {
             sol::resolve<void(string,Vec2f)>(&Shader::uniform),
             sol::resolve<void(string,Vec2f)>(&Shader::uniform),
             sol::resolve<void(string,f32)>(&Shader::uniform),
-            sol::resolve<void(string,Texture)>(&Shader::uniform)
-        )
+            sol::resolve<void(string,const Texture&)>(&Shader::uniform)
+        ),
+        "sampler", &Shader::sampler
     );
     
     sol::constructors<Texture()> Texture_ctors;
@@ -132,6 +202,518 @@ sol::table libGFX(sol::this_state state) {
         "bind", &Texture::bind
     );
 
+    sol::constructors<DrawList()> DrawList_ctors;
+    module.new_usertype<DrawList>("DrawList",
+        DrawList_ctors,
+        "make", &DrawList::make,
+        "destroy", &DrawList::destroy,
+        "add", sol::overload(
+            sol::resolve<void(Mesh&,Shader&,Mat4)>(&DrawList::add),
+            sol::resolve<void(Mesh&,Shader&,Mat4,u32)>(&DrawList::add)
+        ),
+        "clear", &DrawList::clear,
+        "build", &DrawList::build,
+        "submit", &DrawList::submit,
+
+        "partition_size", &DrawList::partition_size,
+        "visible", sol::readonly(&DrawList::visible),
+        "culled", sol::readonly(&DrawList::culled)
+    );
+
+    sol::constructors<ClusteredLighting()> ClusteredLighting_ctors;
+    module.new_usertype<ClusteredLighting>("ClusteredLighting",
+        ClusteredLighting_ctors,
+        "make", &ClusteredLighting::make,
+        "destroy", &ClusteredLighting::destroy,
+        "add_point", &ClusteredLighting::add_point,
+        "add_spot", &ClusteredLighting::add_spot,
+        "clear", &ClusteredLighting::clear,
+        "update", &ClusteredLighting::update,
+        "bind", &ClusteredLighting::bind,
+        "apply", &ClusteredLighting::apply,
+        "glsl", &ClusteredLighting::glsl
+    );
+
+    sol::constructors<CascadedShadowMap()> CascadedShadowMap_ctors;
+    module.new_usertype<CascadedShadowMap>("CascadedShadowMap",
+        CascadedShadowMap_ctors,
+        "make", &CascadedShadowMap::make,
+        "destroy", &CascadedShadowMap::destroy,
+        "update", &CascadedShadowMap::update,
+        "render", &CascadedShadowMap::render,
+        "invalidate", &CascadedShadowMap::invalidate,
+        "bind", &CascadedShadowMap::bind,
+        "apply", &CascadedShadowMap::apply,
+        "glsl", &CascadedShadowMap::glsl,
+        "cascade_count", &CascadedShadowMap::cascade_count,
+        "light_matrix", &CascadedShadowMap::light_matrix,
+
+        "lambda", &CascadedShadowMap::lambda,
+        "margin", &CascadedShadowMap::margin,
+        "max_distance", &CascadedShadowMap::max_distance,
+        "depth_range", &CascadedShadowMap::depth_range
+    );
+
+    module.new_usertype<MaterialParams>("MaterialParams",
+        sol::constructors<MaterialParams()>(),
+        "albedo", &MaterialParams::albedo,
+        "emissive", &MaterialParams::emissive,
+        "roughness", &MaterialParams::roughness,
+        "metallic", &MaterialParams::metallic,
+        "albedo_layer", &MaterialParams::albedo_layer,
+        "normal_layer", &MaterialParams::normal_layer
+    );
+
+    sol::constructors<MaterialTable()> MaterialTable_ctors;
+    module.new_usertype<MaterialTable>("MaterialTable",
+        MaterialTable_ctors,
+        "make", &MaterialTable::make,
+        "destroy", &MaterialTable::destroy,
+        "add", &MaterialTable::add,
+        "set", &MaterialTable::set,
+        "get", &MaterialTable::get,
+        "texture", sol::resolve<i32(string)>(&MaterialTable::texture),
+        "count", &MaterialTable::count,
+        "upload", &MaterialTable::upload,
+        "bind", &MaterialTable::bind,
+        "glsl", &MaterialTable::glsl
+    );
+
+    module.new_usertype<TransformHandle>("TransformHandle",
+        sol::constructors<TransformHandle()>(),
+        "valid", &TransformHandle::valid,
+        "id", sol::readonly(&TransformHandle::id)
+    );
+
+    sol::constructors<TransformSystem()> TransformSystem_ctors;
+    module.new_usertype<TransformSystem>("TransformSystem",
+        TransformSystem_ctors,
+        "make", &TransformSystem::make,
+        "destroy", &TransformSystem::destroy,
+        "create", sol::overload(
+            sol::resolve<TransformHandle()>(&TransformSystem::create),
+            sol::resolve<TransformHandle(TransformHandle)>(&TransformSystem::create)
+        ),
+        "remove", &TransformSystem::remove,
+        "set_parent", &TransformSystem::set_parent,
+        "get_parent", &TransformSystem::get_parent,
+
+        "set_position", &TransformSystem::set_position,
+        "set_scale", &TransformSystem::set_scale,
+        "get_position", &TransformSystem::get_position,
+        "get_scale", &TransformSystem::get_scale,
+
+        // euler angles in degrees on the Lua side
+        "set_rotation", [](TransformSystem& self, TransformHandle handle, Vec3f euler) {
+            self.set_rotation(handle, Quat(glm::radians(euler)));
+        },
+        "get_rotation", [](TransformSystem& self, TransformHandle handle) {
+            return glm::degrees(glm::eulerAngles(self.get_rotation(handle)));
+        },
+
+        "get_world", &TransformSystem::get_world,
+        "count", &TransformSystem::count,
+        "update", &TransformSystem::update
+    );
+
+    module.new_usertype<ArenaStats>("ArenaStats",
+        "meshes", sol::readonly(&ArenaStats::meshes),
+        "vertex_capacity", sol::readonly(&ArenaStats::vertex_capacity),
+        "vertex_used", sol::readonly(&ArenaStats::vertex_used),
+        "vertex_free_blocks", sol::readonly(&ArenaStats::vertex_free_blocks),
+        "vertex_fragmentation", sol::readonly(&ArenaStats::vertex_fragmentation),
+        "index_capacity", sol::readonly(&ArenaStats::index_capacity),
+        "index_used", sol::readonly(&ArenaStats::index_used),
+        "index_free_blocks", sol::readonly(&ArenaStats::index_free_blocks),
+        "index_fragmentation", sol::readonly(&ArenaStats::index_fragmentation),
+        "defragmentations", sol::readonly(&ArenaStats::defragmentations)
+    );
+
+    sol::constructors<GeometryArena()> GeometryArena_ctors;
+    module.new_usertype<GeometryArena>("GeometryArena",
+        GeometryArena_ctors,
+        "make", sol::overload(
+            []() { return GeometryArena::make(); },
+            [](u32 vertices, u32 indices) {
+                return GeometryArena::make(vertices, indices);
+            }
+        ),
+        "destroy", &GeometryArena::destroy,
+        "add", [](GeometryArena &arena, const Mesh &mesh) {
+            return arena.add(mesh);
+        },
+        "remove", &GeometryArena::remove,
+        "defragment", &GeometryArena::defragment,
+        "bind", &GeometryArena::bind,
+        "draw", sol::overload(
+            [](GeometryArena &arena, u32 mesh) { arena.draw(mesh); },
+            [](GeometryArena &arena, u32 mesh, u32 instances, u32 base) {
+                arena.draw(mesh, instances, base);
+            }
+        ),
+        "stats", &GeometryArena::stats,
+        "draw_panel", &GeometryArena::draw_panel,
+        "glsl", &GeometryArena::glsl
+    );
+
+    sol::constructors<ShaderVariants()> ShaderVariants_ctors;
+    module.new_usertype<ShaderVariants>("ShaderVariants",
+        ShaderVariants_ctors,
+        "load", &ShaderVariants::load,
+        "destroy", &ShaderVariants::destroy,
+        "get", [](ShaderVariants &variants, sol::table features) -> Shader & {
+            ArrayList<string> names;
+            for (auto &[key, value] : features) {
+                names.push_back(value.as<string>());
+            }
+            return variants.get(names);
+        },
+        "variant_count", &ShaderVariants::variant_count,
+        "compiled", sol::readonly(&ShaderVariants::compiled),
+        "disk_hits", sol::readonly(&ShaderVariants::disk_hits)
+    );
+
+    sol::constructors<Terrain()> Terrain_ctors;
+    module.new_usertype<Terrain>("Terrain",
+        Terrain_ctors,
+        "load", sol::overload(
+            [](string path, f32 spacing, f32 height_scale) {
+                return Terrain::load(path, spacing, height_scale);
+            },
+            [](string path, f32 spacing, f32 height_scale, u32 levels,
+               u32 grid) {
+                return Terrain::load(path, spacing, height_scale, levels,
+                                     grid);
+            }
+        ),
+        "destroy", &Terrain::destroy,
+        "update", &Terrain::update,
+        "draw", &Terrain::draw,
+        "height_at", &Terrain::height_at,
+        "shape", &Terrain::shape,
+        "vertex_count", &Terrain::vertex_count,
+
+        "spacing", sol::readonly(&Terrain::spacing),
+        "height_scale", sol::readonly(&Terrain::height_scale),
+        "sun_direction", &Terrain::sun_direction,
+        "levels_moved", sol::readonly(&Terrain::levels_moved)
+    );
+
+    sol::constructors<Tilemap()> Tilemap_ctors;
+    module.new_usertype<Tilemap>("Tilemap",
+        Tilemap_ctors,
+        "make", &Tilemap::make,
+        "destroy", &Tilemap::destroy,
+        "set", &Tilemap::set,
+        "get", &Tilemap::get,
+        "fill", &Tilemap::fill,
+        "draw", &Tilemap::draw,
+
+        "tile_size", sol::readonly(&Tilemap::tile_size),
+        "drawn_chunks", sol::readonly(&Tilemap::drawn_chunks),
+        "rebuilt_chunks", sol::readonly(&Tilemap::rebuilt_chunks)
+    );
+
+    sol::constructors<PostProcess()> PostProcess_ctors;
+    module.new_usertype<PostProcess>("PostProcess",
+        PostProcess_ctors,
+        "make", &PostProcess::make,
+        "destroy", &PostProcess::destroy,
+        "draw_panel", &PostProcess::draw_panel,
+        "variant_count", &PostProcess::variant_count,
+
+        "bloom_enabled", &PostProcess::bloom_enabled,
+        "bloom_threshold", &PostProcess::bloom_threshold,
+        "bloom_intensity", &PostProcess::bloom_intensity,
+        "bloom_levels", &PostProcess::bloom_levels,
+        "bloom_quarter_res", &PostProcess::bloom_quarter_res,
+        "tonemap", &PostProcess::tonemap,
+        "exposure", &PostProcess::exposure,
+        "grading", &PostProcess::grading,
+        "contrast", &PostProcess::contrast,
+        "saturation", &PostProcess::saturation,
+        "tint", &PostProcess::tint,
+        "fxaa", &PostProcess::fxaa
+    );
+
+    sol::constructors<Font()> Font_ctors;
+    module.new_usertype<Font>("Font",
+        Font_ctors,
+        "load", sol::overload(
+            [](string path) { return Font::load(path); },
+            [](string path, u32 pixel_size) {
+                return Font::load(path, pixel_size);
+            },
+            [](string path, u32 pixel_size, bool sdf) {
+                return Font::load(path, pixel_size, sdf);
+            }
+        ),
+        "destroy", &Font::destroy,
+        // rgb plus an optional alpha on the Lua side
+        "draw", sol::overload(
+            [](Font &self, string text, Vec2f pos, f32 size, Vec3f colour) {
+                self.draw(text, pos, size, Vec4f(colour, 1.0f));
+            },
+            [](Font &self, string text, Vec2f pos, f32 size, Vec3f colour,
+               f32 alpha) {
+                self.draw(text, pos, size, Vec4f(colour, alpha));
+            },
+            [](Font &self, string text, Vec2f pos, f32 size, Vec3f colour,
+               f32 alpha, f32 wrap) {
+                self.draw(text, pos, size, Vec4f(colour, alpha), wrap);
+            }
+        ),
+        "measure", sol::overload(
+            [](Font &self, string text, f32 size) {
+                return self.measure(text, size);
+            },
+            &Font::measure
+        ),
+        "flush", sol::overload(
+            sol::resolve<void()>(&Font::flush),
+            sol::resolve<void(Mat4, Mat4)>(&Font::flush)
+        ),
+        "resident", &Font::resident,
+        "capacity", &Font::capacity,
+
+        "pixel_size", sol::readonly(&Font::pixel_size),
+        "line_height", sol::readonly(&Font::line_height),
+        "rasterized", sol::readonly(&Font::rasterized),
+        "evictions", sol::readonly(&Font::evictions),
+        "overflows", sol::readonly(&Font::overflows),
+
+        "draw_panel", &Font::draw_panel,
+        "cached_layouts", &Font::cached_layouts,
+        "layout_max_age", &Font::layout_max_age,
+        "layout_hits", sol::readonly(&Font::layout_hits),
+        "layout_misses", sol::readonly(&Font::layout_misses)
+    );
+
+    sol::constructors<Impostor()> Impostor_ctors;
+    module.new_usertype<Impostor>("Impostor",
+        Impostor_ctors,
+        // an opaque rgb colour on the Lua side
+        "bake", sol::overload(
+            [](Mesh &mesh, Vec3f colour) {
+                return Impostor::bake(mesh, Vec4f(colour, 1.0f));
+            },
+            [](Mesh &mesh, Vec3f colour, u32 frames, u32 frame_size) {
+                return Impostor::bake(mesh, Vec4f(colour, 1.0f), frames,
+                                      frame_size);
+            },
+            [](Mesh &mesh, Texture &texture) {
+                return Impostor::bake(mesh, texture);
+            },
+            [](Mesh &mesh, Texture &texture, u32 frames, u32 frame_size) {
+                return Impostor::bake(mesh, texture, frames, frame_size);
+            }
+        ),
+        "destroy", &Impostor::destroy
+    );
+
+    sol::constructors<ImpostorSet()> ImpostorSet_ctors;
+    module.new_usertype<ImpostorSet>("ImpostorSet",
+        ImpostorSet_ctors,
+        "make", &ImpostorSet::make,
+        "destroy", &ImpostorSet::destroy,
+        // euler angles in degrees on the Lua side
+        "add", [](ImpostorSet &self, Vec3f pos, Vec3f euler, f32 scale) {
+            self.add(pos, Quat(glm::radians(euler)), scale);
+        },
+        "clear", &ImpostorSet::clear,
+        "draw", &ImpostorSet::draw,
+
+        "distance", &ImpostorSet::distance,
+        "sun_direction", &ImpostorSet::sun_direction,
+        "near_count", sol::readonly(&ImpostorSet::near_count),
+        "far_count", sol::readonly(&ImpostorSet::far_count)
+    );
+
+    sol::constructors<Lightmap()> Lightmap_ctors;
+    module.new_usertype<Lightmap>("Lightmap",
+        Lightmap_ctors,
+        "load", &Lightmap::load,
+        "destroy", &Lightmap::destroy,
+        "apply", &Lightmap::apply,
+        "receiver_count", &Lightmap::receiver_count,
+        "glsl", &Lightmap::glsl
+    );
+
+    using LightmapGeometry = LightmapBaker::Geometry;
+    sol::constructors<LightmapGeometry()> LightmapGeometry_ctors;
+    module.new_usertype<LightmapGeometry>("LightmapGeometry",
+        LightmapGeometry_ctors,
+        "load", &LightmapGeometry::load,
+        "vertex_count", [](LightmapGeometry &self) {
+            return self.positions.size();
+        },
+        "has_uv2", [](LightmapGeometry &self) {
+            return !self.uv2.empty();
+        }
+    );
+
+    sol::constructors<LightmapBaker()> LightmapBaker_ctors;
+    module.new_usertype<LightmapBaker>("LightmapBaker",
+        LightmapBaker_ctors,
+        "add", sol::overload(
+            [](LightmapBaker &self, Mesh &mesh, Mat4 model, Vec3f albedo) {
+                return self.add(mesh, model, albedo);
+            },
+            [](LightmapBaker &self, Mesh &mesh, Mat4 model, Vec3f albedo,
+               bool receiver) {
+                return self.add(mesh, model, albedo, receiver);
+            },
+            [](LightmapBaker &self, LightmapGeometry &geometry, Mat4 model,
+               Vec3f albedo) {
+                return self.add(geometry, model, albedo);
+            },
+            [](LightmapBaker &self, LightmapGeometry &geometry, Mat4 model,
+               Vec3f albedo, bool receiver) {
+                return self.add(geometry, model, albedo, receiver);
+            }
+        ),
+        "add_point", [](LightmapBaker &self, Vec3f pos, Vec3f colour,
+                        f32 intensity, f32 radius) {
+            Light light;
+            light.pos = pos;
+            light.colour = colour;
+            light.intensity = intensity;
+            light.radius = radius;
+            self.lights.push_back(light);
+        },
+        "add_spot", [](LightmapBaker &self, Vec3f pos, Vec3f direction,
+                       Vec3f colour, f32 intensity, f32 radius,
+                       f32 inner_angle, f32 outer_angle) {
+            Light light;
+            light.type = LightType::spot;
+            light.pos = pos;
+            light.direction = glm::normalize(direction);
+            light.colour = colour;
+            light.intensity = intensity;
+            light.radius = radius;
+            light.inner_angle = inner_angle;
+            light.outer_angle = outer_angle;
+            self.lights.push_back(light);
+        },
+        "clear", &LightmapBaker::clear,
+        "build", &LightmapBaker::build,
+        "refine", &LightmapBaker::refine,
+        "result", &LightmapBaker::result,
+        "save", &LightmapBaker::save,
+        "bake", &LightmapBaker::bake,
+        "unwrap", sol::overload(
+            [](Mesh &mesh) { return LightmapBaker::unwrap(mesh); },
+            [](Mesh &mesh, u32 resolution) {
+                return LightmapBaker::unwrap(mesh, resolution);
+            },
+            [](LightmapGeometry &geometry) {
+                return LightmapBaker::unwrap(geometry);
+            },
+            [](LightmapGeometry &geometry, u32 resolution) {
+                return LightmapBaker::unwrap(geometry, resolution);
+            }
+        ),
+        "texel_count", &LightmapBaker::texel_count,
+        "node_count", &LightmapBaker::node_count,
+
+        "resolution", &LightmapBaker::resolution,
+        "texels_per_unit", &LightmapBaker::texels_per_unit,
+        "padding", &LightmapBaker::padding,
+        "bounces", &LightmapBaker::bounces,
+        "samples_per_pass", &LightmapBaker::samples_per_pass,
+        "sky", &LightmapBaker::sky,
+        "sun_direction", &LightmapBaker::sun_direction,
+        "sun_colour", &LightmapBaker::sun_colour,
+        "passes", sol::readonly(&LightmapBaker::passes)
+    );
+
+    sol::constructors<GltfModel()> GltfModel_ctors;
+    module.new_usertype<GltfModel>("GltfModel",
+        GltfModel_ctors,
+        "load", sol::overload(
+            [](string path) { return GltfModel::load(path); },
+            [](string path, MaterialTable &materials) {
+                return GltfModel::load(path, &materials);
+            }
+        ),
+        "destroy", &GltfModel::destroy,
+        "draw", sol::overload(
+            sol::resolve<void(Shader &, Mat4)>(&GltfModel::draw),
+            sol::resolve<void(Shader &, Mat4, Mat4, Mat4)>(&GltfModel::draw)
+        ),
+        "primitive_count", &GltfModel::primitive_count,
+        "load_ms", sol::readonly(&GltfModel::load_ms),
+        "benchmark", &GltfModel::benchmark
+    );
+
+    sol::constructors<Skeleton()> Skeleton_ctors;
+    module.new_usertype<Skeleton>("Skeleton",
+        Skeleton_ctors,
+        "load", &Skeleton::load,
+        "joint_count", &Skeleton::joint_count
+    );
+
+    sol::constructors<AnimationClip()> AnimationClip_ctors;
+    module.new_usertype<AnimationClip>("AnimationClip",
+        AnimationClip_ctors,
+        "load", sol::overload(
+            [](string path, const Skeleton &skeleton) {
+                return AnimationClip::load(path, skeleton);
+            },
+            [](string path, const Skeleton &skeleton, u32 index) {
+                return AnimationClip::load(path, skeleton, index);
+            }
+        ),
+        "name", sol::readonly(&AnimationClip::name),
+        "duration", sol::readonly(&AnimationClip::duration)
+    );
+
+    sol::constructors<AnimationSystem()> AnimationSystem_ctors;
+    module.new_usertype<AnimationSystem>("AnimationSystem",
+        AnimationSystem_ctors,
+        "make", &AnimationSystem::make,
+        "destroy", &AnimationSystem::destroy,
+        "add", &AnimationSystem::add,
+        "play", &AnimationSystem::play,
+        "set_speed", &AnimationSystem::set_speed,
+        "count", &AnimationSystem::count,
+        "update", &AnimationSystem::update,
+        "bind", &AnimationSystem::bind,
+        "apply", &AnimationSystem::apply,
+        "glsl", &AnimationSystem::glsl
+    );
+
+    module.new_usertype<EmitterSettings>("EmitterSettings",
+        sol::constructors<EmitterSettings()>(),
+        "pos", &EmitterSettings::pos,
+        "velocity", &EmitterSettings::velocity,
+        "spread", &EmitterSettings::spread,
+        "gravity", &EmitterSettings::gravity,
+        "drag", &EmitterSettings::drag,
+        "life_min", &EmitterSettings::life_min,
+        "life_max", &EmitterSettings::life_max,
+        "size_start", &EmitterSettings::size_start,
+        "size_end", &EmitterSettings::size_end,
+        "colour_start", &EmitterSettings::colour_start,
+        "colour_end", &EmitterSettings::colour_end,
+        "rate", &EmitterSettings::rate
+    );
+
+    sol::constructors<ParticleSystem()> ParticleSystem_ctors;
+    module.new_usertype<ParticleSystem>("ParticleSystem",
+        ParticleSystem_ctors,
+        "make", &ParticleSystem::make,
+        "destroy", &ParticleSystem::destroy,
+        "burst", &ParticleSystem::burst,
+        "update", &ParticleSystem::update,
+        "draw", &ParticleSystem::draw,
+        "alive", &ParticleSystem::alive,
+        "benchmark", &ParticleSystem::benchmark,
+
+        "settings", &ParticleSystem::settings,
+        "emitting", &ParticleSystem::emitting
+    );
+
     sol::constructors<Sprite()> Sprite_ctors;
     module.new_usertype<Sprite>("Sprite",
         Sprite_ctors,
@@ -494,6 +1076,22 @@ sol::table libImGui(sol::this_state state) {
         }
     ));
 
+    // shipping runs have no ImGui until something uses it: every call makes
+    // sure it exists, and calls made outside an ImGui frame do nothing
+    sol::protected_function guard = luaview.load(R"(
+        local module, available = ...
+        for name, fn in pairs(module) do
+            if type(fn) == "function" then
+                module[name] = function(...)
+                    if available() then
+                        return fn(...)
+                    end
+                end
+            end
+        end
+    )");
+    guard(module, &engine::imgui_available);
+
     return module;
 }
 
@@ -541,6 +1139,11 @@ namespace scripting {
         lua_state.require("imgui", sol::c_call<decltype(&libImGui), &libImGui>, false);
 
         physics3d::RegisterLuaModule(lua_state);
+        profiler::RegisterLuaModule(lua_state);
+        capture::RegisterLuaModule(lua_state);
+        resolution::RegisterLuaModule(lua_state);
+        render_stats::RegisterLuaModule(lua_state);
+        gpu_memory::RegisterLuaModule(lua_state);
     }
 }
 
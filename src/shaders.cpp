@@ -0,0 +1,329 @@
+#include <rama/shaders.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+struct Line {
+  string text;
+  u32 file;
+  u32 number;
+};
+
+u64 fnv1a(const void *data, usize size, u64 hash = 14695981039346656037ull) {
+  const u8 *bytes = (const u8 *)data;
+  for (usize i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+u64 fnv1a(const string &text, u64 hash = 14695981039346656037ull) {
+  return fnv1a(text.data(), text.size(), hash);
+}
+
+// returns the quoted path of an `#include "..."` line, or an empty string
+string include_target(const string &line) {
+  usize start = line.find_first_not_of(" \t");
+  if (start == string::npos || line.compare(start, 8, "#include") != 0) {
+    return "";
+  }
+
+  usize open = line.find('"', start + 8);
+  usize close = open != string::npos ? line.find('"', open + 1) : open;
+  if (close == string::npos) {
+    return "";
+  }
+
+  return line.substr(open + 1, close - open - 1);
+}
+
+bool expand(const fs::path &path, ArrayList<Line> &out,
+            ArrayList<string> &files, ArrayList<string> &stack) {
+  string name = path.lexically_normal().string();
+
+  if (std::find(stack.begin(), stack.end(), name) != stack.end()) {
+    engine::error("Shader: \"{}\" includes itself", name);
+    return false;
+  }
+
+  std::ifstream ifs(path);
+  if (!ifs.is_open()) {
+    engine::error("Failed to open shader file: {}", name);
+    return false;
+  }
+
+  u32 file = files.size();
+  files.push_back(name);
+  stack.push_back(name);
+
+  string line;
+  u32 number = 0;
+  bool ok = true;
+
+  while (std::getline(ifs, line)) {
+    number++;
+
+    string target = include_target(line);
+    if (target.empty()) {
+      out.push_back(Line{line, file, number});
+      continue;
+    }
+
+    ok &= expand(path.parent_path() / target, out, files, stack);
+  }
+
+  stack.pop_back();
+  return ok;
+}
+
+bool compile_stage(u32 id, const char *stage, const ShaderSource &source) {
+  glCompileShader(id);
+
+  i32 success;
+  glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+  if (success) {
+    return true;
+  }
+
+  char log[1024];
+  glGetShaderInfoLog(id, sizeof(log), nullptr, log);
+
+  string files;
+  for (u32 i = 0; i < source.files.size(); i++) {
+    files += fmt::format("\n  {}: {}", i, source.files[i]);
+  }
+
+  engine::error("{} Shader Error: {}source strings:{}", stage, log, files);
+  return false;
+}
+
+string driver_id() {
+  auto str = [](GLenum name) {
+    const GLubyte *value = glGetString(name);
+    return value ? string((const char *)value) : string();
+  };
+
+  return str(GL_VENDOR) + str(GL_RENDERER) + str(GL_VERSION);
+}
+
+} // namespace
+
+ShaderSource ShaderSource::load(string path) {
+  ShaderSource result;
+
+  ArrayList<Line> lines;
+  ArrayList<string> stack;
+  expand(engine::get_path(path), lines, result.files, stack);
+
+  enum class Stage { none, vertex, fragment } stage = Stage::none;
+
+  // where the previous line of each stage came from, so `#line` is only
+  // emitted when the source jumps between files or over a marker
+  struct Cursor {
+    u32 file = UINT32_MAX;
+    u32 next = 0;
+  } vertex_at, fragment_at;
+
+  for (const Line &line : lines) {
+    usize end = line.text.find_last_not_of(" \t\r");
+    string trimmed = line.text.substr(0, end + 1);
+
+    if (trimmed == "@vertex") {
+      stage = Stage::vertex;
+      continue;
+    } else if (trimmed == "@fragment") {
+      stage = Stage::fragment;
+      continue;
+    } else if (trimmed.rfind("@feature ", 0) == 0) {
+      std::istringstream names(trimmed.substr(9));
+      string name;
+      while (names >> name) {
+        if (std::find(result.features.begin(), result.features.end(),
+                      name) == result.features.end()) {
+          result.features.push_back(name);
+        }
+      }
+      continue;
+    }
+
+    if (stage == Stage::none) {
+      continue;
+    }
+
+    string &code = stage == Stage::vertex ? result.vertex : result.fragment;
+    Cursor &at = stage == Stage::vertex ? vertex_at : fragment_at;
+
+    if (at.file != line.file || at.next != line.number) {
+      code += fmt::format("#line {} {}\n", line.number, line.file);
+    }
+    code += line.text;
+    code += "\n";
+
+    at.file = line.file;
+    at.next = line.number + 1;
+  }
+
+  if (result.features.size() > 64) {
+    engine::error("Shader: \"{}\" declares {} features, at most 64 are "
+                  "supported",
+                  path, result.features.size());
+    result.features.resize(64);
+  }
+
+  result.hash = fnv1a(result.vertex);
+  result.hash = fnv1a(result.fragment, result.hash);
+
+  return result;
+}
+
+ShaderVariants ShaderVariants::load(string path) {
+  ShaderVariants result;
+  result.source = ShaderSource::load(path);
+  return result;
+}
+
+void ShaderVariants::destroy() {
+  for (auto &[mask, shader] : variants) {
+    shader.destroy();
+  }
+  variants.clear();
+}
+
+u64 ShaderVariants::mask(const ArrayList<string> &names) {
+  u64 result = 0;
+
+  for (const string &name : names) {
+    auto it = std::find(source.features.begin(), source.features.end(), name);
+    if (it == source.features.end()) {
+      engine::warning("ShaderVariants: unknown feature \"{}\" in \"{}\"", name,
+                      source.files.empty() ? "" : source.files[0]);
+      continue;
+    }
+
+    result |= 1ull << (it - source.features.begin());
+  }
+
+  return result;
+}
+
+Shader &ShaderVariants::get(u64 mask) {
+  if (auto it = variants.find(mask); it != variants.end()) {
+    return it->second;
+  }
+
+  return variants.emplace(mask, compile(mask)).first->second;
+}
+
+Shader ShaderVariants::compile(u64 mask) {
+  string header = engine::get_GLSLVersion();
+  for (u32 i = 0; i < source.features.size(); i++) {
+    if (mask & (1ull << i)) {
+      header += fmt::format("#define {} 1\n", source.features[i]);
+    }
+  }
+
+  Shader result;
+
+  string cache_path;
+#ifndef __EMSCRIPTEN__
+  if (disk_cache) {
+    u64 key = fnv1a(&mask, sizeof(mask), source.hash);
+    key = fnv1a(header, key);
+    key = fnv1a(driver_id(), key);
+    cache_path =
+        fmt::format("{}/{:016x}.bin", engine::get_path(cache_dir), key);
+
+    std::ifstream ifs(cache_path, std::ios::binary);
+    if (ifs.is_open()) {
+      u32 format = 0;
+      ifs.read((char *)&format, sizeof(format));
+      string binary((std::istreambuf_iterator<char>(ifs)),
+                    std::istreambuf_iterator<char>());
+
+      result.program = glCreateProgram();
+      glProgramBinary(result.program, format, binary.data(), binary.size());
+
+      // a driver update makes old binaries fail here, recompile then
+      i32 success;
+      glGetProgramiv(result.program, GL_LINK_STATUS, &success);
+      if (success) {
+        disk_hits++;
+        return result;
+      }
+      glDeleteProgram(result.program);
+    }
+  }
+#endif
+
+  string vertex_src = header + source.vertex;
+  string fragment_src = header + source.fragment;
+  const char *vsrc = vertex_src.c_str();
+  const char *fsrc = fragment_src.c_str();
+
+  u32 vertex = glCreateShader(GL_VERTEX_SHADER);
+  u32 fragment = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(vertex, 1, &vsrc, NULL);
+  glShaderSource(fragment, 1, &fsrc, NULL);
+
+  compile_stage(vertex, "Vertex", source);
+  compile_stage(fragment, "Fragment", source);
+
+  result.program = glCreateProgram();
+  glAttachShader(result.program, vertex);
+  glAttachShader(result.program, fragment);
+
+#ifndef __EMSCRIPTEN__
+  if (!cache_path.empty()) {
+    glProgramParameteri(result.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  }
+#endif
+
+  glLinkProgram(result.program);
+
+  glDetachShader(result.program, vertex);
+  glDetachShader(result.program, fragment);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  i32 success;
+  glGetProgramiv(result.program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char log[1024];
+    glGetProgramInfoLog(result.program, sizeof(log), nullptr, log);
+    engine::error("Program Error: {}", log);
+    return result;
+  }
+
+  compiled++;
+
+#ifndef __EMSCRIPTEN__
+  if (!cache_path.empty()) {
+    i32 length = 0;
+    glGetProgramiv(result.program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (length > 0) {
+      string binary(length, '\0');
+      GLenum format = 0;
+      glGetProgramBinary(result.program, length, nullptr, &format,
+                         binary.data());
+
+      std::error_code ec;
+      fs::create_directories(fs::path(cache_path).parent_path(), ec);
+
+      std::ofstream ofs(cache_path, std::ios::binary);
+      u32 format32 = format;
+      ofs.write((const char *)&format32, sizeof(format32));
+      ofs.write(binary.data(), binary.size());
+    }
+  }
+#endif
+
+  return result;
+}
@@ -0,0 +1,238 @@
+#include <rama/shadows.hpp>
+
+#include <cmath>
+
+namespace {
+
+void allocate_array(u32 texture, u32 resolution, u32 layers, bool compare) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, resolution,
+                 resolution, layers);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+  f32 border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+
+  if (compare) {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                    GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  }
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+} // namespace
+
+CascadedShadowMap CascadedShadowMap::make(u32 resolution, u32 cascades) {
+  CascadedShadowMap result;
+  result.resolution = resolution;
+  result.cascades = std::max(1u, cascades);
+
+  result.matrices.resize(result.cascades, Mat4(1));
+  result.centers.resize(result.cascades, Vec3f(0));
+  result.radii.resize(result.cascades, 0.0f);
+  result.splits.resize(result.cascades, 0.0f);
+  result.dirty.resize(result.cascades, true);
+
+  glGenTextures(1, &result.static_depth);
+  glGenTextures(1, &result.depth);
+  allocate_array(result.static_depth, resolution, result.cascades, false);
+  allocate_array(result.depth, resolution, result.cascades, true);
+
+  glGenFramebuffers(1, &result.fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, result.fbo);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  return result;
+}
+
+void CascadedShadowMap::destroy() {
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &static_depth);
+  glDeleteTextures(1, &depth);
+}
+
+void CascadedShadowMap::invalidate() {
+  for (u32 i = 0; i < cascades; i++) {
+    dirty[i] = true;
+  }
+}
+
+void CascadedShadowMap::fit(u32 cascade, Vec3f center, f32 radius) {
+  f32 extent = radius * (1.0f + margin);
+
+  Vec3f up = std::abs(light_dir.y) > 0.99f ? engine::WorldForward
+                                           : engine::WorldUp;
+  Mat4 view =
+      glm::lookAt(center - light_dir * (extent + depth_range), center, up);
+  Mat4 projection = glm::ortho(-extent, extent, -extent, extent, 0.0f,
+                               2.0f * extent + depth_range);
+
+  // snap the projection to whole texels so the cascade doesn't shimmer as
+  // the camera moves
+  Mat4 matrix = projection * view;
+  Vec4f origin = matrix * Vec4f(0, 0, 0, 1) * (resolution * 0.5f);
+  Vec4f offset = (glm::round(origin) - origin) * (2.0f / resolution);
+  projection[3][0] += offset.x;
+  projection[3][1] += offset.y;
+
+  matrices[cascade] = projection * view;
+  centers[cascade] = center;
+  radii[cascade] = radius;
+}
+
+void CascadedShadowMap::update(FPSCamera &camera, Vec3f direction) {
+  direction = engine::safe_normalize(direction);
+  if (direction != light_dir) {
+    light_dir = direction;
+    invalidate();
+  }
+
+  Vec2f size = engine::get_game_size();
+  f32 aspect = size.x / std::max(1.0f, size.y);
+  f32 tan_y = std::tan(glm::radians(camera.fov) * 0.5f);
+  f32 tan_x = tan_y * aspect;
+
+  f32 near = camera.near;
+  f32 far = std::min(camera.far, max_distance);
+
+  Mat4 inverse_view = glm::inverse(camera.GetView());
+
+  f32 previous = near;
+  for (u32 i = 0; i < cascades; i++) {
+    f32 t = (f32)(i + 1) / cascades;
+    f32 log_split = near * std::pow(far / near, t);
+    f32 uniform_split = near + (far - near) * t;
+    splits[i] = lambda * log_split + (1.0f - lambda) * uniform_split;
+
+    // bounding sphere of the frustum slice. only the radius is independent of
+    // camera rotation: the centre follows the view direction, so turning far
+    // enough to move it past `margin` re-renders the static cascade
+    Vec3f center(0);
+    Array<Vec3f, 8> corners;
+    for (u32 c = 0; c < 8; c++) {
+      f32 d = (c & 4) ? splits[i] : previous;
+      Vec3f local((c & 1 ? 1 : -1) * tan_x * d, (c & 2 ? 1 : -1) * tan_y * d,
+                  -d);
+      corners[c] = Vec3f(inverse_view * Vec4f(local, 1));
+      center += corners[c];
+    }
+    center /= 8.0f;
+
+    f32 radius = 0;
+    for (auto &corner : corners) {
+      radius = std::max(radius, glm::length(corner - center));
+    }
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    bool moved = glm::length(center - centers[i]) > radii[i] * margin;
+    if (dirty[i] || moved || radius != radii[i]) {
+      fit(i, center, radius);
+      dirty[i] = true;
+    }
+
+    previous = splits[i];
+  }
+}
+
+void CascadedShadowMap::render(DrawCallback draw_static,
+                               DrawCallback draw_dynamic) {
+  i32 viewport[4];
+  i32 previous_fbo = 0;
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, resolution, resolution);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+
+  for (u32 i = 0; i < cascades; i++) {
+    if (dirty[i]) {
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                static_depth, 0, i);
+      glClear(GL_DEPTH_BUFFER_BIT);
+      if (draw_static) {
+        draw_static(matrices[i]);
+      }
+      dirty[i] = false;
+    }
+
+    glCopyImageSubData(static_depth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, depth,
+                       GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, resolution, resolution,
+                       1);
+
+    if (draw_dynamic) {
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0,
+                                i);
+      draw_dynamic(matrices[i]);
+    }
+  }
+
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void CascadedShadowMap::bind(i32 unit) {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, depth);
+}
+
+void CascadedShadowMap::apply(Shader &shader, i32 unit) {
+  shader.sampler("shadow_map", unit);
+  shader.uniform("shadow_cascades", (f32)cascades);
+
+  for (u32 i = 0; i < cascades; i++) {
+    shader.uniform(fmt::format("shadow_matrices[{}]", i), matrices[i]);
+    shader.uniform(fmt::format("shadow_splits[{}]", i), splits[i]);
+  }
+}
+
+string CascadedShadowMap::glsl() {
+  return R"(
+        #define SHADOW_MAX_CASCADES 8
+
+        uniform sampler2DArrayShadow shadow_map;
+        uniform mat4 shadow_matrices[SHADOW_MAX_CASCADES];
+        uniform float shadow_splits[SHADOW_MAX_CASCADES];
+        uniform float shadow_cascades;
+
+        // 1 = lit, 0 = fully shadowed. view_depth is the positive distance
+        // along the camera forward axis.
+        float cascaded_shadow(vec3 world_pos, float view_depth) {
+            int count = int(shadow_cascades);
+            int cascade = count - 1;
+            for (int i = 0; i < count; i++) {
+                if (view_depth < shadow_splits[i]) {
+                    cascade = i;
+                    break;
+                }
+            }
+
+            vec4 p = shadow_matrices[cascade] * vec4(world_pos, 1.0);
+            vec3 coord = p.xyz / p.w * 0.5 + 0.5;
+            if (coord.z > 1.0) {
+                return 1.0;
+            }
+
+            vec2 texel = 1.0 / vec2(textureSize(shadow_map, 0).xy);
+            float lit = 0.0;
+            for (int x = -1; x <= 1; x++) {
+                for (int y = -1; y <= 1; y++) {
+                    vec2 uv = coord.xy + vec2(x, y) * texel;
+                    lit += texture(shadow_map, vec4(uv, float(cascade), coord.z));
+                }
+            }
+
+            return lit / 9.0;
+        }
+    )";
+}
@@ -0,0 +1,296 @@
+#include <rama/terrain.hpp>
+
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+#include "stb_image.h"
+
+Terrain Terrain::load(string path, f32 spacing, f32 height_scale, u32 levels,
+                      u32 grid) {
+  string full_path = engine::get_path(path);
+
+  i32 w, h, ncomp;
+  u16 *data = stbi_load_16(full_path.c_str(), &w, &h, &ncomp, 1);
+  if (!data) {
+    engine::error("Failed to load heightmap: \"{}\"", full_path);
+    return Terrain{};
+  }
+
+  if (w != h) {
+    engine::error("Terrain: \"{}\" is {}x{}, heightmaps must be square",
+                  full_path, w, h);
+    stbi_image_free(data);
+    return Terrain{};
+  }
+
+  ArrayList<u16> heights(data, data + w * h);
+  stbi_image_free(data);
+
+  return Terrain::make(std::move(heights), w, spacing, height_scale, levels,
+                       grid);
+}
+
+Terrain Terrain::make(ArrayList<u16> heights, u32 size, f32 spacing,
+                      f32 height_scale, u32 levels, u32 grid) {
+  string vtx_shader = R"(
+        layout(location = 0) in vec2 cell;
+
+        uniform mat4 perspective;
+        uniform mat4 view;
+
+        uniform sampler2D heightmap;
+        uniform vec2 level_origin;
+        uniform float level_step;
+        uniform float grid_size;
+        uniform float terrain_spacing;
+        uniform float terrain_height;
+
+        out vec3 world_pos;
+        out vec3 normal;
+
+        float height(vec2 texel) {
+            ivec2 t = clamp(ivec2(texel), ivec2(0),
+                            textureSize(heightmap, 0) - 1);
+            return texelFetch(heightmap, t, 0).r * terrain_height;
+        }
+
+        void main() {
+            vec2 texel = level_origin + cell * level_step;
+            vec2 dx = vec2(level_step, 0.0);
+            vec2 dy = vec2(0.0, level_step);
+
+            // odd vertices on the outer edge lie on the coarser level's edge
+            float h;
+            bool odd_x = mod(cell.x, 2.0) == 1.0;
+            bool odd_y = mod(cell.y, 2.0) == 1.0;
+            if ((cell.x == 0.0 || cell.x == grid_size) && odd_y) {
+                h = 0.5 * (height(texel - dy) + height(texel + dy));
+            } else if ((cell.y == 0.0 || cell.y == grid_size) && odd_x) {
+                h = 0.5 * (height(texel - dx) + height(texel + dx));
+            } else {
+                h = height(texel);
+            }
+
+            float hx = height(texel + dx) - height(texel - dx);
+            float hz = height(texel + dy) - height(texel - dy);
+            normal = normalize(
+                vec3(-hx, 2.0 * level_step * terrain_spacing, -hz));
+
+            world_pos = vec3(texel.x * terrain_spacing, h,
+                             texel.y * terrain_spacing);
+            gl_Position = perspective * view * vec4(world_pos, 1.0);
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec3 world_pos;
+        in vec3 normal;
+
+        uniform vec3 sun_direction;
+        uniform float terrain_height;
+
+        out vec4 fragColor;
+
+        void main() {
+            vec3 n = normalize(normal);
+            float diffuse = max(dot(n, -normalize(sun_direction)), 0.0);
+
+            vec3 grass = vec3(0.25, 0.4, 0.15);
+            vec3 rock = vec3(0.4, 0.37, 0.33);
+            vec3 snow = vec3(0.9);
+
+            vec3 albedo = mix(rock, grass, smoothstep(0.6, 0.8, n.y));
+            albedo = mix(albedo, snow,
+                         smoothstep(0.7, 0.85, world_pos.y / terrain_height));
+
+            fragColor = vec4(albedo * (0.2 + 0.8 * diffuse), 1.0);
+        }
+    )";
+
+  if (grid % 4 != 0 || grid > 252) {
+    engine::error("Terrain: grid must be a multiple of 4 up to 252, got {}",
+                  grid);
+    grid = 128;
+  }
+
+  Terrain result;
+  result.heights = std::move(heights);
+  result.size = size;
+  result.spacing = spacing;
+  result.height_scale = height_scale;
+  result.grid = grid;
+  result.origins.assign(levels, Vec2i(INT32_MIN));
+  result.holes.assign(levels, 0);
+  result.shader = Shader::make_with_version(vtx_shader, frg_shader);
+
+  glGenTextures(1, &result.texture);
+  glBindTexture(GL_TEXTURE_2D, result.texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, size, size, 0, GL_RED,
+               GL_UNSIGNED_SHORT, result.heights.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // one (grid + 1)^2 grid shared by every level, 16 bit cell coordinates
+  u32 n = grid + 1;
+  ArrayList<u16> cells;
+  cells.reserve(n * n * 2);
+  for (u32 y = 0; y < n; y++) {
+    for (u32 x = 0; x < n; x++) {
+      cells.push_back(x);
+      cells.push_back(y);
+    }
+  }
+
+  ArrayList<u16> indices;
+  auto quads = [&](i32 hole_x, i32 hole_y) {
+    Range range{(u32)indices.size(), 0};
+    i32 hole = grid / 2;
+
+    for (u32 y = 0; y < grid; y++) {
+      for (u32 x = 0; x < grid; x++) {
+        if ((i32)x >= hole_x && (i32)x < hole_x + hole && (i32)y >= hole_y &&
+            (i32)y < hole_y + hole) {
+          continue;
+        }
+
+        u16 v00 = y * n + x, v10 = v00 + 1;
+        u16 v01 = v00 + n, v11 = v01 + 1;
+        indices.insert(indices.end(), {v00, v01, v11, v00, v11, v10});
+      }
+    }
+
+    range.count = indices.size() - range.offset;
+    return range;
+  };
+
+  // a hole past the last cell keeps the whole grid
+  result.full = quads(grid, grid);
+  for (u32 i = 0; i < 4; i++) {
+    result.rings[i] = quads(grid / 4 + (i & 1), grid / 4 + (i >> 1));
+  }
+
+  glGenVertexArrays(1, &result.vao);
+  glBindVertexArray(result.vao);
+
+  glGenBuffers(1, &result.vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(u16) * cells.size(), cells.data(),
+               GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(u16) * 2,
+                        (void *)0);
+
+  glGenBuffers(1, &result.ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(u16) * indices.size(),
+               indices.data(), GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+
+  return result;
+}
+
+void Terrain::destroy() {
+  glDeleteTextures(1, &texture);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+  shader.destroy();
+}
+
+void Terrain::update(FPSCamera &camera) {
+  Vec2f eye = Vec2f(camera.pos.x, camera.pos.z) / spacing;
+
+  // level l has cells of 2^l texels and is snapped to the cells of level
+  // l + 1, so the level inside it always covers whole cells
+  auto snapped = [&](u32 level) {
+    f32 cell = (f32)(2u << level);
+    return Vec2i(glm::floor(eye / cell) * cell);
+  };
+
+  levels_moved = 0;
+  Vec2i inner = snapped(0);
+
+  for (u32 l = 0; l < origins.size(); l++) {
+    Vec2i center = snapped(l);
+    Vec2i origin = center - Vec2i((grid / 2) << l);
+
+    if (l > 0) {
+      // 0 or 1 cells between the centred hole and the finer level
+      Vec2i offset = (inner - center) >> (i32)l;
+      holes[l] = offset.x + offset.y * 2;
+    }
+    inner = center;
+
+    if (origin != origins[l]) {
+      origins[l] = origin;
+      levels_moved++;
+    }
+  }
+}
+
+void Terrain::draw(Mat4 perspective, Mat4 view) {
+  if (origins.empty() || origins[0].x == INT32_MIN) {
+    return;
+  }
+
+  GPU_SCOPE("Terrain");
+
+  shader.bind();
+  shader.uniform("perspective", perspective);
+  shader.uniform("view", view);
+  shader.uniform("grid_size", (f32)grid);
+  shader.uniform("terrain_spacing", spacing);
+  shader.uniform("terrain_height", height_scale);
+  shader.uniform("sun_direction", sun_direction);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  shader.sampler("heightmap", 0);
+
+  glBindVertexArray(vao);
+
+  for (u32 l = 0; l < origins.size(); l++) {
+    shader.uniform("level_origin", Vec2f(origins[l]));
+    shader.uniform("level_step", (f32)(1u << l));
+
+    Range range = l == 0 ? full : rings[holes[l]];
+    RENDER_STAT(draw_calls, 1);
+    RENDER_STAT(triangles, range.count / 3);
+    glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_SHORT,
+                   (void *)(sizeof(u16) * range.offset));
+  }
+
+  glBindVertexArray(0);
+}
+
+f32 Terrain::height_at(f32 x, f32 z) {
+  if (size == 0) {
+    return 0;
+  }
+
+  Vec2f p = glm::clamp(Vec2f(x, z) / spacing, Vec2f(0), Vec2f(size - 1));
+  Vec2u p0 = Vec2u(p);
+  Vec2u p1 = glm::min(p0 + 1u, Vec2u(size - 1));
+  Vec2f t = p - Vec2f(p0);
+
+  auto sample = [&](u32 sx, u32 sy) { return (f32)heights[sy * size + sx]; };
+
+  f32 top = glm::mix(sample(p0.x, p0.y), sample(p1.x, p0.y), t.x);
+  f32 bottom = glm::mix(sample(p0.x, p1.y), sample(p1.x, p1.y), t.x);
+
+  return glm::mix(top, bottom, t.y) / 65535.0f * height_scale;
+}
+
+physics3d::Shape Terrain::shape() {
+  ArrayList<f32> samples(heights.size());
+  for (usize i = 0; i < heights.size(); i++) {
+    samples[i] = heights[i] / 65535.0f;
+  }
+
+  return physics3d::Shape::HeightField(
+      samples, size, Vec3f(0), Vec3f(spacing, height_scale, spacing));
+}
@@ -0,0 +1,502 @@
+#include <rama/text.hpp>
+
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+#include <bit>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace {
+
+FT_Library library = nullptr;
+u32 library_users = 0;
+
+// the distance field reaches this far past the outline, in font pixels
+constexpr u32 sdf_spread = 8;
+
+// returns 0xFFFD for malformed sequences and always makes progress
+u32 next_codepoint(const string &text, usize &i) {
+  u8 c = text[i++];
+  if (c < 0x80) {
+    return c;
+  }
+
+  u32 extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+  if (extra == 0) {
+    return 0xFFFD;
+  }
+
+  u32 codepoint = c & (0x3F >> extra);
+  for (u32 n = 0; n < extra; n++) {
+    if (i >= text.size() || ((u8)text[i] & 0xC0) != 0x80) {
+      return 0xFFFD;
+    }
+    codepoint = codepoint << 6 | ((u8)text[i++] & 0x3F);
+  }
+
+  return codepoint;
+}
+
+u32 pack_colour(Vec4f colour) {
+  Vec4u c = Vec4u(glm::clamp(colour, Vec4f(0), Vec4f(1)) * 255.0f + 0.5f);
+  return c.r | c.g << 8 | c.b << 16 | c.a << 24;
+}
+
+} // namespace
+
+Font Font::load(string path, u32 pixel_size, bool sdf, u32 atlas_size) {
+  string vtx_shader = R"(
+        layout(location = 0) in vec4 rect;
+        layout(location = 1) in vec4 uv_rect;
+        layout(location = 2) in vec4 colour;
+
+        uniform mat4 perspective;
+        uniform mat4 view;
+
+        out vec2 uv;
+        out vec4 tint;
+
+        void main() {
+            vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+            // bitmap rows go down, y goes up
+            uv = uv_rect.xy + vec2(corner.x, 1.0 - corner.y) * uv_rect.zw;
+            tint = colour;
+
+            vec2 pos = rect.xy + corner * rect.zw;
+            gl_Position = perspective * view * vec4(pos, 0.0, 1.0);
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec2 uv;
+        in vec4 tint;
+
+        uniform sampler2D atlas;
+        uniform float sdf;
+
+        out vec4 fragColor;
+
+        void main() {
+            float value = texture(atlas, uv).r;
+            float alpha = value;
+
+            if (sdf > 0.5) {
+                // the outline is at 0.5, soften over about one screen pixel
+                float w = max(fwidth(value) * 0.75, 1e-4);
+                alpha = smoothstep(0.5 - w, 0.5 + w, value);
+            }
+
+            if (alpha <= 0.0) {
+                discard;
+            }
+            fragColor = vec4(tint.rgb, tint.a * alpha);
+        }
+    )";
+
+  Font result;
+  string full_path = engine::get_path(path);
+
+  if (!library && FT_Init_FreeType(&library) != 0) {
+    engine::error("Font: could not initialise FreeType");
+    return result;
+  }
+
+  if (FT_New_Face(library, full_path.c_str(), 0, &result.face) != 0) {
+    engine::error("Failed to load font: \"{}\"", full_path);
+    result.face = nullptr;
+    return result;
+  }
+  library_users++;
+
+  FT_Set_Pixel_Sizes(result.face, 0, pixel_size);
+
+  result.pixel_size = pixel_size;
+  result.sdf = sdf;
+  result.line_height = result.face->size->metrics.height / 64.0f;
+
+  // room for an em plus accents and descenders, and the SDF spread
+  result.cell_size = pixel_size * 3 / 2 + (sdf ? sdf_spread * 2 : 2);
+  result.atlas_size = atlas_size;
+  result.cells_per_row = std::max(1u, atlas_size / result.cell_size);
+  result.cells.resize(result.cells_per_row * result.cells_per_row);
+
+  glGenTextures(1, &result.atlas);
+  glBindTexture(GL_TEXTURE_2D, result.atlas);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, atlas_size, atlas_size);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  result.shader = Shader::make_with_version(vtx_shader, frg_shader);
+
+  glGenVertexArrays(1, &result.vao);
+  glBindVertexArray(result.vao);
+
+  glGenBuffers(1, &result.vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)offsetof(Instance, rect));
+  glVertexAttribDivisor(0, 1);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void *)offsetof(Instance, uv));
+  glVertexAttribDivisor(1, 1);
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance),
+                        (void *)offsetof(Instance, colour));
+  glVertexAttribDivisor(2, 1);
+
+  glBindVertexArray(0);
+
+  return result;
+}
+
+void Font::destroy() {
+  if (face) {
+    FT_Done_Face(face);
+    face = nullptr;
+
+    if (--library_users == 0) {
+      FT_Done_FreeType(library);
+      library = nullptr;
+    }
+  }
+
+  glDeleteTextures(1, &atlas);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+  shader.destroy();
+
+  glyphs.clear();
+  glyph_index.clear();
+  layouts.clear();
+  cells.clear();
+  instances.clear();
+}
+
+u32 Font::resident() {
+  return std::count_if(cells.begin(), cells.end(),
+                       [](const Cell &cell) { return cell.used; });
+}
+
+bool Font::make_resident(Glyph &glyph) {
+  // a free cell, or the one drawn longest ago
+  u32 victim = 0;
+  for (u32 i = 0; i < cells.size(); i++) {
+    if (!cells[i].used) {
+      victim = i;
+      break;
+    }
+    if (cells[i].last_used < cells[victim].last_used) {
+      victim = i;
+    }
+  }
+
+  Cell &cell = cells[victim];
+  if (cell.used && cell.last_used == frame) {
+    // still queued for this frame's draw
+    return false;
+  }
+
+  if (FT_Load_Glyph(face, glyph.index, FT_LOAD_DEFAULT) != 0 ||
+      FT_Render_Glyph(face->glyph, sdf ? FT_RENDER_MODE_SDF
+                                       : FT_RENDER_MODE_NORMAL) != 0) {
+    engine::warning("Font: could not rasterize U+{:04X}", glyph.codepoint);
+    return false;
+  }
+
+  if (cell.used) {
+    glyphs[glyph_index[cell.codepoint]].cell = -1;
+    evictions++;
+  }
+
+  const FT_Bitmap &bitmap = face->glyph->bitmap;
+  u32 w = std::min(bitmap.width, cell_size);
+  u32 h = std::min(bitmap.rows, cell_size);
+
+  // the whole cell is written so nothing of the previous glyph bleeds in
+  ArrayList<u8> pixels(cell_size * cell_size, 0);
+  for (u32 y = 0; y < h; y++) {
+    const u8 *row = bitmap.buffer + y * std::abs(bitmap.pitch);
+    std::copy(row, row + w, pixels.begin() + y * cell_size);
+  }
+
+  u32 cx = (victim % cells_per_row) * cell_size;
+  u32 cy = (victim / cells_per_row) * cell_size;
+
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, cx, cy, cell_size, cell_size, GL_RED,
+                  GL_UNSIGNED_BYTE, pixels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glyph.offset = Vec2f(face->glyph->bitmap_left,
+                       face->glyph->bitmap_top - (i32)h);
+  glyph.size = Vec2f(w, h);
+  glyph.cell = victim;
+
+  cell.codepoint = glyph.codepoint;
+  cell.used = true;
+  rasterized++;
+
+  return true;
+}
+
+i64 Font::lookup(u32 codepoint) {
+  if (auto it = glyph_index.find(codepoint); it != glyph_index.end()) {
+    return it->second;
+  }
+
+  Glyph glyph;
+  glyph.codepoint = codepoint;
+  glyph.index = FT_Get_Char_Index(face, codepoint);
+
+  if (FT_Load_Glyph(face, glyph.index, FT_LOAD_DEFAULT) != 0) {
+    return -1;
+  }
+  glyph.advance = face->glyph->advance.x / 64.0f;
+
+  // outline-less glyphs such as spaces only ever advance
+  glyph.outline = face->glyph->format == FT_GLYPH_FORMAT_OUTLINE &&
+                  face->glyph->outline.n_points > 0;
+
+  glyph_index.emplace(codepoint, glyphs.size());
+  glyphs.push_back(glyph);
+  return glyphs.size() - 1;
+}
+
+bool Font::touch(Glyph &glyph) {
+  if (glyph.cell < 0 && !make_resident(glyph)) {
+    overflows++;
+    return false;
+  }
+
+  cells[glyph.cell].last_used = frame;
+  return true;
+}
+
+const Font::Layout &Font::layout(const string &text, f32 size, f32 wrap) {
+  u64 key = std::hash<string>{}(text);
+  key ^= (u64)std::bit_cast<u32>(size) * 0x9E3779B97F4A7C15ull;
+  key ^= (u64)std::bit_cast<u32>(wrap) << 32 | std::bit_cast<u32>(wrap) >> 7;
+
+  Layout &result = layouts[key];
+  result.last_used = frame;
+
+  // a hash collision just lays the new text out over the old one
+  if (result.size == size && result.wrap == wrap && result.text == text) {
+    frame_hits++;
+    return result;
+  }
+  frame_misses++;
+
+  result.text = text;
+  result.size = size;
+  result.wrap = wrap;
+  result.glyphs.clear();
+
+  f32 scale = size / pixel_size;
+  f32 line = line_height * scale;
+
+  Vec2f pen(0);
+  u32 previous = 0, lines = 1;
+
+  // the first glyph after the last space on this line, and where it starts
+  i64 break_at = -1;
+  f32 break_x = 0;
+
+  for (usize i = 0; i < text.size();) {
+    u32 codepoint = next_codepoint(text, i);
+
+    if (codepoint == '\n') {
+      pen = Vec2f(0, pen.y - line);
+      previous = 0;
+      break_at = -1;
+      lines++;
+      continue;
+    }
+
+    i64 index = lookup(codepoint);
+    if (index < 0) {
+      continue;
+    }
+    Glyph *g = &glyphs[index];
+
+    if (previous && FT_HAS_KERNING(face)) {
+      FT_Vector kerning;
+      FT_Get_Kerning(face, previous, g->index, FT_KERNING_DEFAULT, &kerning);
+      pen.x += kerning.x / 64.0f * scale;
+    }
+    previous = g->index;
+
+    f32 advance = g->advance * scale;
+
+    if (codepoint == ' ') {
+      pen.x += advance;
+      break_at = result.glyphs.size();
+      break_x = pen.x;
+      continue;
+    }
+
+    // move the word being written to a new line
+    if (wrap > 0 && pen.x + advance > wrap && break_at >= 0) {
+      for (usize n = break_at; n < result.glyphs.size(); n++) {
+        result.glyphs[n].pos += Vec2f(-break_x, -line);
+      }
+      pen += Vec2f(-break_x, -line);
+      break_at = -1;
+      lines++;
+    }
+
+    if (g->outline) {
+      result.glyphs.push_back(PlacedGlyph{(u32)index, pen});
+    }
+    pen.x += advance;
+  }
+
+  f32 width = 0;
+  for (const PlacedGlyph &placed : result.glyphs) {
+    f32 end = placed.pos.x + glyphs[placed.glyph].advance * scale;
+    width = std::max(width, end);
+  }
+  result.extent = Vec2f(width, lines * line);
+
+  return result;
+}
+
+void Font::draw(const string &text, Vec2f pos, f32 size, Vec4f colour,
+                f32 wrap) {
+  if (!face) {
+    return;
+  }
+
+  const Layout &laid_out = layout(text, size, wrap);
+
+  f32 scale = size / pixel_size;
+  u32 packed = pack_colour(colour);
+  f32 texel = 1.0f / atlas_size;
+
+  for (const PlacedGlyph &placed : laid_out.glyphs) {
+    Glyph &g = glyphs[placed.glyph];
+    if (!touch(g)) {
+      continue;
+    }
+
+    Vec2f cell = Vec2f(g.cell % cells_per_row, g.cell / cells_per_row) *
+                 (f32)cell_size;
+
+    Instance instance;
+    instance.rect = Vec4f(pos + placed.pos + g.offset * scale, g.size * scale);
+    instance.uv = Vec4f(cell * texel, g.size * texel);
+    instance.colour = packed;
+    instances.push_back(instance);
+  }
+}
+
+Vec2f Font::measure(const string &text, f32 size, f32 wrap) {
+  if (!face) {
+    return Vec2f(0);
+  }
+
+  return layout(text, size, wrap).extent;
+}
+
+void Font::flush(Mat4 perspective, Mat4 view) {
+  layout_hits = frame_hits;
+  layout_misses = frame_misses;
+  total_layout_hits += frame_hits;
+  total_layout_misses += frame_misses;
+  frame_hits = frame_misses = 0;
+
+  // sweep once a second or so rather than every frame
+  if (frame % 64 == 0) {
+    std::erase_if(layouts, [&](const auto &entry) {
+      return frame - entry.second.last_used > layout_max_age;
+    });
+  }
+
+  frame++;
+
+  if (instances.empty()) {
+    return;
+  }
+
+  GPU_SCOPE("Text");
+
+  usize size = sizeof(Instance) * instances.size();
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (size > vbo_capacity) {
+    vbo_capacity = std::max(size, vbo_capacity * 2);
+  }
+  glBufferData(GL_ARRAY_BUFFER, vbo_capacity, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+  RENDER_STAT_UPLOAD(size);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  shader.bind();
+  shader.uniform("perspective", perspective);
+  shader.uniform("view", view);
+  shader.uniform("sdf", sdf ? 1.0f : 0.0f);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  shader.sampler("atlas", 0);
+
+  // text sits on top of whatever was drawn
+  GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+  glDisable(GL_DEPTH_TEST);
+
+  glBindVertexArray(vao);
+  RENDER_STAT(draw_calls, 1);
+  RENDER_STAT(triangles, 2 * instances.size());
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances.size());
+  glBindVertexArray(0);
+
+  if (depth) {
+    glEnable(GL_DEPTH_TEST);
+  }
+
+  instances.clear();
+}
+
+void Font::flush() {
+  Vec2f size = engine::get_game_size();
+  flush(glm::ortho(0.0f, size.x, 0.0f, size.y), Mat4(1));
+}
+
+void Font::draw_panel() {
+  if (!engine::imgui_available()) {
+    return;
+  }
+
+  ImGui::Begin("Text");
+
+  ImGui::PushID(this);
+  ImGui::Text("%s %s, %upx%s", face ? face->family_name : "(none)",
+              face ? face->style_name : "", pixel_size, sdf ? " SDF" : "");
+
+  ImGui::Text("Atlas: %u / %u glyphs", resident(), capacity());
+  ImGui::Text("Rasterized %u, evicted %u, overflowed %u", rasterized,
+              evictions, overflows);
+
+  u32 frame_total = layout_hits + layout_misses;
+  u64 total = total_layout_hits + total_layout_misses;
+  ImGui::Text("Layouts: %u cached", cached_layouts());
+  ImGui::Text("Hit rate: %.1f%% this frame, %.1f%% overall",
+              frame_total ? 100.0 * layout_hits / frame_total : 100.0,
+              total ? 100.0 * total_layout_hits / total : 100.0);
+  ImGui::Separator();
+  ImGui::PopID();
+
+  ImGui::End();
+}
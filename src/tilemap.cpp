@@ -0,0 +1,228 @@
+#include <rama/tilemap.hpp>
+
+#include <rama/profiler.hpp>
+#include <rama/render_stats.hpp>
+
+Tilemap Tilemap::make(u32 width, u32 height, f32 tile_size, Texture atlas,
+                      u32 atlas_columns, u32 atlas_rows) {
+  string vtx_shader = R"(
+        // x | y << 8 inside the chunk, tile
+        layout(location = 0) in uvec2 instance;
+
+        uniform mat4 perspective;
+        uniform mat4 view;
+
+        uniform vec2 chunk_origin;
+        uniform float tile_size;
+        uniform vec2 atlas_grid;
+
+        out vec2 uv;
+
+        void main() {
+            vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+            vec2 cell = vec2(instance.x & 255u, instance.x >> 8u);
+
+            uint tile = instance.y - 1u;
+            vec2 atlas_cell = vec2(tile % uint(atlas_grid.x),
+                                   tile / uint(atlas_grid.x));
+
+            // atlas rows go down, world y goes up
+            uv = vec2(atlas_cell.x + corner.x, atlas_cell.y + 1.0 - corner.y)
+               / atlas_grid;
+
+            vec2 world = chunk_origin + (cell + corner) * tile_size;
+            gl_Position = perspective * view * vec4(world, 0.0, 1.0);
+        }
+    )";
+
+  string frg_shader = R"(
+        in vec2 uv;
+
+        uniform sampler2D atlas;
+
+        out vec4 fragColor;
+
+        void main() {
+            vec4 colour = texture(atlas, uv);
+            if (colour.a < 0.5) {
+                discard;
+            }
+            fragColor = colour;
+        }
+    )";
+
+  Tilemap result;
+  result.width = width;
+  result.height = height;
+  result.tile_size = tile_size;
+  result.atlas = atlas;
+  result.atlas_columns = std::max(atlas_columns, 1u);
+  result.atlas_rows = std::max(atlas_rows, 1u);
+
+  result.tiles.assign(width * height, 0);
+  result.chunks_x = (width + chunk_size - 1) / chunk_size;
+  result.chunks_y = (height + chunk_size - 1) / chunk_size;
+  result.chunks.resize(result.chunks_x * result.chunks_y);
+
+  result.shader = Shader::make_with_version(vtx_shader, frg_shader);
+
+  return result;
+}
+
+void Tilemap::destroy() {
+  for (auto &chunk : chunks) {
+    if (chunk.vao) {
+      glDeleteVertexArrays(1, &chunk.vao);
+      glDeleteBuffers(1, &chunk.vbo);
+    }
+  }
+
+  chunks.clear();
+  shader.destroy();
+}
+
+void Tilemap::mark(u32 x, u32 y) {
+  chunks[(y / chunk_size) * chunks_x + x / chunk_size].dirty = true;
+}
+
+void Tilemap::set(u32 x, u32 y, u16 tile) {
+  if (x >= width || y >= height || tiles[y * width + x] == tile) {
+    return;
+  }
+
+  tiles[y * width + x] = tile;
+  mark(x, y);
+}
+
+u16 Tilemap::get(u32 x, u32 y) {
+  return x < width && y < height ? tiles[y * width + x] : 0;
+}
+
+void Tilemap::fill(u32 x, u32 y, u32 w, u32 h, u16 tile) {
+  if (x >= width || y >= height) {
+    return;
+  }
+
+  u32 x_end = std::min(x + w, width);
+  u32 y_end = std::min(y + h, height);
+
+  for (u32 ty = y; ty < y_end; ty++) {
+    auto row = tiles.begin() + ty * width;
+    std::fill(row + x, row + x_end, tile);
+  }
+
+  // one mark per chunk rather than per tile
+  for (u32 cy = y; cy < y_end; cy = (cy / chunk_size + 1) * chunk_size) {
+    for (u32 cx = x; cx < x_end; cx = (cx / chunk_size + 1) * chunk_size) {
+      mark(cx, cy);
+    }
+  }
+}
+
+void Tilemap::build(u32 index) {
+  Chunk &chunk = chunks[index];
+  u32 x0 = (index % chunks_x) * chunk_size;
+  u32 y0 = (index / chunks_x) * chunk_size;
+  u32 x1 = std::min(x0 + chunk_size, width);
+  u32 y1 = std::min(y0 + chunk_size, height);
+
+  ArrayList<u16> instances;
+  instances.reserve(chunk_size * chunk_size * 2);
+
+  for (u32 y = y0; y < y1; y++) {
+    for (u32 x = x0; x < x1; x++) {
+      u16 tile = tiles[y * width + x];
+      if (tile != 0) {
+        instances.push_back((x - x0) | (y - y0) << 8);
+        instances.push_back(tile);
+      }
+    }
+  }
+
+  if (!chunk.vao) {
+    glGenVertexArrays(1, &chunk.vao);
+    glBindVertexArray(chunk.vao);
+
+    glGenBuffers(1, &chunk.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_SHORT, sizeof(u16) * 2,
+                           (void *)0);
+    glVertexAttribDivisor(0, 1);
+
+    glBindVertexArray(0);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(u16) * instances.size(),
+               instances.data(), GL_STATIC_DRAW);
+  RENDER_STAT_UPLOAD(sizeof(u16) * instances.size());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  chunk.count = instances.size() / 2;
+  chunk.dirty = false;
+  rebuilt_chunks++;
+}
+
+void Tilemap::draw(Camera2D &camera) {
+  drawn_chunks = 0;
+  rebuilt_chunks = 0;
+
+  if (chunks.empty()) {
+    return;
+  }
+
+  Mat4 perspective = camera.GetPerspective();
+  Mat4 view = camera.GetView();
+
+  // world space rectangle of the view, from the clip space corners
+  Mat4 inverse = glm::inverse(perspective * view);
+  Vec4f a = inverse * Vec4f(-1, -1, 0, 1);
+  Vec4f b = inverse * Vec4f(1, 1, 0, 1);
+  Vec2f min = glm::min(Vec2f(a) / a.w, Vec2f(b) / b.w);
+  Vec2f max = glm::max(Vec2f(a) / a.w, Vec2f(b) / b.w);
+
+  f32 chunk_world = chunk_size * tile_size;
+  Vec2i first = glm::max(Vec2i(glm::floor(min / chunk_world)), Vec2i(0));
+  Vec2i last = glm::min(Vec2i(glm::floor(max / chunk_world)),
+                        Vec2i(chunks_x - 1, chunks_y - 1));
+
+  if (first.x > last.x || first.y > last.y) {
+    return;
+  }
+
+  GPU_SCOPE("Tilemap");
+
+  shader.bind();
+  shader.uniform("perspective", perspective);
+  shader.uniform("view", view);
+  shader.uniform("tile_size", tile_size);
+  shader.uniform("atlas_grid", Vec2f(atlas_columns, atlas_rows));
+
+  atlas.bind(0);
+  shader.sampler("atlas", 0);
+
+  for (i32 cy = first.y; cy <= last.y; cy++) {
+    for (i32 cx = first.x; cx <= last.x; cx++) {
+      u32 index = cy * chunks_x + cx;
+      if (chunks[index].dirty) {
+        build(index);
+      }
+
+      Chunk &chunk = chunks[index];
+      if (chunk.count == 0) {
+        continue;
+      }
+
+      shader.uniform("chunk_origin", Vec2f(cx, cy) * chunk_world);
+      glBindVertexArray(chunk.vao);
+      RENDER_STAT(draw_calls, 1);
+      RENDER_STAT(triangles, 2 * chunk.count);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, chunk.count);
+      drawn_chunks++;
+    }
+  }
+
+  glBindVertexArray(0);
+}
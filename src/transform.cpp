@@ -0,0 +1,366 @@
+#include <rama/transform.hpp>
+
+#include <rama/engine.hpp>
+#include <rama/jobs.hpp>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr u32 none = UINT32_MAX;
+
+// out = a * b, column major. out may alias b but not a.
+void multiply(const Mat4 &a, const Mat4 &b, Mat4 &out) {
+#if defined(__SSE2__)
+  const f32 *pa = glm::value_ptr(a);
+  const f32 *pb = glm::value_ptr(b);
+  f32 *po = glm::value_ptr(out);
+
+  __m128 a0 = _mm_loadu_ps(pa + 0);
+  __m128 a1 = _mm_loadu_ps(pa + 4);
+  __m128 a2 = _mm_loadu_ps(pa + 8);
+  __m128 a3 = _mm_loadu_ps(pa + 12);
+
+  for (u32 j = 0; j < 4; j++) {
+    __m128 r = _mm_mul_ps(a0, _mm_set1_ps(pb[j * 4 + 0]));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(pb[j * 4 + 1])));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(pb[j * 4 + 2])));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(pb[j * 4 + 3])));
+    _mm_storeu_ps(po + j * 4, r);
+  }
+#else
+  out = a * b;
+#endif
+}
+
+Mat4 compose(Vec3f position, Quat rotation, Vec3f scale) {
+  Mat4 result = glm::mat4_cast(rotation);
+  result[0] *= scale.x;
+  result[1] *= scale.y;
+  result[2] *= scale.z;
+  result[3] = Vec4f(position, 1.0f);
+  return result;
+}
+
+template <typename T>
+void permute(ArrayList<T> &values, const ArrayList<u32> &order) {
+  ArrayList<T> sorted(values.size());
+  for (u32 i = 0; i < order.size(); i++) {
+    sorted[i] = values[order[i]];
+  }
+  values = std::move(sorted);
+}
+
+template <typename T> void erase_range(ArrayList<T> &values, u32 at, u32 n) {
+  values.erase(values.begin() + at, values.begin() + at + n);
+}
+
+} // namespace
+
+TransformSystem TransformSystem::make() { return TransformSystem{}; }
+
+void TransformSystem::destroy() { *this = TransformSystem{}; }
+
+u32 TransformSystem::index(TransformHandle handle) {
+  if (!handle.valid() || handle.id >= dense_of.size() ||
+      dense_of[handle.id] == none) {
+    return none;
+  }
+
+  return dense_of[handle.id];
+}
+
+void TransformSystem::mark_dirty(u32 i) {
+  dirty[i] = 1;
+
+  // flag ancestors so update() can find this node without visiting
+  // every clean subtree
+  for (u32 p = parent[i]; p != none && !subtree_dirty[p]; p = parent[p]) {
+    subtree_dirty[p] = 1;
+  }
+}
+
+TransformHandle TransformSystem::create() { return create(TransformHandle{}); }
+
+TransformHandle TransformSystem::create(TransformHandle parent_handle) {
+  u32 parent_index = index(parent_handle);
+
+  u32 id;
+  if (!free_ids.empty()) {
+    id = free_ids.back();
+    free_ids.pop_back();
+  } else {
+    id = dense_of.size();
+    dense_of.push_back(none);
+  }
+
+  u32 i = parent.size();
+  dense_of[id] = i;
+  handle_of.push_back(id);
+
+  parent.push_back(parent_index);
+  subtree_size.push_back(1);
+  position.push_back(Vec3f(0));
+  rotation.push_back(Quat(1, 0, 0, 0));
+  scale.push_back(Vec3f(1));
+  local.push_back(Mat4(1));
+  world.push_back(Mat4(1));
+  dirty.push_back(0);
+  subtree_dirty.push_back(0);
+  changed_frame.push_back(0);
+
+  // appending a root keeps the depth first order, a child doesn't
+  if (parent_index == none) {
+    roots.push_back(i);
+  } else {
+    order_dirty = true;
+  }
+
+  mark_dirty(i);
+
+  return TransformHandle{id};
+}
+
+void TransformSystem::remove(TransformHandle handle) {
+  if (index(handle) == none) {
+    return;
+  }
+
+  if (order_dirty) {
+    rebuild_order();
+  }
+
+  u32 at = index(handle);
+  u32 n = subtree_size[at];
+
+  for (u32 i = at; i < at + n; i++) {
+    dense_of[handle_of[i]] = none;
+    free_ids.push_back(handle_of[i]);
+  }
+
+  if (parent[at] != none) {
+    for (u32 p = parent[at]; p != none; p = parent[p]) {
+      subtree_size[p] -= n;
+    }
+  }
+
+  erase_range(parent, at, n);
+  erase_range(subtree_size, at, n);
+  erase_range(position, at, n);
+  erase_range(rotation, at, n);
+  erase_range(scale, at, n);
+  erase_range(local, at, n);
+  erase_range(world, at, n);
+  erase_range(dirty, at, n);
+  erase_range(subtree_dirty, at, n);
+  erase_range(changed_frame, at, n);
+  erase_range(handle_of, at, n);
+
+  roots.clear();
+  for (u32 i = 0; i < parent.size(); i++) {
+    if (parent[i] != none && parent[i] >= at) {
+      parent[i] -= n;
+    }
+    if (parent[i] == none) {
+      roots.push_back(i);
+    }
+    dense_of[handle_of[i]] = i;
+  }
+}
+
+void TransformSystem::set_parent(TransformHandle child,
+                                 TransformHandle new_parent) {
+  u32 i = index(child);
+  u32 p = index(new_parent);
+  if (i == none) {
+    return;
+  }
+
+  for (u32 a = p; a != none; a = parent[a]) {
+    if (a == i) {
+      engine::error("TransformSystem::set_parent: would create a cycle");
+      return;
+    }
+  }
+
+  parent[i] = p;
+  order_dirty = true;
+  mark_dirty(i);
+}
+
+TransformHandle TransformSystem::get_parent(TransformHandle handle) {
+  u32 i = index(handle);
+  if (i == none || parent[i] == none) {
+    return TransformHandle{};
+  }
+
+  return TransformHandle{handle_of[parent[i]]};
+}
+
+void TransformSystem::set_position(TransformHandle handle, Vec3f value) {
+  if (u32 i = index(handle); i != none) {
+    position[i] = value;
+    mark_dirty(i);
+  }
+}
+
+void TransformSystem::set_rotation(TransformHandle handle, Quat value) {
+  if (u32 i = index(handle); i != none) {
+    rotation[i] = value;
+    mark_dirty(i);
+  }
+}
+
+void TransformSystem::set_scale(TransformHandle handle, Vec3f value) {
+  if (u32 i = index(handle); i != none) {
+    scale[i] = value;
+    mark_dirty(i);
+  }
+}
+
+Vec3f TransformSystem::get_position(TransformHandle handle) {
+  u32 i = index(handle);
+  return i != none ? position[i] : Vec3f(0);
+}
+
+Quat TransformSystem::get_rotation(TransformHandle handle) {
+  u32 i = index(handle);
+  return i != none ? rotation[i] : Quat(1, 0, 0, 0);
+}
+
+Vec3f TransformSystem::get_scale(TransformHandle handle) {
+  u32 i = index(handle);
+  return i != none ? scale[i] : Vec3f(1);
+}
+
+Mat4 TransformSystem::get_world(TransformHandle handle) {
+  u32 i = index(handle);
+  return i != none ? world[i] : Mat4(1);
+}
+
+void TransformSystem::rebuild_order() {
+  u32 n = parent.size();
+
+  ArrayList<u32> first_child(n, none), next_sibling(n, none);
+  for (u32 i = n; i-- > 0;) {
+    if (parent[i] != none) {
+      next_sibling[i] = first_child[parent[i]];
+      first_child[parent[i]] = i;
+    }
+  }
+
+  ArrayList<u32> order;
+  order.reserve(n);
+
+  Stack<u32> stack;
+  for (u32 i = 0; i < n; i++) {
+    if (parent[i] != none) {
+      continue;
+    }
+
+    stack.push(i);
+    while (!stack.empty()) {
+      u32 node = stack.top();
+      stack.pop();
+      order.push_back(node);
+
+      for (u32 c = first_child[node]; c != none; c = next_sibling[c]) {
+        stack.push(c);
+      }
+    }
+  }
+
+  ArrayList<u32> remap(n);
+  for (u32 i = 0; i < n; i++) {
+    remap[order[i]] = i;
+  }
+
+  permute(parent, order);
+  permute(position, order);
+  permute(rotation, order);
+  permute(scale, order);
+  permute(local, order);
+  permute(world, order);
+  permute(dirty, order);
+  permute(subtree_dirty, order);
+  permute(changed_frame, order);
+  permute(handle_of, order);
+
+  roots.clear();
+  for (u32 i = 0; i < n; i++) {
+    if (parent[i] != none) {
+      parent[i] = remap[parent[i]];
+    } else {
+      roots.push_back(i);
+    }
+    dense_of[handle_of[i]] = i;
+  }
+
+  // children follow their parent, so sizes accumulate back to front
+  subtree_size.assign(n, 1);
+  for (u32 i = n; i-- > 0;) {
+    if (parent[i] != none) {
+      subtree_size[parent[i]] += subtree_size[i];
+    }
+  }
+
+  // the dirty markers on ancestors may point at the old parents
+  for (u32 i = 0; i < n; i++) {
+    if (dirty[i]) {
+      mark_dirty(i);
+    }
+  }
+
+  order_dirty = false;
+}
+
+void TransformSystem::propagate(u32 root) {
+  u32 end = root + subtree_size[root];
+
+  for (u32 i = root; i < end;) {
+    u32 p = parent[i];
+    bool parent_changed = p != none && changed_frame[p] == frame;
+
+    if (!dirty[i] && !subtree_dirty[i] && !parent_changed) {
+      i += subtree_size[i];
+      continue;
+    }
+
+    if (dirty[i] || parent_changed) {
+      if (p == none) {
+        world[i] = local[i];
+      } else {
+        multiply(world[p], local[i], world[i]);
+      }
+      changed_frame[i] = frame;
+    }
+
+    dirty[i] = 0;
+    subtree_dirty[i] = 0;
+    i++;
+  }
+}
+
+void TransformSystem::update() {
+  if (order_dirty) {
+    rebuild_order();
+  }
+
+  frame++;
+
+  jobs::parallel_for(parent.size(), 1024, [&](u32 begin, u32 end, u32) {
+    for (u32 i = begin; i < end; i++) {
+      if (dirty[i]) {
+        local[i] = compose(position[i], rotation[i], scale[i]);
+      }
+    }
+  });
+
+  jobs::parallel_for(roots.size(), 16, [&](u32 begin, u32 end, u32) {
+    for (u32 r = begin; r < end; r++) {
+      propagate(roots[r]);
+    }
+  });
+}